@@ -0,0 +1,141 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+// Alocador bump-pointer: tudo que ele entrega e liberado de uma vez em
+// release(). Nenhum destrutor e chamado, entao so serve para objetos
+// trivialmente destrutiveis (os nos da AST e suas listas de filhos).
+class Arena {
+private:
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+    };
+
+    static const size_t CHUNK_SIZE = 256 * 1024;
+
+    Chunk *chunks = nullptr;
+    char *cur = nullptr;
+    char *end = nullptr;
+    size_t allocated = 0;
+
+    void *allocSlow(size_t size, size_t align) {
+        size_t need = sizeof(Chunk) + size + align;
+        size_t chunkSize = need > CHUNK_SIZE ? need : CHUNK_SIZE;
+        Chunk *c = (Chunk*) malloc(chunkSize);
+        if (c == nullptr)
+            throw bad_alloc();
+        c->size = chunkSize;
+        allocated += chunkSize;
+
+        char *start = (char*) (c + 1);
+        if (need > CHUNK_SIZE && chunks != nullptr) {
+            // bloco grande: fica atras do chunk corrente para nao desperdica-lo
+            c->next = chunks->next;
+            chunks->next = c;
+            return align_up(start, align);
+        }
+        c->next = chunks;
+        chunks = c;
+        cur = start;
+        end = (char*) c + chunkSize;
+        return alloc(size, align);
+    }
+
+    static char *align_up(char *p, size_t align) {
+        return (char*) (((uintptr_t) p + align - 1) & ~(uintptr_t) (align - 1));
+    }
+
+public:
+    Arena() {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        release();
+    }
+
+    void *alloc(size_t size, size_t align = alignof(max_align_t)) {
+        char *p = align_up(cur, align);
+        if (cur == nullptr || p + size > end)
+            return allocSlow(size, align);
+        cur = p + size;
+        return p;
+    }
+
+    template <typename T>
+    T *allocArray(size_t n) {
+        return (T*) alloc(n * sizeof(T), alignof(T));
+    }
+
+    void release() {
+        while (chunks != nullptr) {
+            Chunk *next = chunks->next;
+            free(chunks);
+            chunks = next;
+        }
+        cur = end = nullptr;
+        allocated = 0;
+    }
+
+    size_t bytesAllocated() const {
+        return allocated;
+    }
+};
+
+// Uma por thread: cada compilacao roda inteira numa thread e libera a
+// arena no fim, entao compilacoes paralelas nao disputam o alocador.
+inline thread_local Arena ast_arena;
+
+// Vetor que guarda os elementos na arena. Ao crescer copia para um bloco
+// novo e abandona o antigo, que volta junto com o resto no release().
+template <typename T>
+class ArenaList {
+private:
+    T *items = nullptr;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+
+public:
+    void push_back(const T &v) {
+        if (count == capacity) {
+            uint32_t ncap = capacity ? capacity * 2 : 2;
+            T *n = ast_arena.allocArray<T>(ncap);
+            if (count)
+                memcpy(n, items, count * sizeof(T));
+            items = n;
+            capacity = ncap;
+        }
+        items[count++] = v;
+    }
+
+    size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+    // Descarta os itens a partir de n (o espaco fica na arena).
+    void truncate(size_t n) {
+        if (n < count)
+            count = (uint32_t) n;
+    }
+    T &operator[](size_t i) {
+        return items[i];
+    }
+    T *begin() {
+        return items;
+    }
+    T *end() {
+        return items + count;
+    }
+};
+
+#endif
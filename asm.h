@@ -0,0 +1,531 @@
+#ifndef ASM_H
+#define ASM_H
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "bytecode.h"
+
+using namespace std;
+
+// Gerador de codigo x86-64 (--emit-asm, --native): assembly do gas, System V,
+// a partir do Chunk que o BytecodeCompiler faz da arvore checada. Os tipos,
+// as conversoes e os erros de execucao sao os do --vm; cada instrucao vira
+// algumas instrucoes de maquina sobre o vetor de registradores do Chunk,
+// que fica em vl_regs com %rbx apontando para ele. giez usa os registradores
+// de 32 bits (a volta no overflow e a da maquina), bevumbagon usa SSE2.
+//
+// bardugon, pikibagon e os erros ficam num runtime pequeno no fim do mesmo
+// arquivo, sobre a libc, entao o resultado monta e liga sozinho:
+//
+//     as -o prog.o prog.s
+//     ld -dynamic-linker /lib64/ld-linux-x86-64.so.2 -o prog prog.o -lc -lm
+//
+// que e o que o --native faz.
+
+static const char asm_runtime[] = R"(
+    .text
+vl_print_i:
+    subq $8, %rsp
+    movl %edi, %esi
+    leaq .Lvl_fmt_i(%rip), %rdi
+    xorl %eax, %eax
+    call printf@PLT
+    addq $8, %rsp
+    ret
+
+vl_print_f:
+    subq $8, %rsp
+    leaq .Lvl_fmt_f(%rip), %rdi
+    movl $1, %eax
+    call printf@PLT
+    addq $8, %rsp
+    ret
+
+vl_print_s:
+    subq $8, %rsp
+    movq %rdi, %rdx
+    leaq .Lvl_fmt_s(%rip), %rdi
+    xorl %eax, %eax
+    call printf@PLT
+    addq $8, %rsp
+    ret
+
+vl_print_b:
+    subq $8, %rsp
+    testl %edi, %edi
+    leaq .Lvl_dreje(%rip), %rax
+    leaq .Lvl_pirta(%rip), %rdi
+    cmovne %rax, %rdi
+    call puts@PLT
+    addq $8, %rsp
+    ret
+
+# vl_fail(linha, mensagem, complemento): nao volta
+vl_fail:
+    subq $8, %rsp
+    movq %rdx, %r8
+    movq %rsi, %rcx
+    movl %edi, %edx
+    leaq vl_file(%rip), %rsi
+    leaq .Lvl_fmt_fail(%rip), %rdi
+    xorl %eax, %eax
+    call printf@PLT
+    movl $1, %edi
+    call exit@PLT
+
+# le uma palavra em vl_buf; a linha em %edi
+vl_scan_word:
+    pushq %rbx
+    movl %edi, %ebx
+    movb $0, vl_buf(%rip)
+    leaq vl_buf(%rip), %rsi
+    leaq .Lvl_fmt_word(%rip), %rdi
+    xorl %eax, %eax
+    call scanf@PLT
+    cmpl $1, %eax
+    jne 1f
+    popq %rbx
+    ret
+1:  movl %ebx, %edi
+    leaq .Lvl_eof(%rip), %rsi
+    leaq vl_buf(%rip), %rdx
+    call vl_fail
+
+# a linha em %ebx e a pilha alinhada
+vl_scan_bad:
+    movl %ebx, %edi
+    leaq .Lvl_invalid(%rip), %rsi
+    leaq vl_buf(%rip), %rdx
+    call vl_fail
+
+vl_scan_i:
+    pushq %rbx
+    subq $16, %rsp
+    movl %edi, %ebx
+    call vl_scan_word
+    leaq vl_buf(%rip), %rdi
+    movq %rsp, %rsi
+    movl $10, %edx
+    call strtol@PLT
+    movq (%rsp), %rcx
+    cmpb $0, (%rcx)
+    jne vl_scan_bad
+    addq $16, %rsp
+    popq %rbx
+    ret
+
+vl_scan_f:
+    pushq %rbx
+    subq $16, %rsp
+    movl %edi, %ebx
+    call vl_scan_word
+    leaq vl_buf(%rip), %rdi
+    movq %rsp, %rsi
+    call strtod@PLT
+    movq (%rsp), %rcx
+    cmpb $0, (%rcx)
+    jne vl_scan_bad
+    addq $16, %rsp
+    popq %rbx
+    ret
+
+vl_scan_b:
+    pushq %rbx
+    movl %edi, %ebx
+    call vl_scan_word
+    leaq vl_buf(%rip), %rdi
+    leaq .Lvl_dreje(%rip), %rsi
+    call strcmp@PLT
+    testl %eax, %eax
+    je 1f
+    leaq vl_buf(%rip), %rdi
+    leaq .Lvl_true(%rip), %rsi
+    call strcmp@PLT
+    testl %eax, %eax
+    je 1f
+    leaq vl_buf(%rip), %rdi
+    leaq .Lvl_pirta(%rip), %rsi
+    call strcmp@PLT
+    testl %eax, %eax
+    je 2f
+    leaq vl_buf(%rip), %rdi
+    leaq .Lvl_false(%rip), %rsi
+    call strcmp@PLT
+    testl %eax, %eax
+    je 2f
+    jmp vl_scan_bad
+1:  movl $1, %eax
+    popq %rbx
+    ret
+2:  xorl %eax, %eax
+    popq %rbx
+    ret
+
+# texto em %rax, tamanho em %edx
+vl_scan_s:
+    pushq %rbx
+    call vl_scan_word
+    leaq vl_buf(%rip), %rdi
+    call strdup@PLT
+    movq %rax, %rbx
+    movq %rax, %rdi
+    call strlen@PLT
+    movq %rax, %rdx
+    movq %rbx, %rax
+    popq %rbx
+    ret
+
+# vl_compare_s(a, len a, b, len b): como string_view::compare
+vl_compare_s:
+    pushq %r12
+    pushq %r13
+    subq $8, %rsp
+    movl %esi, %r12d
+    movl %ecx, %r13d
+    movq %rdx, %rsi
+    movl %r12d, %edx
+    cmpl %r13d, %edx
+    cmova %r13d, %edx
+    call memcmp@PLT
+    testl %eax, %eax
+    jne 1f
+    cmpl %r13d, %r12d
+    seta %al
+    setb %cl
+    movzbl %al, %eax
+    movzbl %cl, %ecx
+    subl %ecx, %eax
+1:  addq $8, %rsp
+    popq %r13
+    popq %r12
+    ret
+
+    .section .rodata
+.Lvl_fmt_i: .asciz "%d\n"
+.Lvl_fmt_f: .asciz "%g\n"
+.Lvl_fmt_s: .asciz "%.*s\n"
+.Lvl_fmt_word: .asciz "%255s"
+.Lvl_fmt_fail: .asciz "%s:%d:0: runtime error: %s%s\n"
+.Lvl_dreje: .asciz "dreje"
+.Lvl_pirta: .asciz "pirta"
+.Lvl_true: .asciz "true"
+.Lvl_false: .asciz "false"
+.Lvl_eof: .asciz "fim da entrada em pikibagon"
+.Lvl_invalid: .asciz "entrada inv\303\241lida em pikibagon: "
+.Lvl_empty: .asciz ""
+    .align 16
+.Lvl_sign: .quad 0x8000000000000000, 0
+.Lvl_one: .double 1.0
+.Lvl_minus_one: .double -1.0
+
+    .bss
+vl_buf: .zero 256
+
+    .section .note.GNU-stack,"",@progbits
+)";
+
+class AsmGenerator {
+private:
+    struct Stub {
+        int line;
+        uint32_t message;
+    };
+
+    const char *file;
+    FILE *out;
+    Chunk chunk;
+    vector<string> messages;    // textos de vl_fail: os do Chunk e os do gerador
+    unordered_map<string, uint32_t> messageIds;
+    vector<Stub> stubs;         // desvios para vl_fail no fim do codigo
+
+    static uint64_t at(uint32_t r) {
+        return (uint64_t) r * sizeof(Reg);
+    }
+
+    uint32_t message(const string &text) {
+        auto it = messageIds.find(text);
+        if (it != messageIds.end())
+            return it->second;
+        messages.push_back(text);
+        return messageIds[text] = (uint32_t) messages.size() - 1;
+    }
+
+    uint32_t stub(int line, const string &text) {
+        stubs.push_back({line, message(text)});
+        return (uint32_t) stubs.size() - 1;
+    }
+
+    void text(string_view s) {
+        fputc('"', out);
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\')
+                fprintf(out, "\\%c", c);
+            else if (c < 32 || c >= 127)
+                fprintf(out, "\\%03o", c);
+            else
+                fputc(c, out);
+        }
+        fputc('"', out);
+    }
+
+    void jump(const char *cc, uint32_t target) {
+        fprintf(out, "    %s .L%u\n", cc, target);
+    }
+
+    void instr(size_t pc) {
+        const Instr &ins = chunk.code[pc];
+        int line = chunk.lines[pc];
+        uint64_t a = at(ins.a), b = at(ins.b), c = at(ins.c);
+        switch (ins.op) {
+        case OP_MOV:
+            fprintf(out, "    movups %" PRIu64 "(%%rbx), %%xmm0\n    movups %%xmm0, %" PRIu64 "(%%rbx)\n", b, a);
+            break;
+        case OP_I2F:
+            fprintf(out, "    cvtsi2sdl %" PRIu64 "(%%rbx), %%xmm0\n    movsd %%xmm0, %" PRIu64 "(%%rbx)\n", b, a);
+            break;
+        case OP_F2I:
+            fprintf(out, "    cvttsd2si %" PRIu64 "(%%rbx), %%eax\n    movl %%eax, %" PRIu64 "(%%rbx)\n", b, a);
+            break;
+        case OP_ADD_I:
+        case OP_SUB_I:
+        case OP_MUL_I: {
+            const char *op = ins.op == OP_ADD_I ? "addl" : ins.op == OP_SUB_I ? "subl" : "imull";
+            fprintf(out, "    movl %" PRIu64 "(%%rbx), %%eax\n    %s %" PRIu64 "(%%rbx), %%eax\n"
+                    "    movl %%eax, %" PRIu64 "(%%rbx)\n", b, op, c, a);
+            break;
+        }
+        case OP_DIV_I:
+        case OP_MOD_I: {
+            // y == -1 fica de fora do idiv, que daria SIGFPE com INT_MIN
+            bool div = ins.op == OP_DIV_I;
+            fprintf(out, "    movl %" PRIu64 "(%%rbx), %%ecx\n    movl %" PRIu64 "(%%rbx), %%eax\n", c, b);
+            fprintf(out, "    testl %%ecx, %%ecx\n    je .Lfail%u\n", stub(line, "divisão por zero"));
+            fprintf(out, "    cmpl $-1, %%ecx\n    jne 1f\n");
+            fprintf(out, div ? "    negl %%eax\n" : "    xorl %%eax, %%eax\n");
+            fprintf(out, "    jmp 2f\n1:  cltd\n    idivl %%ecx\n");
+            if (!div)
+                fprintf(out, "    movl %%edx, %%eax\n");
+            fprintf(out, "2:  movl %%eax, %" PRIu64 "(%%rbx)\n", a);
+            break;
+        }
+        case OP_ADD_F:
+        case OP_SUB_F:
+        case OP_MUL_F:
+        case OP_DIV_F: {
+            static const char *const ops[] = {"addsd", "subsd", "mulsd", "divsd"};
+            fprintf(out, "    movsd %" PRIu64 "(%%rbx), %%xmm0\n    %s %" PRIu64 "(%%rbx), %%xmm0\n"
+                    "    movsd %%xmm0, %" PRIu64 "(%%rbx)\n", b, ops[ins.op - OP_ADD_F], c, a);
+            break;
+        }
+        case OP_MOD_F:
+            fprintf(out, "    movsd %" PRIu64 "(%%rbx), %%xmm0\n    movsd %" PRIu64 "(%%rbx), %%xmm1\n"
+                    "    call fmod@PLT\n    movsd %%xmm0, %" PRIu64 "(%%rbx)\n", b, c, a);
+            break;
+        case OP_NEG_I:
+            fprintf(out, "    movl %" PRIu64 "(%%rbx), %%eax\n    negl %%eax\n    movl %%eax, %" PRIu64 "(%%rbx)\n", b, a);
+            break;
+        case OP_NEG_F:
+            fprintf(out, "    movsd %" PRIu64 "(%%rbx), %%xmm0\n    xorpd .Lvl_sign(%%rip), %%xmm0\n"
+                    "    movsd %%xmm0, %" PRIu64 "(%%rbx)\n", b, a);
+            break;
+        case OP_INC_I:
+            fprintf(out, "    addl $%d, %" PRIu64 "(%%rbx)\n", (int32_t) ins.b, a);
+            break;
+        case OP_INC_F:
+            fprintf(out, "    movsd %" PRIu64 "(%%rbx), %%xmm0\n    addsd %s(%%rip), %%xmm0\n"
+                    "    movsd %%xmm0, %" PRIu64 "(%%rbx)\n", a, (int32_t) ins.b < 0 ? ".Lvl_minus_one" : ".Lvl_one", a);
+            break;
+        case OP_JMP:
+            jump("jmp", ins.c);
+            break;
+        case OP_JT:
+        case OP_JF:
+            fprintf(out, "    cmpl $0, %" PRIu64 "(%%rbx)\n", a);
+            jump(ins.op == OP_JT ? "jne" : "je", ins.c);
+            break;
+        case OP_JLT_I:
+        case OP_JLE_I:
+        case OP_JEQ_I:
+        case OP_JNE_I: {
+            static const char *const cc[] = {"jl", "jle", "je", "jne"};
+            fprintf(out, "    movl %" PRIu64 "(%%rbx), %%eax\n    cmpl %" PRIu64 "(%%rbx), %%eax\n", a, b);
+            jump(cc[ins.op - OP_JLT_I], ins.c);
+            break;
+        }
+        case OP_JLT_F:
+            // a < b sem NaN: b acima de a
+            fprintf(out, "    movsd %" PRIu64 "(%%rbx), %%xmm0\n    ucomisd %" PRIu64 "(%%rbx), %%xmm0\n", b, a);
+            jump("ja", ins.c);
+            break;
+        case OP_JLE_F:
+        case OP_JEQ_F:
+        case OP_JNE_F: {
+            // pelo resultado de tres vias, como na VM: NaN conta como igual
+            static const char *const cc[] = {"jbe", "je", "jne"};
+            fprintf(out, "    movsd %" PRIu64 "(%%rbx), %%xmm0\n    ucomisd %" PRIu64 "(%%rbx), %%xmm0\n", a, b);
+            jump(cc[ins.op - OP_JLE_F], ins.c);
+            break;
+        }
+        case OP_JLT_S:
+        case OP_JLE_S:
+        case OP_JEQ_S:
+        case OP_JNE_S: {
+            static const char *const cc[] = {"jl", "jle", "je", "jne"};
+            fprintf(out, "    movq %" PRIu64 "(%%rbx), %%rdi\n    movl %" PRIu64 "(%%rbx), %%esi\n"
+                    "    movq %" PRIu64 "(%%rbx), %%rdx\n    movl %" PRIu64 "(%%rbx), %%ecx\n"
+                    "    call vl_compare_s\n    testl %%eax, %%eax\n", a, a + 8, b, b + 8);
+            jump(cc[ins.op - OP_JLT_S], ins.c);
+            break;
+        }
+        case OP_SCAN_I:
+        case OP_SCAN_B:
+            fprintf(out, "    movl $%d, %%edi\n    call %s\n    movl %%eax, %" PRIu64 "(%%rbx)\n",
+                    line, ins.op == OP_SCAN_I ? "vl_scan_i" : "vl_scan_b", a);
+            break;
+        case OP_SCAN_F:
+            fprintf(out, "    movl $%d, %%edi\n    call vl_scan_f\n    movsd %%xmm0, %" PRIu64 "(%%rbx)\n", line, a);
+            break;
+        case OP_SCAN_S:
+            fprintf(out, "    movl $%d, %%edi\n    call vl_scan_s\n    movq %%rax, %" PRIu64 "(%%rbx)\n"
+                    "    movl %%edx, %" PRIu64 "(%%rbx)\n", line, a, a + 8);
+            break;
+        case OP_PRINT_I:
+        case OP_PRINT_B:
+            fprintf(out, "    movl %" PRIu64 "(%%rbx), %%edi\n    call %s\n", a,
+                    ins.op == OP_PRINT_I ? "vl_print_i" : "vl_print_b");
+            break;
+        case OP_PRINT_F:
+            fprintf(out, "    movsd %" PRIu64 "(%%rbx), %%xmm0\n    call vl_print_f\n", a);
+            break;
+        case OP_PRINT_S:
+            fprintf(out, "    movq %" PRIu64 "(%%rbx), %%rdi\n    movl %" PRIu64 "(%%rbx), %%esi\n"
+                    "    call vl_print_s\n", a, a + 8);
+            break;
+        case OP_HALT:
+            fprintf(out, "    xorl %%edi, %%edi\n    call exit@PLT\n");
+            break;
+        default:
+            break;
+        }
+    }
+
+public:
+    AsmGenerator(const char *file, FILE *out) : file(file), out(out) {}
+
+    void generate(Program *program) {
+        chunk = BytecodeCompiler().compile(program);
+        for (const string &m : chunk.messages)
+            message(m);
+
+        // so os destinos de salto ganham rotulo
+        vector<bool> target(chunk.code.size() + 1, false);
+        for (const Instr &ins : chunk.code)
+            if (ins.op >= OP_JMP && ins.op <= OP_JNE_S)
+                target[ins.c] = true;
+
+        fprintf(out, "# %s\n    .text\n    .globl _start\n_start:\n", file);
+        fprintf(out, "    andq $-16, %%rsp\n    leaq vl_regs(%%rip), %%rbx\n");
+        for (size_t pc = 0; pc < chunk.code.size(); pc++) {
+            if (target[pc])
+                fprintf(out, ".L%zu:\n", pc);
+            const Instr &ins = chunk.code[pc];
+            if (ins.op == OP_FAIL) {
+                fprintf(out, "    jmp .Lfail%u\n", stub(chunk.lines[pc], chunk.messages[ins.a]));
+                continue;
+            }
+            instr(pc);
+        }
+        for (size_t k = 0; k < stubs.size(); k++)
+            fprintf(out, ".Lfail%zu:\n    movl $%d, %%edi\n    leaq .Lmsg%u(%%rip), %%rsi\n"
+                    "    leaq .Lvl_empty(%%rip), %%rdx\n    call vl_fail\n", k, stubs[k].line, stubs[k].message);
+
+        fprintf(out, "\n    .section .rodata\nvl_file: .asciz ");
+        text(file);
+        fputc('\n', out);
+        for (size_t k = 0; k < messages.size(); k++) {
+            fprintf(out, ".Lmsg%zu: .asciz ", k);
+            text(messages[k]);
+            fputc('\n', out);
+        }
+        for (size_t k = 0; k < chunk.consts.size(); k++) {
+            if (chunk.constTypes[k] != VT_STRING)
+                continue;
+            fprintf(out, ".Lstr%zu: .asciz ", k);
+            text(string_view(chunk.consts[k].str.s, chunk.consts[k].str.len));
+            fputc('\n', out);
+        }
+
+        // os registradores, com as constantes no lugar
+        fprintf(out, "\n    .data\n    .align 16\nvl_regs:\n");
+        if (chunk.constBase > 0)
+            fprintf(out, "    .zero %" PRIu64 "\n", at(chunk.constBase));
+        for (size_t k = 0; k < chunk.consts.size(); k++) {
+            const Reg &r = chunk.consts[k];
+            if (chunk.constTypes[k] == VT_STRING) {
+                fprintf(out, "    .quad .Lstr%zu, %u\n", k, r.str.len);
+                continue;
+            }
+            uint64_t words[2];
+            memcpy(words, &r, sizeof words);
+            fprintf(out, "    .quad 0x%" PRIx64 ", 0x%" PRIx64 "\n", words[0], words[1]);
+        }
+        uint32_t used = chunk.constBase + (uint32_t) chunk.consts.size();
+        if (chunk.numRegs > used)
+            fprintf(out, "    .zero %" PRIu64 "\n", at(chunk.numRegs - used));
+        fputs(asm_runtime, out);
+        fflush(out);
+    }
+};
+
+// Aspas simples para o shell.
+inline string shell_quote(const string &s) {
+    string q = "'";
+    for (char c : s) {
+        if (c == '\'')
+            q += "'\\''";
+        else
+            q += c;
+    }
+    return q + "'";
+}
+
+// O executavel fica ao lado do fonte: prog.val vira prog.
+inline string native_name(const char *file) {
+    string exe = file;
+    size_t dot = exe.rfind('.');
+    if (dot != string::npos && dot > 0 && exe.find('/', dot) == string::npos)
+        exe.erase(dot);
+    else
+        exe += ".out";
+    return exe;
+}
+
+// --native: monta com o as e liga com o ld. Devolve a mensagem de erro ou
+// uma string vazia.
+inline string build_native(Program *program, const char *file, string &exe) {
+    exe = native_name(file);
+    string obj = exe + ".o";
+
+    FILE *as = popen(("as -o " + shell_quote(obj) + " -").c_str(), "w");
+    if (as == NULL)
+        return "Não foi possível executar o as.";
+    AsmGenerator(file, as).generate(program);
+    if (pclose(as) != 0)
+        return "Falha ao montar " + obj + " com o as.";
+
+    string ld = "ld -dynamic-linker /lib64/ld-linux-x86-64.so.2 -o " + shell_quote(exe) + " "
+        + shell_quote(obj) + " -lc -lm";
+    int status = system(ld.c_str());
+    remove(obj.c_str());
+    if (status != 0)
+        return "Falha ao ligar " + exe + " com o ld.";
+    return "";
+}
+
+#endif
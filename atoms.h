@@ -0,0 +1,125 @@
+#ifndef ATOMS_H
+#define ATOMS_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+typedef uint32_t Atom;
+
+// Tabela de lexemas internados: cada identificador/string e copiado
+// uma unica vez e passa a ser representado por um id denso de 32 bits.
+class AtomTable {
+private:
+    struct Entry {
+        uint32_t hash;
+        uint32_t len;
+        const char *text;
+    };
+
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    vector<Entry> entries;
+    vector<uint32_t> slots; // id + 1, 0 = vazio
+    vector<char*> blocks;
+    size_t blockUsed = BLOCK_SIZE;
+
+    static uint32_t hashOf(const char *s, size_t len) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < len; i++) {
+            h ^= (unsigned char) s[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    const char *store(const char *s, size_t len) {
+        if (len + 1 > BLOCK_SIZE) {
+            char *big = (char*) malloc(len + 1);
+            blocks.insert(blocks.begin(), big);
+            memcpy(big, s, len);
+            big[len] = '\0';
+            return big;
+        }
+        if (blockUsed + len + 1 > BLOCK_SIZE) {
+            blocks.push_back((char*) malloc(BLOCK_SIZE));
+            blockUsed = 0;
+        }
+        char *dst = blocks.back() + blockUsed;
+        memcpy(dst, s, len);
+        dst[len] = '\0';
+        blockUsed += len + 1;
+        return dst;
+    }
+
+    void grow() {
+        vector<uint32_t> old(slots.empty() ? 256 : slots.size() * 2, 0);
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (uint32_t id = 0; id < entries.size(); id++) {
+            size_t i = entries[id].hash & mask;
+            while (slots[i] != 0)
+                i = (i + 1) & mask;
+            slots[i] = id + 1;
+        }
+    }
+
+public:
+    AtomTable() {}
+    AtomTable(const AtomTable&) = delete;
+    AtomTable& operator=(const AtomTable&) = delete;
+
+    ~AtomTable() {
+        for (char *b : blocks)
+            free(b);
+    }
+
+    Atom intern(const char *s, size_t len) {
+        if ((entries.size() + 1) * 2 > slots.size())
+            grow();
+        uint32_t h = hashOf(s, len);
+        size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        while (slots[i] != 0) {
+            const Entry &e = entries[slots[i] - 1];
+            if (e.hash == h && e.len == len && memcmp(e.text, s, len) == 0)
+                return slots[i] - 1;
+            i = (i + 1) & mask;
+        }
+        Atom id = (Atom) entries.size();
+        entries.push_back({h, (uint32_t) len, store(s, len)});
+        slots[i] = id + 1;
+        return id;
+    }
+
+    Atom intern(string_view s) {
+        return intern(s.data(), s.size());
+    }
+
+    string_view name(Atom a) const {
+        return string_view(entries[a].text, entries[a].len);
+    }
+
+    const char *c_str(Atom a) const {
+        return entries[a].text;
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+};
+
+// Uma por thread, como a ast_arena: os ids so valem dentro da thread que
+// os criou, que e a mesma que roda a compilacao inteira.
+inline thread_local AtomTable atoms;
+
+inline string atom_str(Atom a) {
+    return string(atoms.name(a));
+}
+
+#endif
@@ -0,0 +1,30 @@
+#!/bin/bash
+# Compara o despacho threaded (goto computado) com o switch nos kernels de
+# syt deste diretorio. Uso: bench.sh <valirian-threaded> <valirian-switch>
+# Cada kernel roda RUNS vezes em cada binario e fica o melhor tempo.
+set -e
+THREADED=${1:-./valirian-threaded}
+SWITCH=${2:-./valirian-switch}
+RUNS=${RUNS:-3}
+DIR=$(dirname "$0")
+TIMEFORMAT=%R
+
+best() {
+    local min=
+    for ((r = 0; r < RUNS; r++)); do
+        local t
+        t=$( { time "$1" --vm "$2" > /dev/null; } 2>&1 )
+        if [ -z "$min" ] || awk "BEGIN { exit !($t < $min) }"; then
+            min=$t
+        fi
+    done
+    echo "$min"
+}
+
+printf "%-16s %10s %10s %8s\n" kernel threaded switch ganho
+for kernel in "$DIR"/*.val; do
+    t=$(best "$THREADED" "$kernel")
+    s=$(best "$SWITCH" "$kernel")
+    gain=$(awk "BEGIN { printf \"%.0f%%\", ($s / $t - 1) * 100 }")
+    printf "%-16s %9ss %9ss %8s\n" "$(basename "$kernel" .val)" "$t" "$s" "$gain"
+done
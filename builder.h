@@ -0,0 +1,209 @@
+#ifndef BUILDER_H
+#define BUILDER_H
+
+#include "nodes.h"
+#include "flat_ast.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+int yyget_lineno(yyscan_t yyscanner);
+
+// Usado pelas acoes do bison: monta a arvore de ponteiros (Node) ou,
+// com -c, direto o AST compacto, sem passar pela arvore. Cada no recebe
+// a linha corrente do scanner da compilacao.
+class AstBuilder {
+private:
+    bool compact;
+    yyscan_t scanner = nullptr;
+
+    uint32_t line() {
+        return (uint32_t) yyget_lineno(scanner);
+    }
+
+    NodeRef ref(Node *n) {
+        n->setLineNo((int) line());
+        return NodeRef{n, 0};
+    }
+    NodeRef ref(uint32_t id) {
+        return NodeRef{nullptr, id};
+    }
+
+    uint32_t add(NodeKind k, uint32_t value) {
+        return flat.add(k, line(), value);
+    }
+    uint32_t add(NodeKind k, uint32_t value, initializer_list<uint32_t> children) {
+        return flat.add(k, line(), value, children);
+    }
+    uint32_t addList(NodeKind k) {
+        return flat.addList(k, line());
+    }
+
+public:
+    FlatAst flat;
+
+    AstBuilder(bool compact) : compact(compact) {}
+
+    void setScanner(yyscan_t s) {
+        scanner = s;
+    }
+
+    NodeRef program(NodeRef globals) {
+        if (compact) {
+            uint32_t p = addList(NK_PROGRAM);
+            flat.append(p, globals.id);
+            return ref(p);
+        }
+        Node *p = new Program();
+        p->append(globals.node);
+        return ref(p);
+    }
+
+    NodeRef stmts(NodeRef first) {
+        if (compact) {
+            uint32_t s = addList(NK_STMTS);
+            flat.append(s, first.id);
+            return ref(s);
+        }
+        Node *n = new Node();
+        n->append(first.node);
+        return ref(n);
+    }
+
+    NodeRef append(NodeRef list, NodeRef item) {
+        if (compact)
+            flat.append(list.id, item.id);
+        else
+            list.node->append(item.node);
+        return list;
+    }
+
+    NodeRef typeDec(const char *type) {
+        if (compact)
+            return ref(add(NK_TYPEDEC, type_code(type)));
+        return ref(new TypeDec(type));
+    }
+
+    NodeRef ident(Atom name) {
+        if (compact)
+            return ref(add(NK_IDENT, name));
+        return ref(new Ident(name));
+    }
+
+    NodeRef integer(int value) {
+        if (compact)
+            return ref(add(NK_INTEGER, FlatAst::bits(value)));
+        return ref(new Integer(value));
+    }
+
+    NodeRef floating(float value) {
+        if (compact)
+            return ref(add(NK_FLOAT, FlatAst::bits(value)));
+        return ref(new Float(value));
+    }
+
+    NodeRef str(Atom value) {
+        if (compact)
+            return ref(add(NK_STRING, value));
+        return ref(new String(value));
+    }
+
+    NodeRef boolean(bool value) {
+        if (compact)
+            return ref(add(value ? NK_TRUE : NK_FALSE, 0));
+        if (value)
+            return ref(new True());
+        return ref(new False());
+    }
+
+    NodeRef variable(const char *type, Atom name, NodeRef value) {
+        NodeRef t = typeDec(type);
+        if (compact)
+            return ref(add(NK_VARIABLE, name, {t.id, value.id}));
+        return ref(new Variable((TypeDec*) t.node, name, value.node));
+    }
+
+    NodeRef attribution(Atom name, NodeRef value) {
+        if (compact)
+            return ref(add(NK_ATTRIBUTION, name, {value.id}));
+        return ref(new Attribution(name, value.node));
+    }
+
+    NodeRef unary(NodeRef value, char op) {
+        if (compact)
+            return ref(add(NK_UNARY, (uint32_t) op, {value.id}));
+        return ref(new Unary(value.node, op));
+    }
+
+    NodeRef binaryOp(NodeRef v1, NodeRef v2, char op) {
+        if (compact)
+            return ref(add(NK_BINARYOP, (uint32_t) op, {v1.id, v2.id}));
+        return ref(new BinaryOp(v1.node, v2.node, op));
+    }
+
+    NodeRef condition(NodeRef v1, NodeRef v2, const char *op) {
+        if (compact)
+            return ref(add(NK_CONDITION, condition_op_code(op), {v1.id, v2.id}));
+        return ref(new Condition(v1.node, v2.node, op));
+    }
+
+    NodeRef pass(Atom ident, const char *op) {
+        if (compact)
+            return ref(add(NK_PASS, ident | (op[0] == '-' ? FlatAst::PASS_DEC : 0)));
+        return ref(new Pass(ident, op));
+    }
+
+    NodeRef ifStmt(NodeRef cond, NodeRef body) {
+        if (compact) {
+            flat.kind[body.id] = NK_BLOCK;
+            return ref(add(NK_IF, 0, {cond.id, body.id}));
+        }
+        return ref(new If(cond.node, body.node));
+    }
+
+    NodeRef ifElse(NodeRef cond, NodeRef ifBody, NodeRef elseBody) {
+        if (compact) {
+            flat.kind[ifBody.id] = NK_BLOCK;
+            flat.kind[elseBody.id] = NK_BLOCK;
+            return ref(add(NK_IFELSE, 0, {cond.id, ifBody.id, elseBody.id}));
+        }
+        return ref(new IfElse(cond.node, ifBody.node, elseBody.node));
+    }
+
+    NodeRef loop(NodeRef decl, NodeRef cond, NodeRef pass, NodeRef body) {
+        if (compact) {
+            flat.kind[body.id] = NK_BLOCK;
+            return ref(add(NK_LOOP, 0, {decl.id, cond.id, pass.id, body.id}));
+        }
+        return ref(new Loop(decl.node, cond.node, pass.node, body.node));
+    }
+
+    NodeRef scan() {
+        if (compact)
+            return ref(add(NK_SCAN, 0));
+        return ref(new Scan());
+    }
+
+    NodeRef scan(const char *type) {
+        NodeRef t = typeDec(type);
+        if (compact)
+            return ref(add(NK_SCAN, 0, {t.id}));
+        return ref(new Scan(t.node));
+    }
+
+    NodeRef print(NodeRef value) {
+        if (compact)
+            return ref(add(NK_PRINT, 0, {value.id}));
+        return ref(new Print(value.node));
+    }
+
+    string toDebug(NodeRef n) {
+        if (compact)
+            return flat.label(n.id);
+        return n.node->toDebug();
+    }
+};
+
+#endif
@@ -0,0 +1,524 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "interpreter.h"
+
+using namespace std;
+
+// Bytecode de registradores (--vm). Instrucoes de largura fixa: um opcode
+// tipado e tres operandos. Os registradores 0..frameSize-1 sao os slots das
+// variaveis (CheckVarDecl), depois vem as constantes e por fim os
+// temporarios das expressoes.
+enum OpCode : uint8_t {
+    OP_MOV,         // R[a] = R[b]
+    OP_I2F,         // R[a] = (double) R[b].i
+    OP_F2I,         // R[a] = (int) R[b].f
+    OP_ADD_I,       // R[a] = R[b] op R[c]
+    OP_SUB_I,
+    OP_MUL_I,
+    OP_DIV_I,
+    OP_MOD_I,
+    OP_ADD_F,
+    OP_SUB_F,
+    OP_MUL_F,
+    OP_DIV_F,
+    OP_MOD_F,
+    OP_NEG_I,       // R[a] = -R[b]
+    OP_NEG_F,
+    OP_INC_I,       // R[a] += (int32_t) b
+    OP_INC_F,
+    OP_JMP,         // pc = c
+    OP_JT,          // se R[a]: pc = c
+    OP_JF,          // se !R[a]: pc = c
+    OP_JLT_I,       // se R[a] op R[b]: pc = c
+    OP_JLE_I,
+    OP_JEQ_I,
+    OP_JNE_I,
+    OP_JLT_F,
+    OP_JLE_F,
+    OP_JEQ_F,
+    OP_JNE_F,
+    OP_JLT_S,
+    OP_JLE_S,
+    OP_JEQ_S,
+    OP_JNE_S,
+    OP_SCAN_I,      // R[a] = pikibagon
+    OP_SCAN_F,
+    OP_SCAN_S,
+    OP_SCAN_B,
+    OP_PRINT_I,     // bardugon(R[a])
+    OP_PRINT_F,
+    OP_PRINT_S,
+    OP_PRINT_B,
+    OP_FAIL,        // erro de execucao messages[a]
+    OP_HALT,
+    OP_COUNT
+};
+
+// Comparacoes dos saltos, na ordem de OP_JLT_x..OP_JNE_x.
+enum CompareOp : uint8_t {
+    CMP_LT,
+    CMP_LE,
+    CMP_EQ,
+    CMP_NE
+};
+
+struct Instr {
+    OpCode op;
+    uint32_t a, b, c;
+};
+
+// giez e iderennon (0 ou 1) ficam em i.
+union Reg {
+    int32_t i;
+    double f;
+    struct {
+        const char *s;
+        uint32_t len;
+    } str;
+};
+
+struct Chunk {
+    vector<Instr> code;
+    vector<int> lines;          // linha de cada instrucao, para os erros
+    vector<Reg> consts;         // valores iniciais de R[constBase..]
+    vector<ValueType> constTypes;   // o tipo de cada uma (iderennon e VT_INT)
+    vector<string> messages;    // textos de OP_FAIL
+    uint32_t constBase = 0;
+    uint32_t numRegs = 0;
+};
+
+// Junta os literais do programa, sem repetir, para virarem registradores
+// constantes.
+class ConstantPool : public Visitor<ConstantPool> {
+private:
+    Chunk &chunk;
+    unordered_map<int32_t, uint32_t> ints;
+    unordered_map<uint64_t, uint32_t> floats;
+    unordered_map<string_view, uint32_t> strings;
+
+    uint32_t add(Reg r, ValueType type) {
+        chunk.consts.push_back(r);
+        chunk.constTypes.push_back(type);
+        return chunk.constBase + (uint32_t) chunk.consts.size() - 1;
+    }
+
+public:
+    ConstantPool(Chunk &c) : chunk(c) {}
+
+    uint32_t intReg(int32_t v) {
+        auto it = ints.find(v);
+        if (it != ints.end())
+            return it->second;
+        Reg r{};
+        r.i = v;
+        return ints[v] = add(r, VT_INT);
+    }
+
+    uint32_t floatReg(double v) {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof bits);
+        auto it = floats.find(bits);
+        if (it != floats.end())
+            return it->second;
+        Reg r{};
+        r.f = v;
+        return floats[bits] = add(r, VT_FLOAT);
+    }
+
+    uint32_t stringReg(string_view v) {
+        auto it = strings.find(v);
+        if (it != strings.end())
+            return it->second;
+        Reg r{};
+        r.str.s = v.data();
+        r.str.len = (uint32_t) v.size();
+        return strings[v] = add(r, VT_STRING);
+    }
+
+    void collect(Node *n) {
+        walk(n);
+    }
+
+    void visitInteger(Integer *n) {
+        intReg(n->getValue());
+    }
+    void visitFloat(Float *n) {
+        floatReg(n->getValue());
+    }
+    void visitString(String *n) {
+        stringReg(literal_text(n->getValue()));
+    }
+    void visitTrue(True *) {
+        intReg(1);
+    }
+    void visitFalse(False *) {
+        intReg(0);
+    }
+};
+
+// Traduz a arvore checada para um Chunk. Os tipos sao todos conhecidos na
+// compilacao (o tipo de cada slot vem da sua declaracao), entao cada
+// operacao sai com o opcode do seu tipo; o que o interpretador so descobre
+// ao executar (tipos incompativeis, alvo nao declarado) vira um OP_FAIL no
+// mesmo ponto do programa.
+class BytecodeCompiler {
+private:
+    static const uint32_t NONE = UINT32_MAX;
+
+    struct Operand {
+        uint32_t reg;
+        ValueType type;
+    };
+
+    Chunk chunk;
+    ConstantPool pool;
+    vector<ValueType> slotType;
+    vector<Node*> spine;
+    uint32_t nextTemp = 0;
+    uint32_t maxReg = 0;
+    int line = 0;
+
+    uint32_t temp() {
+        uint32_t r = nextTemp++;
+        if (nextTemp > maxReg)
+            maxReg = nextTemp;
+        return r;
+    }
+
+    size_t emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        chunk.code.push_back({op, a, b, c});
+        chunk.lines.push_back(line);
+        return chunk.code.size() - 1;
+    }
+
+    size_t here() const {
+        return chunk.code.size();
+    }
+
+    void patch(vector<size_t> &jumps, size_t target) {
+        for (size_t j : jumps)
+            chunk.code[j].c = (uint32_t) target;
+        jumps.clear();
+    }
+
+    void fail(string_view msg, string_view arg = {}) {
+        string text(msg);
+        text.append(arg);
+        chunk.messages.push_back(text);
+        emit(OP_FAIL, (uint32_t) chunk.messages.size() - 1);
+    }
+
+    Operand toFloat(Operand v) {
+        if (v.type != VT_INT)
+            return v;
+        uint32_t r = temp();
+        emit(OP_I2F, r, v.reg);
+        return {r, VT_FLOAT};
+    }
+
+    Operand arith(char op, Operand a, Operand b, uint32_t dst) {
+        if ((a.type != VT_INT && a.type != VT_FLOAT) || (b.type != VT_INT && b.type != VT_FLOAT)) {
+            fail("operação aritmética com valor não numérico");
+            return {dst, VT_INT};
+        }
+        int base = OP_ADD_I;
+        ValueType type = VT_INT;
+        if (a.type == VT_FLOAT || b.type == VT_FLOAT) {
+            a = toFloat(a);
+            b = toFloat(b);
+            base = OP_ADD_F;
+            type = VT_FLOAT;
+        }
+        int k;
+        switch (op) {
+        case '+': k = 0; break;
+        case '-': k = 1; break;
+        case '*': k = 2; break;
+        case '/': k = 3; break;
+        default: k = 4; break;
+        }
+        emit((OpCode) (base + k), dst, a.reg, b.reg);
+        return {dst, type};
+    }
+
+    // Mesma ideia do Interpreter::evalBinary: a cadeia da esquerda e
+    // percorrida com um vetor. O acumulador usa um unico temporario e so
+    // a ultima operacao escreve no destino pedido.
+    Operand binary(BinaryOp *bo, uint32_t dst) {
+        size_t base = spine.size();
+        Node *n = bo;
+        while (n->getKind() == NK_BINARYOP) {
+            spine.push_back(n);
+            n = n->getChildren()[0];
+        }
+        uint32_t acc = temp();
+        Operand v = expr(n);
+        while (spine.size() > base) {
+            BinaryOp *op = static_cast<BinaryOp*>(spine.back());
+            spine.pop_back();
+            Operand r = expr(op->getChildren()[1]);
+            line = op->getLineNo();
+            bool last = spine.size() == base;
+            v = arith(op->getOperation(), v, r, last && dst != NONE ? dst : acc);
+            nextTemp = acc + 1;
+        }
+        if (v.reg != acc)
+            nextTemp = acc;
+        return v;
+    }
+
+    Operand expr(Node *n, uint32_t dst = NONE) {
+        line = n->getLineNo();
+        switch (n->getKind()) {
+        case NK_INTEGER: return {pool.intReg(static_cast<Integer*>(n)->getValue()), VT_INT};
+        case NK_FLOAT: return {pool.floatReg(static_cast<Float*>(n)->getValue()), VT_FLOAT};
+        case NK_TRUE: return {pool.intReg(1), VT_BOOL};
+        case NK_FALSE: return {pool.intReg(0), VT_BOOL};
+        case NK_STRING: return {pool.stringReg(literal_text(static_cast<String*>(n)->getValue())), VT_STRING};
+        case NK_IDENT: {
+            uint32_t slot = static_cast<Ident*>(n)->getSlot();
+            return {slot, slotType[slot]};
+        }
+        case NK_BINARYOP: return binary(static_cast<BinaryOp*>(n), dst);
+        case NK_UNARY: {
+            uint32_t r = dst != NONE ? dst : temp();
+            uint32_t mark = nextTemp;
+            Operand v = expr(n->getChildren()[0]);
+            line = n->getLineNo();
+            nextTemp = mark;
+            if (v.type == VT_INT)
+                emit(OP_NEG_I, r, v.reg);
+            else if (v.type == VT_FLOAT)
+                emit(OP_NEG_F, r, v.reg);
+            else
+                fail("operação aritmética com valor não numérico");
+            return {r, v.type};
+        }
+        default:
+            fail("expressão inválida");
+            return {dst != NONE ? dst : temp(), VT_INT};
+        }
+    }
+
+    // Salta para jumps quando o teste der when; senao segue em frente.
+    void branch(Node *n, bool when, vector<size_t> &jumps) {
+        uint32_t mark = nextTemp;
+        if (n->getKind() != NK_CONDITION) {
+            Operand v = expr(n);
+            line = n->getLineNo();
+            if (v.type != VT_BOOL)
+                fail("condição não booleana");
+            else
+                jumps.push_back(emit(when ? OP_JT : OP_JF, v.reg));
+            nextTemp = mark;
+            return;
+        }
+        Condition *c = static_cast<Condition*>(n);
+        const char *op = c->getOperation();
+        Node *l = c->getChildren()[0];
+        Node *r = c->getChildren()[1];
+        if (op[0] == '|' || op[0] == '&') {
+            // || com when verdadeiro e && com when falso saltam direto;
+            // nos outros casos o primeiro teste pula o segundo.
+            bool direct = (op[0] == '|') == when;
+            if (direct) {
+                branch(l, when, jumps);
+                branch(r, when, jumps);
+            } else {
+                vector<size_t> skip;
+                branch(l, !when, skip);
+                branch(r, when, jumps);
+                patch(skip, here());
+            }
+            return;
+        }
+        Operand a = expr(l);
+        Operand b = expr(r);
+        line = c->getLineNo();
+        int base;
+        if ((a.type == VT_INT || a.type == VT_FLOAT) && (b.type == VT_INT || b.type == VT_FLOAT)) {
+            if (a.type == VT_INT && b.type == VT_INT) {
+                base = OP_JLT_I;
+            } else {
+                a = toFloat(a);
+                b = toFloat(b);
+                base = OP_JLT_F;
+            }
+        } else if (a.type == b.type && a.type == VT_STRING) {
+            base = OP_JLT_S;
+        } else if (a.type == b.type && a.type == VT_BOOL) {
+            base = OP_JLT_I;
+        } else {
+            fail("comparação entre tipos diferentes");
+            nextTemp = mark;
+            return;
+        }
+        // Todas as comparacoes saem do mesmo resultado de tres vias c, como
+        // no interpretador, entao negar e trocar os operandos sao exatos.
+        CompareOp cmp;
+        bool swap = false;
+        switch (condition_op_code(op)) {
+        case 0: cmp = when ? CMP_LE : CMP_LT; swap = !when; break;    // <=
+        case 1: cmp = when ? CMP_LE : CMP_LT; swap = when; break;     // >=
+        case 2: cmp = when ? CMP_EQ : CMP_NE; break;                  // ==
+        case 3: cmp = when ? CMP_NE : CMP_EQ; break;                  // !=
+        case 4: cmp = when ? CMP_LT : CMP_LE; swap = !when; break;    // <
+        default: cmp = when ? CMP_LT : CMP_LE; swap = when; break;    // >
+        }
+        if (swap)
+            std::swap(a, b);
+        jumps.push_back(emit((OpCode) (base + cmp), a.reg, b.reg));
+        nextTemp = mark;
+    }
+
+    // Guarda v no slot com a conversao da atribuicao.
+    void store(uint32_t slot, Operand v) {
+        ValueType to = slotType[slot];
+        if (v.type == to) {
+            if (v.reg != slot)
+                emit(OP_MOV, slot, v.reg);
+        } else if (to == VT_INT && v.type == VT_FLOAT) {
+            emit(OP_F2I, slot, v.reg);
+        } else if (to == VT_FLOAT && v.type == VT_INT) {
+            emit(OP_I2F, slot, v.reg);
+        } else {
+            fail("tipo incompatível na atribuição");
+        }
+    }
+
+    void assign(uint32_t slot, Node *value) {
+        if (value->getKind() == NK_SCAN) {
+            emit((OpCode) (OP_SCAN_I + slotType[slot]), slot);
+            return;
+        }
+        uint32_t mark = nextTemp;
+        Operand v = expr(value, slot);
+        nextTemp = mark;
+        store(slot, v);
+    }
+
+    void step(Pass *p) {
+        line = p->getLineNo();
+        uint32_t slot = p->getSlot();
+        if (slot == Node::NO_SLOT) {
+            fail("variável não declarada: ", atoms.name(p->getAtom()));
+            return;
+        }
+        uint32_t d = p->getOperation()[0] == '-' ? (uint32_t) -1 : 1;
+        if (slotType[slot] == VT_INT)
+            emit(OP_INC_I, slot, d);
+        else if (slotType[slot] == VT_FLOAT)
+            emit(OP_INC_F, slot, d);
+        else
+            fail("operação aritmética com valor não numérico");
+    }
+
+    void stmt(Node *n) {
+        ArenaList<Node*> &c = n->getChildren();
+        line = n->getLineNo();
+        switch (n->getKind()) {
+        case NK_STMTS:
+        case NK_BLOCK:
+            for (Node *s : c)
+                stmt(s);
+            break;
+        case NK_VARIABLE: {
+            Variable *var = static_cast<Variable*>(n);
+            ValueType type = value_type(var->getType());
+            uint32_t slot = var->getSlot();
+            if (var->getValue()->getKind() == NK_SCAN) {
+                slotType[slot] = type;
+                assign(slot, var->getValue());
+                break;
+            }
+            // o valor ainda ve o tipo antigo do slot, como no interpretador
+            uint32_t mark = nextTemp;
+            Operand v = expr(var->getValue(), slot);
+            nextTemp = mark;
+            line = var->getLineNo();
+            slotType[slot] = type;
+            store(slot, v);
+            break;
+        }
+        case NK_ATTRIBUTION: {
+            Attribution *a = static_cast<Attribution*>(n);
+            if (a->getSlot() != Node::NO_SLOT) {
+                assign(a->getSlot(), a->getValue());
+                break;
+            }
+            if (a->getValue()->getKind() != NK_SCAN) {
+                uint32_t mark = nextTemp;
+                expr(a->getValue());
+                nextTemp = mark;
+            }
+            line = a->getLineNo();
+            fail("variável não declarada: ", atoms.name(a->getAtom()));
+            break;
+        }
+        case NK_PRINT: {
+            uint32_t mark = nextTemp;
+            Operand v = expr(c[0]);
+            emit((OpCode) (OP_PRINT_I + v.type), v.reg);
+            nextTemp = mark;
+            break;
+        }
+        case NK_IF: {
+            vector<size_t> skip;
+            branch(c[0], false, skip);
+            stmt(c[1]);
+            patch(skip, here());
+            break;
+        }
+        case NK_IFELSE: {
+            vector<size_t> other;
+            branch(c[0], false, other);
+            stmt(c[1]);
+            vector<size_t> end{emit(OP_JMP)};
+            patch(other, here());
+            stmt(c[2]);
+            patch(end, here());
+            break;
+        }
+        case NK_LOOP: {
+            // o teste fica no fim: uma instrucao de salto por volta
+            stmt(c[0]);
+            vector<size_t> test{emit(OP_JMP)};
+            size_t top = here();
+            stmt(c[3]);
+            step(static_cast<Pass*>(c[2]));
+            patch(test, here());
+            vector<size_t> again;
+            branch(c[1], true, again);
+            patch(again, top);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+public:
+    BytecodeCompiler() : pool(chunk) {}
+
+    Chunk compile(Program *program) {
+        uint32_t frame = program->getFrameSize();
+        slotType.assign(frame, VT_INT);
+        chunk.constBase = frame;
+        pool.collect(program);
+        nextTemp = maxReg = frame + (uint32_t) chunk.consts.size();
+        for (Node *n : program->getChildren())
+            stmt(n);
+        emit(OP_HALT);
+        chunk.numRegs = maxReg;
+        return std::move(chunk);
+    }
+};
+
+#endif
@@ -0,0 +1,370 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ir.h"
+
+using namespace std;
+
+// Traduz a arvore checada para um IrFunction em blocos basicos: lo, lo/daor,
+// syt e o curto-circuito de || e && viram arestas entre blocos. Os tipos
+// seguem as mesmas regras do BytecodeCompiler, e o que o interpretador so
+// descobre ao executar vira um bloco terminado em TERM_FAIL. Cada declaracao
+// e uma variavel nova (IrVar), mesmo quando reaproveita o slot de outra, e as
+// leituras e escritas saem como IR_LOAD/IR_STORE ate o SsaBuilder.
+class CfgBuilder {
+private:
+    struct Operand {
+        uint32_t v;
+        ValueType type;
+    };
+
+    IrFunction fn;
+    vector<uint32_t> slotVar;   // declaracao visivel em cada slot
+    vector<Node*> spine;
+    uint32_t cur = 0;
+    int line = 0;
+
+    uint32_t emit(IrInstr in) {
+        in.line = line;
+        return fn.add(cur, std::move(in));
+    }
+
+    Operand constant(Value k) {
+        IrInstr in;
+        in.op = IR_CONST;
+        in.type = k.type;
+        in.k = k;
+        return {emit(in), k.type};
+    }
+
+    Operand unary(IrOp op, ValueType type, uint32_t a) {
+        IrInstr in;
+        in.op = op;
+        in.type = type;
+        in.a = a;
+        return {emit(in), type};
+    }
+
+    Operand binaryOp(IrOp op, ValueType type, uint32_t a, uint32_t b) {
+        IrInstr in;
+        in.op = op;
+        in.type = type;
+        in.a = a;
+        in.b = b;
+        return {emit(in), type};
+    }
+
+    void terminate(IrTerm term, uint32_t s0 = IR_NONE, uint32_t s1 = IR_NONE, uint32_t cond = IR_NONE) {
+        IrBlock &b = fn.blocks[cur];
+        b.term = term;
+        b.succ[0] = s0;
+        b.succ[1] = s1;
+        b.cond = cond;
+        b.line = line;
+    }
+
+    // Termina o bloco atual com o erro; o que vier depois cai num bloco
+    // inalcancavel, que o SsaBuilder descarta.
+    Operand fail(string_view msg, string_view arg = "") {
+        string text(msg);
+        text.append(arg);
+        fn.messages.push_back(text);
+        terminate(TERM_FAIL);
+        fn.blocks[cur].message = (uint32_t) fn.messages.size() - 1;
+        cur = fn.newBlock();
+        IrInstr in;
+        in.op = IR_UNDEF;
+        return {emit(in), VT_INT};
+    }
+
+    Operand load(uint32_t var) {
+        IrInstr in;
+        in.op = IR_LOAD;
+        in.type = fn.vars[var].type;
+        in.var = var;
+        return {emit(in), in.type};
+    }
+
+    Operand toFloat(Operand v) {
+        return v.type == VT_INT ? unary(IR_I2F, VT_FLOAT, v.v) : v;
+    }
+
+    Operand arith(char op, Operand a, Operand b) {
+        if ((a.type != VT_INT && a.type != VT_FLOAT) || (b.type != VT_INT && b.type != VT_FLOAT))
+            return fail("operação aritmética com valor não numérico");
+        ValueType type = VT_INT;
+        if (a.type == VT_FLOAT || b.type == VT_FLOAT) {
+            a = toFloat(a);
+            b = toFloat(b);
+            type = VT_FLOAT;
+        }
+        IrOp ir;
+        switch (op) {
+        case '+': ir = IR_ADD; break;
+        case '-': ir = IR_SUB; break;
+        case '*': ir = IR_MUL; break;
+        case '/': ir = IR_DIV; break;
+        default: ir = IR_MOD; break;
+        }
+        return binaryOp(ir, type, a.v, b.v);
+    }
+
+    Operand binary(BinaryOp *bo) {
+        size_t base = spine.size();
+        Node *n = bo;
+        while (n->getKind() == NK_BINARYOP) {
+            spine.push_back(n);
+            n = n->getChildren()[0];
+        }
+        Operand v = expr(n);
+        while (spine.size() > base) {
+            BinaryOp *op = static_cast<BinaryOp*>(spine.back());
+            spine.pop_back();
+            Operand r = expr(op->getChildren()[1]);
+            line = op->getLineNo();
+            v = arith(op->getOperation(), v, r);
+        }
+        return v;
+    }
+
+    Operand expr(Node *n) {
+        line = n->getLineNo();
+        switch (n->getKind()) {
+        case NK_INTEGER: return constant(Value::ofInt(static_cast<Integer*>(n)->getValue()));
+        case NK_FLOAT: return constant(Value::ofFloat(static_cast<Float*>(n)->getValue()));
+        case NK_TRUE: return constant(Value::ofBool(true));
+        case NK_FALSE: return constant(Value::ofBool(false));
+        case NK_STRING: return constant(Value::ofString(literal_text(static_cast<String*>(n)->getValue())));
+        case NK_IDENT: {
+            Ident *id = static_cast<Ident*>(n);
+            if (id->getSlot() == Node::NO_SLOT || slotVar[id->getSlot()] == IR_NONE) {
+                fn.unresolved.push_back(id->getAtom());
+                return fail("variável não declarada: ", atoms.name(id->getAtom()));
+            }
+            Operand v = load(slotVar[id->getSlot()]);
+            fn.sources.push_back({id, slotVar[id->getSlot()], v.v});
+            return v;
+        }
+        case NK_BINARYOP: return binary(static_cast<BinaryOp*>(n));
+        case NK_UNARY: {
+            Operand v = expr(n->getChildren()[0]);
+            line = n->getLineNo();
+            if (v.type != VT_INT && v.type != VT_FLOAT)
+                return fail("operação aritmética com valor não numérico");
+            return unary(IR_NEG, v.type, v.v);
+        }
+        default:
+            return fail("expressão inválida");
+        }
+    }
+
+    // Termina o bloco atual saltando para t se n for verdadeiro e para f
+    // se nao; || e && ganham um bloco para o segundo teste.
+    void branch(Node *n, uint32_t t, uint32_t f) {
+        if (n->getKind() != NK_CONDITION) {
+            Operand v = expr(n);
+            line = n->getLineNo();
+            if (v.type != VT_BOOL)
+                fail("condição não booleana");
+            else
+                terminate(TERM_BR, t, f, v.v);
+            return;
+        }
+        Condition *c = static_cast<Condition*>(n);
+        const char *op = c->getOperation();
+        Node *l = c->getChildren()[0];
+        Node *r = c->getChildren()[1];
+        if (op[0] == '|' || op[0] == '&') {
+            uint32_t second = fn.newBlock();
+            if (op[0] == '|')
+                branch(l, t, second);
+            else
+                branch(l, second, f);
+            cur = second;
+            branch(r, t, f);
+            return;
+        }
+        Operand a = expr(l);
+        Operand b = expr(r);
+        line = c->getLineNo();
+        if ((a.type == VT_INT || a.type == VT_FLOAT) && (b.type == VT_INT || b.type == VT_FLOAT)) {
+            if (a.type != b.type) {
+                a = toFloat(a);
+                b = toFloat(b);
+            }
+        } else if (a.type != b.type) {
+            fail("comparação entre tipos diferentes");
+            return;
+        }
+        IrInstr in;
+        in.op = IR_CMP;
+        in.type = VT_BOOL;
+        in.cmp = (uint8_t) condition_op_code(op);
+        in.a = a.v;
+        in.b = b.v;
+        terminate(TERM_BR, t, f, emit(in));
+    }
+
+    // Guarda v na variavel com a conversao da atribuicao.
+    void store(uint32_t var, Operand v) {
+        ValueType to = fn.vars[var].type;
+        if (to == VT_INT && v.type == VT_FLOAT) {
+            v = unary(IR_F2I, VT_INT, v.v);
+        } else if (to == VT_FLOAT && v.type == VT_INT) {
+            v = unary(IR_I2F, VT_FLOAT, v.v);
+        } else if (v.type != to) {
+            fail("tipo incompatível na atribuição");
+            return;
+        }
+        IrInstr in;
+        in.op = IR_STORE;
+        in.type = to;
+        in.a = v.v;
+        in.var = var;
+        emit(in);
+    }
+
+    void assign(uint32_t var, Node *value) {
+        if (value->getKind() == NK_SCAN) {
+            IrInstr in;
+            in.op = IR_SCAN;
+            in.type = fn.vars[var].type;
+            store(var, {emit(in), in.type});
+            return;
+        }
+        store(var, expr(value));
+    }
+
+    void step(Pass *p) {
+        line = p->getLineNo();
+        if (p->getSlot() == Node::NO_SLOT || slotVar[p->getSlot()] == IR_NONE) {
+            fn.unresolved.push_back(p->getAtom());
+            fail("variável não declarada: ", atoms.name(p->getAtom()));
+            return;
+        }
+        uint32_t var = slotVar[p->getSlot()];
+        fn.sources.push_back({p, var, IR_NONE});
+        Operand v = load(var);
+        int d = p->getOperation()[0] == '-' ? -1 : 1;
+        if (v.type == VT_INT)
+            store(var, binaryOp(IR_ADD, VT_INT, v.v, constant(Value::ofInt(d)).v));
+        else if (v.type == VT_FLOAT)
+            store(var, binaryOp(IR_ADD, VT_FLOAT, v.v, constant(Value::ofFloat(d)).v));
+        else
+            fail("operação aritmética com valor não numérico");
+    }
+
+    void stmt(Node *n) {
+        ArenaList<Node*> &c = n->getChildren();
+        line = n->getLineNo();
+        switch (n->getKind()) {
+        case NK_STMTS:
+        case NK_BLOCK:
+            for (Node *s : c)
+                stmt(s);
+            break;
+        case NK_VARIABLE: {
+            Variable *v = static_cast<Variable*>(n);
+            fn.vars.push_back({v->getAtom(), value_type(v->getType())});
+            uint32_t var = (uint32_t) fn.vars.size() - 1;
+            fn.sources.push_back({v, var, IR_NONE});
+            if (v->getValue()->getKind() == NK_SCAN) {
+                slotVar[v->getSlot()] = var;
+                assign(var, v->getValue());
+                break;
+            }
+            // o valor ainda ve a declaracao antiga do slot
+            Operand value = expr(v->getValue());
+            line = v->getLineNo();
+            slotVar[v->getSlot()] = var;
+            store(var, value);
+            break;
+        }
+        case NK_ATTRIBUTION: {
+            Attribution *a = static_cast<Attribution*>(n);
+            if (a->getSlot() != Node::NO_SLOT && slotVar[a->getSlot()] != IR_NONE) {
+                fn.sources.push_back({a, slotVar[a->getSlot()], IR_NONE});
+                assign(slotVar[a->getSlot()], a->getValue());
+                break;
+            }
+            if (a->getValue()->getKind() != NK_SCAN)
+                expr(a->getValue());
+            line = a->getLineNo();
+            fn.unresolved.push_back(a->getAtom());
+            fail("variável não declarada: ", atoms.name(a->getAtom()));
+            break;
+        }
+        case NK_PRINT: {
+            Operand v = expr(c[0]);
+            IrInstr in;
+            in.op = IR_PRINT;
+            in.type = v.type;
+            in.a = v.v;
+            emit(in);
+            break;
+        }
+        case NK_IF: {
+            uint32_t then = fn.newBlock();
+            uint32_t join = fn.newBlock();
+            branch(c[0], then, join);
+            cur = then;
+            stmt(c[1]);
+            terminate(TERM_JMP, join);
+            cur = join;
+            break;
+        }
+        case NK_IFELSE: {
+            uint32_t then = fn.newBlock();
+            uint32_t other = fn.newBlock();
+            uint32_t join = fn.newBlock();
+            branch(c[0], then, other);
+            cur = then;
+            stmt(c[1]);
+            terminate(TERM_JMP, join);
+            cur = other;
+            stmt(c[2]);
+            terminate(TERM_JMP, join);
+            cur = join;
+            break;
+        }
+        case NK_LOOP: {
+            // cabecalho com o teste, corpo, passo e a volta ao cabecalho
+            stmt(c[0]);
+            uint32_t header = fn.newBlock();
+            uint32_t body = fn.newBlock();
+            uint32_t exit = fn.newBlock();
+            terminate(TERM_JMP, header);
+            cur = header;
+            branch(c[1], body, exit);
+            cur = body;
+            stmt(c[3]);
+            step(static_cast<Pass*>(c[2]));
+            terminate(TERM_JMP, header);
+            cur = exit;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+public:
+    IrFunction build(Program *program) {
+        slotVar.assign(program->getFrameSize(), IR_NONE);
+        cur = fn.newBlock();
+        for (Node *n : program->getChildren())
+            stmt(n);
+        terminate(TERM_RET);
+        // os blocos abertos depois de um fail tambem precisam de um fim
+        for (IrBlock &b : fn.blocks)
+            if (b.term == TERM_NONE)
+                b.term = TERM_RET;
+        fn.computePreds();
+        return std::move(fn);
+    }
+};
+
+#endif
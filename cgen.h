@@ -0,0 +1,547 @@
+#ifndef CGEN_H
+#define CGEN_H
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "asm.h"
+
+using namespace std;
+
+// Traducao para C (--emit-c, --native-c): a arvore checada vira uma unidade
+// de traducao sozinha, com uma variavel C tipada por Variable, for para o
+// syt, printf/scanf para bardugon e pikibagon e #line apontando para o
+// fonte .val. Os tipos seguem as regras do BytecodeCompiler, e o que la
+// vira OP_FAIL aqui vira uma chamada a vl_fail no mesmo ponto; as contas de
+// giez passam por funcoes que dao a volta no overflow sem UB, entao o gcc
+// pode otimizar a vontade. Quando os dois lados de uma conta podem parar o
+// programa, eles passam por temporarios para manter a ordem de avaliacao.
+
+static const char c_prelude[] = R"(#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *s;
+    unsigned len;
+} vl_str;
+
+static char vl_buf[256];
+
+static int vl_fail(int line, const char *msg, const char *arg) {
+    printf("%s:%d:0: runtime error: %s%s\n", vl_file, line, msg, arg);
+    exit(1);
+}
+
+static inline int vl_add(int a, int b) { return (int) ((unsigned) a + (unsigned) b); }
+static inline int vl_sub(int a, int b) { return (int) ((unsigned) a - (unsigned) b); }
+static inline int vl_mul(int a, int b) { return (int) ((unsigned) a * (unsigned) b); }
+static inline int vl_neg(int a) { return (int) (0u - (unsigned) a); }
+
+static inline int vl_div(int a, int b, int line) {
+    if (b == 0)
+        vl_fail(line, "divis\303\243o por zero", "");
+    return b == -1 ? vl_neg(a) : a / b;
+}
+
+static inline int vl_mod(int a, int b, int line) {
+    if (b == 0)
+        vl_fail(line, "divis\303\243o por zero", "");
+    return b == -1 ? 0 : a % b;
+}
+
+/* como o cvttsd2si: fora da faixa (e NaN) da INT_MIN */
+static inline int vl_f2i(double x) {
+    return x > -2147483649.0 && x < 2147483648.0 ? (int) x : INT_MIN;
+}
+
+/* pelo resultado de tres vias: NaN conta como igual */
+static inline int vl_eq_f(double a, double b) { return !(a < b) && !(a > b); }
+
+static inline int vl_cmp_s(vl_str a, vl_str b) {
+    int c = memcmp(a.s, b.s, a.len < b.len ? a.len : b.len);
+    return c != 0 ? c : (a.len > b.len) - (a.len < b.len);
+}
+
+static inline void vl_print_s(vl_str v) { printf("%.*s\n", (int) v.len, v.s); }
+
+static void vl_word(int line) {
+    vl_buf[0] = '\0';
+    if (scanf("%255s", vl_buf) != 1)
+        vl_fail(line, "fim da entrada em pikibagon", vl_buf);
+}
+
+static inline int vl_scan_i(int line) {
+    char *end;
+    vl_word(line);
+    long x = strtol(vl_buf, &end, 10);
+    if (*end != '\0')
+        vl_fail(line, "entrada inv\303\241lida em pikibagon: ", vl_buf);
+    return (int) x;
+}
+
+static inline double vl_scan_f(int line) {
+    char *end;
+    vl_word(line);
+    double x = strtod(vl_buf, &end);
+    if (*end != '\0')
+        vl_fail(line, "entrada inv\303\241lida em pikibagon: ", vl_buf);
+    return x;
+}
+
+static inline vl_str vl_scan_s(int line) {
+    vl_word(line);
+    vl_str v = {strdup(vl_buf), (unsigned) strlen(vl_buf)};
+    return v;
+}
+
+static inline int vl_scan_b(int line) {
+    vl_word(line);
+    if (strcmp(vl_buf, "dreje") == 0 || strcmp(vl_buf, "true") == 0)
+        return 1;
+    if (strcmp(vl_buf, "pirta") != 0 && strcmp(vl_buf, "false") != 0)
+        vl_fail(line, "entrada inv\303\241lida em pikibagon: ", vl_buf);
+    return 0;
+}
+
+)";
+
+class CGenerator {
+private:
+    struct Expr {
+        string code;
+        ValueType type;
+        bool fails;     // pode parar o programa
+    };
+
+    // Uma operacao em volta do operando esquerdo: prefix + esquerdo + suffix.
+    struct Wrap {
+        string prefix;
+        string suffix;
+    };
+
+    const char *file;
+    string body;
+    string temps;
+    uint32_t tempCount = 0;
+    int depth = 1;
+    int lastLine = -1;
+    vector<ValueType> slotType;
+    vector<string> slotName;
+    vector<Node*> spine;
+
+    static const char *ctype(ValueType t) {
+        static const char *const names[] = {"int", "double", "vl_str", "int"};
+        return names[t];
+    }
+
+    static const char *zero(ValueType t) {
+        static const char *const values[] = {"0", "0.0", "((vl_str){\"\", 0})", "0"};
+        return values[t];
+    }
+
+    static char scanSuffix(ValueType t) {
+        return "ifsb"[t];
+    }
+
+    static string quote(string_view s) {
+        string q = "\"";
+        char buf[8];
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                q += '\\';
+                q += (char) c;
+            } else if (c < 32 || c >= 127) {
+                snprintf(buf, sizeof buf, "\\%03o", c);
+                q += buf;
+            } else {
+                q += (char) c;
+            }
+        }
+        return q + "\"";
+    }
+
+    static string name(Variable *var) {
+        string n = "v" + to_string(var->getSlot()) + "_";
+        for (char c : var->getName())
+            n += isalnum((unsigned char) c) ? c : '_';
+        return n;
+    }
+
+    static string fail(int line, string_view msg, string_view arg = "") {
+        return "vl_fail(" + to_string(line) + ", " + quote(msg) + ", " + quote(arg) + ")";
+    }
+
+    static string discard(const Expr &e) {
+        return "(void) (" + e.code + "), ";
+    }
+
+    string temp(ValueType t) {
+        string n = "vl_t" + to_string(tempCount++);
+        temps += "    " + string(ctype(t)) + " " + n + ";\n";
+        return n;
+    }
+
+    void emit(const string &s) {
+        body.append((size_t) depth * 4, ' ');
+        body += s;
+        body += '\n';
+    }
+
+    void lineOf(Node *n) {
+        if (n->getLineNo() == lastLine)
+            return;
+        lastLine = n->getLineNo();
+        body += "#line " + to_string(lastLine) + " " + quote(file) + "\n";
+    }
+
+    static string intLiteral(int v) {
+        if (v == INT32_MIN)
+            return "(-2147483647 - 1)";
+        return v < 0 ? "(" + to_string(v) + ")" : to_string(v);
+    }
+
+    static string floatLiteral(double v) {
+        if (std::isnan(v))
+            return "NAN";
+        if (std::isinf(v))
+            return v < 0 ? "(-HUGE_VAL)" : "HUGE_VAL";
+        char buf[64];
+        snprintf(buf, sizeof buf, "%a", v);
+        return v < 0 ? "(" + string(buf) + ")" : string(buf);
+    }
+
+    static bool nonzeroLiteral(Node *n) {
+        return n->getKind() == NK_INTEGER && static_cast<Integer*>(n)->getValue() != 0;
+    }
+
+    // left e o operando esquerdo, que fica fora do texto (em \1).
+    Wrap arith(char op, ValueType &type, bool &fails, const Expr &r, Node *right, int line) {
+        if ((type != VT_INT && type != VT_FLOAT) || (r.type != VT_INT && r.type != VT_FLOAT)) {
+            type = VT_INT;
+            fails = true;
+            return {"((void) (", "), " + discard(r) + fail(line, "operação aritmética com valor não numérico") + ")"};
+        }
+        bool sequence = fails && r.fails;
+        string left = "\1", rc = r.code;
+        string ta, tb;
+        if (sequence) {
+            ta = temp(type);
+            tb = temp(r.type);
+            left = ta;
+            rc = tb;
+        }
+        string code;
+        if (type == VT_INT && r.type == VT_INT) {
+            switch (op) {
+            case '+': code = "vl_add(" + left + ", " + rc + ")"; break;
+            case '-': code = "vl_sub(" + left + ", " + rc + ")"; break;
+            case '*': code = "vl_mul(" + left + ", " + rc + ")"; break;
+            default:
+                code = string(op == '/' ? "vl_div(" : "vl_mod(") + left + ", " + rc + ", " + to_string(line) + ")";
+                fails |= !nonzeroLiteral(right);
+                break;
+            }
+        } else {
+            if (type == VT_INT)
+                left = "(double) (" + left + ")";
+            if (r.type == VT_INT)
+                rc = "(double) (" + rc + ")";
+            if (op == '%')
+                code = "fmod(" + left + ", " + rc + ")";
+            else
+                code = "(" + left + " " + op + " " + rc + ")";
+            type = VT_FLOAT;
+        }
+        fails |= r.fails;
+        if (sequence)
+            return {"(" + ta + " = ", ", " + tb + " = " + r.code + ", " + code + ")"};
+        size_t at = code.find('\1');
+        return {code.substr(0, at), code.substr(at + 1)};
+    }
+
+    // Como no BytecodeCompiler::binary, a cadeia da esquerda vai num vetor;
+    // o texto sai dos prefixos de fora para dentro e dos sufixos de dentro
+    // para fora, sem copiar o operando esquerdo a cada nivel. A cada
+    // CHAIN_CHUNK niveis o acumulado vai para um temporario, em comandos de
+    // uma expressao-comando do GNU C: o gcc nao aguenta um milhao de
+    // chamadas (nem de virgulas) aninhadas. Cadeias curtas ficam em C puro.
+    static constexpr size_t CHAIN_CHUNK = 64;
+
+    Expr binary(BinaryOp *bo) {
+        size_t base = spine.size();
+        Node *n = bo;
+        while (n->getKind() == NK_BINARYOP) {
+            spine.push_back(n);
+            n = n->getChildren()[0];
+        }
+        Expr acc = expr(n);
+        vector<string> prefixes;
+        string suffixes, steps;
+        string accTemp[VT_BOOL + 1];
+        auto collapse = [&]() {
+            string code;
+            for (size_t k = prefixes.size(); k-- > 0;)
+                code += prefixes[k];
+            code += acc.code;
+            code += suffixes;
+            acc.code = std::move(code);
+            prefixes.clear();
+            suffixes.clear();
+        };
+        while (spine.size() > base) {
+            BinaryOp *op = static_cast<BinaryOp*>(spine.back());
+            spine.pop_back();
+            Node *right = op->getChildren()[1];
+            Expr r = expr(right);
+            Wrap w = arith(op->getOperation(), acc.type, acc.fails, r, right, op->getLineNo());
+            prefixes.push_back(std::move(w.prefix));
+            suffixes += w.suffix;
+            if (prefixes.size() == CHAIN_CHUNK && spine.size() > base) {
+                collapse();
+                string &t = accTemp[acc.type];
+                if (t.empty())
+                    t = temp(acc.type);
+                steps += t + " = " + acc.code + "; ";
+                acc.code = t;
+            }
+        }
+        collapse();
+        if (!steps.empty())
+            acc.code = "({ " + steps + acc.code + "; })";
+        return acc;
+    }
+
+    Expr expr(Node *n) {
+        int line = n->getLineNo();
+        switch (n->getKind()) {
+        case NK_INTEGER: return {intLiteral(static_cast<Integer*>(n)->getValue()), VT_INT, false};
+        case NK_FLOAT: return {floatLiteral(static_cast<Float*>(n)->getValue()), VT_FLOAT, false};
+        case NK_TRUE: return {"1", VT_BOOL, false};
+        case NK_FALSE: return {"0", VT_BOOL, false};
+        case NK_STRING: {
+            string_view s = literal_text(static_cast<String*>(n)->getValue());
+            return {"((vl_str){" + quote(s) + ", " + to_string(s.size()) + "})", VT_STRING, false};
+        }
+        case NK_IDENT: {
+            uint32_t slot = static_cast<Ident*>(n)->getSlot();
+            if (slot == Node::NO_SLOT)
+                break;
+            return {slotName[slot], slotType[slot], false};
+        }
+        case NK_BINARYOP: return binary(static_cast<BinaryOp*>(n));
+        case NK_UNARY: {
+            Expr v = expr(n->getChildren()[0]);
+            if (v.type == VT_INT)
+                return {"vl_neg(" + v.code + ")", VT_INT, v.fails};
+            if (v.type == VT_FLOAT)
+                return {"(-" + v.code + ")", VT_FLOAT, v.fails};
+            return {"(" + discard(v) + fail(line, "operação aritmética com valor não numérico") + ")", VT_INT, true};
+        }
+        default:
+            break;
+        }
+        return {fail(line, "expressão inválida"), VT_INT, true};
+    }
+
+    string cond(Node *n) {
+        if (n->getKind() != NK_CONDITION) {
+            Expr v = expr(n);
+            if (v.type != VT_BOOL)
+                return "(" + discard(v) + fail(n->getLineNo(), "condição não booleana") + ")";
+            return v.code;
+        }
+        const char *op = static_cast<Condition*>(n)->getOperation();
+        Node *l = n->getChildren()[0];
+        Node *r = n->getChildren()[1];
+        if (op[0] == '|' || op[0] == '&')
+            return "(" + cond(l) + (op[0] == '|' ? " || " : " && ") + cond(r) + ")";
+
+        Expr a = expr(l);
+        Expr b = expr(r);
+        string pre = "(", post = ")";
+        if (a.fails && b.fails) {
+            string ta = temp(a.type), tb = temp(b.type);
+            pre = "(" + ta + " = " + a.code + ", " + tb + " = " + b.code + ", ";
+            a.code = ta;
+            b.code = tb;
+        }
+        static const char *const cops[] = {"<=", ">=", "==", "!=", "<", ">"};
+        uint32_t code = condition_op_code(op);
+        bool numeric = (a.type == VT_INT || a.type == VT_FLOAT) && (b.type == VT_INT || b.type == VT_FLOAT);
+        if (numeric && (a.type == VT_FLOAT || b.type == VT_FLOAT)) {
+            string x = a.type == VT_INT ? "(double) (" + a.code + ")" : a.code;
+            string y = b.type == VT_INT ? "(double) (" + b.code + ")" : b.code;
+            switch (code) {
+            case 0: return pre + "!(" + x + " > " + y + ")" + post;
+            case 1: return pre + "!(" + x + " < " + y + ")" + post;
+            case 2: return pre + "vl_eq_f(" + x + ", " + y + ")" + post;
+            case 3: return pre + "!vl_eq_f(" + x + ", " + y + ")" + post;
+            default: return pre + x + " " + cops[code] + " " + y + post;
+            }
+        }
+        if (numeric || (a.type == b.type && a.type == VT_BOOL))
+            return pre + a.code + " " + cops[code] + " " + b.code + post;
+        if (a.type == b.type && a.type == VT_STRING)
+            return pre + "vl_cmp_s(" + a.code + ", " + b.code + ") " + cops[code] + " 0" + post;
+        return "(" + discard(a) + discard(b) + fail(n->getLineNo(), "comparação entre tipos diferentes") + ")";
+    }
+
+    // v com a conversao da atribuicao para o tipo to.
+    string convert(const Expr &v, ValueType to, int line) {
+        if (v.type == to)
+            return v.code;
+        if (to == VT_INT && v.type == VT_FLOAT)
+            return "vl_f2i(" + v.code + ")";
+        if (to == VT_FLOAT && v.type == VT_INT)
+            return "(double) (" + v.code + ")";
+        return "(" + discard(v) + fail(line, "tipo incompatível na atribuição") + ", " + zero(to) + ")";
+    }
+
+    string scan(ValueType type, int line) {
+        return string("vl_scan_") + scanSuffix(type) + "(" + to_string(line) + ")";
+    }
+
+    // "tipo nome = valor", para um comando ou para o inicio de um for.
+    string declare(Variable *var) {
+        ValueType type = value_type(var->getType());
+        uint32_t slot = var->getSlot();
+        string init;
+        if (var->getValue()->getKind() == NK_SCAN)
+            init = scan(type, var->getLineNo());
+        else    // o valor ainda ve o slot antigo, como no interpretador
+            init = convert(expr(var->getValue()), type, var->getLineNo());
+        slotType[slot] = type;
+        slotName[slot] = name(var);
+        return string(ctype(type)) + " " + slotName[slot] + " = " + init;
+    }
+
+    string step(Pass *p) {
+        uint32_t slot = p->getSlot();
+        if (slot == Node::NO_SLOT)
+            return fail(p->getLineNo(), "variável não declarada: ", atoms.name(p->getAtom()));
+        bool down = p->getOperation()[0] == '-';
+        const string &v = slotName[slot];
+        if (slotType[slot] == VT_INT)
+            return v + " = vl_add(" + v + ", " + (down ? "-1" : "1") + ")";
+        if (slotType[slot] == VT_FLOAT)
+            return v + (down ? " -= 1.0" : " += 1.0");
+        return fail(p->getLineNo(), "operação aritmética com valor não numérico");
+    }
+
+    void block(Node *n) {
+        depth++;
+        for (Node *s : n->getChildren())
+            stmt(s);
+        depth--;
+    }
+
+    void stmt(Node *n) {
+        ArenaList<Node*> &c = n->getChildren();
+        // o no do lo e do syt tem a linha do fim; o cabecalho fica com a do teste
+        if (n->getKind() == NK_IF || n->getKind() == NK_IFELSE || n->getKind() == NK_LOOP)
+            lineOf(c[0]);
+        else if (n->getKind() != NK_STMTS)
+            lineOf(n);
+        switch (n->getKind()) {
+        case NK_STMTS:
+            for (Node *s : c)
+                stmt(s);
+            break;
+        case NK_BLOCK:
+            emit("{");
+            block(n);
+            emit("}");
+            break;
+        case NK_VARIABLE:
+            emit(declare(static_cast<Variable*>(n)) + ";");
+            break;
+        case NK_ATTRIBUTION: {
+            Attribution *a = static_cast<Attribution*>(n);
+            uint32_t slot = a->getSlot();
+            bool scanned = a->getValue()->getKind() == NK_SCAN;
+            if (slot == Node::NO_SLOT) {
+                string undeclared = fail(a->getLineNo(), "variável não declarada: ", atoms.name(a->getAtom()));
+                emit((scanned ? "" : discard(expr(a->getValue()))) + undeclared + ";");
+            } else if (scanned) {
+                emit(slotName[slot] + " = " + scan(slotType[slot], a->getLineNo()) + ";");
+            } else {
+                emit(slotName[slot] + " = " + convert(expr(a->getValue()), slotType[slot], a->getLineNo()) + ";");
+            }
+            break;
+        }
+        case NK_PRINT: {
+            Expr v = expr(c[0]);
+            switch (v.type) {
+            case VT_INT: emit("printf(\"%d\\n\", " + v.code + ");"); break;
+            case VT_FLOAT: emit("printf(\"%g\\n\", " + v.code + ");"); break;
+            case VT_STRING: emit("vl_print_s(" + v.code + ");"); break;
+            case VT_BOOL: emit("puts(" + v.code + " ? \"dreje\" : \"pirta\");"); break;
+            }
+            break;
+        }
+        case NK_IF:
+            emit("if (" + cond(c[0]) + ") {");
+            block(c[1]);
+            emit("}");
+            break;
+        case NK_IFELSE:
+            emit("if (" + cond(c[0]) + ") {");
+            block(c[1]);
+            emit("} else {");
+            block(c[2]);
+            emit("}");
+            break;
+        case NK_LOOP: {
+            // o corpo tem slots novos, entao o teste e o passo ja podem sair
+            string init = declare(static_cast<Variable*>(c[0]));
+            string test = cond(c[1]);
+            string next = step(static_cast<Pass*>(c[2]));
+            emit("for (" + init + "; " + test + "; " + next + ") {");
+            block(c[3]);
+            emit("}");
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+public:
+    CGenerator(const char *file) : file(file) {}
+
+    void generate(Program *program, FILE *out) {
+        slotType.assign(program->getFrameSize(), VT_INT);
+        slotName.assign(program->getFrameSize(), "");
+        for (Node *n : program->getChildren())
+            stmt(n);
+
+        fprintf(out, "static const char vl_file[] = %s;\n", quote(file).c_str());
+        fputs(c_prelude, out);
+        fputs("int main(void) {\n", out);
+        fputs(temps.c_str(), out);
+        fputs(body.c_str(), out);
+        fputs("    return 0;\n}\n", out);
+        fflush(out);
+    }
+};
+
+// --native-c: compila a traducao com o gcc -O2. Devolve a mensagem de erro
+// ou uma string vazia.
+inline string build_native_c(Program *program, const char *file, string &exe) {
+    exe = native_name(file);
+    FILE *cc = popen(("gcc -O2 -x c -o " + shell_quote(exe) + " - -lm").c_str(), "w");
+    if (cc == NULL)
+        return "Não foi possível executar o gcc.";
+    CGenerator(file).generate(program, cc);
+    if (pclose(cc) != 0)
+        return "Falha ao compilar " + exe + " com o gcc.";
+    return "";
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef COMPILATION_H
+#define COMPILATION_H
+
+#include <cstdio>
+#include "diagnostics.h"
+#include "builder.h"
+
+using namespace std;
+
+// Opcoes da linha de comando, as mesmas para todos os arquivos.
+struct Options {
+    bool force_print_tree = false;
+    bool compact_ast = false;
+    bool separate_passes = false;
+    bool use_mmap = true;
+    bool optimize = false; // -O: otimiza a arvore checada
+    bool run = false; // --run: executa em vez de imprimir a arvore
+    bool vm = false;  // --vm: executa pelo bytecode
+    bool jit = false; // --jit: executa com os lacos quentes em codigo de maquina
+    bool trace = false; // --trace: como --jit, com traces do caminho quente
+    bool baseline = false; // --baseline: executa o bytecode compilado por copy-and-patch
+    bool emit_ssa = false; // --emit-ssa: imprime o IR em SSA em vez da arvore
+    bool emit_asm = false; // --emit-asm: imprime o assembly x86-64
+    bool native = false;   // --native: monta e liga o executavel com as/ld
+    bool emit_c = false;   // --emit-c: imprime a traducao para C
+    bool native_c = false; // --native-c: compila a traducao com o gcc -O2
+    size_t max_errors = 0;
+    FILE *tree_output = nullptr; // -o; sem ele a arvore vai para out
+};
+
+// Estado de uma compilacao: o parser e o scanner recebem o contexto em vez
+// de usar globais, entao cada arquivo tem os seus erros, a sua arvore e a
+// sua saida. A arena e a tabela de atoms sao por thread (arena.h, atoms.h).
+class Compilation {
+public:
+    const Options &options;
+    const char *file_name;
+    FILE *out; // mensagens, erros e (sem -o) a arvore
+    DiagnosticEngine diagnostics;
+    AstBuilder ast;
+    bool failed = false; // o programa parou num erro de execucao
+
+    Compilation(const Options &opts, const char *file, FILE *f)
+        : options(opts), file_name(file), out(f), ast(opts.compact_ast) {
+        diagnostics.setFile(file);
+        diagnostics.setMaxErrors(opts.max_errors);
+    }
+    Compilation(const Compilation&) = delete;
+    Compilation& operator=(const Compilation&) = delete;
+
+    FILE *treeOutput() const {
+        return options.tree_output ? options.tree_output : out;
+    }
+};
+
+#endif
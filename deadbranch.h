@@ -0,0 +1,347 @@
+#ifndef DEADBRANCH_H
+#define DEADBRANCH_H
+
+#include <vector>
+#include "nodes.h"
+#include "flat_ast.h"
+#include "interpreter.h"
+
+using namespace std;
+
+// Eliminacao de ramos mortos (-O), depois da dobra de constantes: um lo ou
+// lo/daor cuja condicao so depende de literais e trocado pelo ramo que
+// executa (o Block, que continua abrindo o seu escopo) ou some, e um syt
+// cuja condicao ja e falsa na entrada some inteiro. A decisao segue o
+// Interpreter::test, com curto-circuito; uma comparacao que daria erro ao
+// executar (tipos diferentes) nunca e decidida aqui.
+
+// Resultado de uma condicao avaliada na compilacao.
+enum CondValue {
+    COND_UNKNOWN = -1,
+    COND_FALSE = 0,
+    COND_TRUE = 1
+};
+
+inline CondValue cond_compare(uint32_t op, Value a, Value b) {
+    int c;
+    if (!three_way(a, b, c))
+        return COND_UNKNOWN;
+    return compare_result(op, c) ? COND_TRUE : COND_FALSE;
+}
+
+class DeadBranches : public Visitor<DeadBranches> {
+private:
+    size_t removed = 0;
+
+    static bool literal(Node *n, Value &v) {
+        switch (n->getKind()) {
+        case NK_INTEGER: v = Value::ofInt(static_cast<Integer*>(n)->getValue()); return true;
+        case NK_FLOAT: v = Value::ofFloat(static_cast<Float*>(n)->getValue()); return true;
+        case NK_TRUE: v = Value::ofBool(true); return true;
+        case NK_FALSE: v = Value::ofBool(false); return true;
+        case NK_STRING: v = Value::ofString(literal_text(static_cast<String*>(n)->getValue())); return true;
+        default: return false;
+        }
+    }
+
+    static size_t size(Node *root) {
+        vector<Node*> stack{root};
+        size_t n = 0;
+        while (!stack.empty()) {
+            Node *x = stack.back();
+            stack.pop_back();
+            n++;
+            for (Node *c : x->getChildren())
+                stack.push_back(c);
+        }
+        return n;
+    }
+
+    // var/val: o nome da variavel do syt e o seu valor inicial, quando se
+    // quer a condicao na entrada do laco.
+    static bool operand(Node *n, Atom var, const Value *val, Value &v) {
+        if (literal(n, v))
+            return true;
+        if (val != nullptr && n->getKind() == NK_IDENT && static_cast<Ident*>(n)->getAtom() == var) {
+            v = *val;
+            return true;
+        }
+        return false;
+    }
+
+    CondValue evaluate(Node *n, Atom var = 0, const Value *val = nullptr) {
+        if (n->getKind() != NK_CONDITION)
+            return COND_UNKNOWN;
+        const char *op = static_cast<Condition*>(n)->getOperation();
+        Node *l = n->getChildren()[0];
+        Node *r = n->getChildren()[1];
+        if (op[0] == '|' || op[0] == '&') {
+            CondValue left = evaluate(l, var, val);
+            if (left == COND_UNKNOWN || left == (op[0] == '|' ? COND_TRUE : COND_FALSE))
+                return left;
+            return evaluate(r, var, val);
+        }
+        Value a, b;
+        if (!operand(l, var, val, a) || !operand(r, var, val, b))
+            return COND_UNKNOWN;
+        return cond_compare(condition_op_code(op), a, b);
+    }
+
+    // dreje && x e pirta || x viram so x.
+    Node *simplifyCondition(Node *n) {
+        if (n->getKind() != NK_CONDITION)
+            return n;
+        const char *op = static_cast<Condition*>(n)->getOperation();
+        if (op[0] != '|' && op[0] != '&')
+            return n;
+        Node *l = n->getChildren()[0];
+        if (evaluate(l) != (op[0] == '&' ? COND_TRUE : COND_FALSE))
+            return n;
+        removed += size(l) + 1;
+        return n->getChildren()[1];
+    }
+
+    // O comando que fica no lugar de s: ele mesmo, um dos seus ramos ou
+    // nullptr se ele nao executa nunca.
+    Node *live(Node *s) {
+        ArenaList<Node*> &c = s->getChildren();
+        switch (s->getKind()) {
+        case NK_IF:
+            switch (evaluate(c[0])) {
+            case COND_TRUE:
+                removed += size(c[0]) + 1;
+                return c[1];
+            case COND_FALSE:
+                removed += size(s);
+                return nullptr;
+            default:
+                return s;
+            }
+        case NK_IFELSE:
+            switch (evaluate(c[0])) {
+            case COND_TRUE:
+                removed += size(c[0]) + size(c[2]) + 1;
+                return c[1];
+            case COND_FALSE:
+                removed += size(c[0]) + size(c[1]) + 1;
+                return c[2];
+            default:
+                return s;
+            }
+        case NK_LOOP: {
+            // so com valor inicial literal: outra expressao poderia falhar
+            // ou ler a entrada, e isso tem que continuar acontecendo
+            Variable *decl = static_cast<Variable*>(c[0]);
+            Value v;
+            if (!literal(decl->getValue(), v) || !convert_value(v, value_type(decl->getType())))
+                return s;
+            if (evaluate(c[1], decl->getAtom(), &v) != COND_FALSE)
+                return s;
+            removed += size(s);
+            return nullptr;
+        }
+        default:
+            return s;
+        }
+    }
+
+public:
+    // Devolve quantos nos sairam da arvore.
+    size_t run(Node *program) {
+        walk(program);
+        return removed;
+    }
+
+    // Pos-ordem: os comandos de dentro ja foram podados quando a lista
+    // que os contem e visitada.
+    void dispatch(Node *n) {
+        ArenaList<Node*> &c = n->getChildren();
+        switch (n->getKind()) {
+        case NK_IF:
+        case NK_IFELSE:
+        case NK_LOOP:
+        case NK_CONDITION: {
+            size_t i = n->getKind() == NK_LOOP ? 1 : 0;
+            Node *r = simplifyCondition(c[i]);
+            if (r != c[i])
+                n->setChild(i, r);
+            if (n->getKind() == NK_CONDITION) {
+                r = simplifyCondition(c[1]);
+                if (r != c[1])
+                    n->setChild(1, r);
+            }
+            break;
+        }
+        case NK_STMTS:
+        case NK_BLOCK: {
+            size_t kept = 0;
+            for (size_t i = 0; i < c.size(); i++) {
+                if (Node *s = live(c[i]))
+                    c[kept++] = s;
+            }
+            c.truncate(kept);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+};
+
+// O mesmo sobre o AST compacto: as listas sao religadas pelo nextSibling e
+// uma condicao simplificada e reescrita no lugar.
+class FlatDeadBranches {
+private:
+    FlatAst &ast;
+    size_t removed = 0;
+
+    bool literal(uint32_t n, Value &v) {
+        switch (ast.kind[n]) {
+        case NK_INTEGER: v = Value::ofInt(ast.intValue(n)); return true;
+        case NK_FLOAT: v = Value::ofFloat(ast.floatValue(n)); return true;
+        case NK_TRUE: v = Value::ofBool(true); return true;
+        case NK_FALSE: v = Value::ofBool(false); return true;
+        case NK_STRING: v = Value::ofString(literal_text(atoms.name(ast.payload[n]))); return true;
+        default: return false;
+        }
+    }
+
+    size_t size(uint32_t root) {
+        vector<uint32_t> stack{root};
+        size_t n = 0;
+        while (!stack.empty()) {
+            uint32_t x = stack.back();
+            stack.pop_back();
+            n++;
+            for (uint32_t c = ast.firstChild[x]; c != FlatAst::NONE; c = ast.nextSibling[c])
+                stack.push_back(c);
+        }
+        return n;
+    }
+
+    bool operand(uint32_t n, Atom var, const Value *val, Value &v) {
+        if (literal(n, v))
+            return true;
+        if (val != nullptr && ast.kind[n] == NK_IDENT && ast.payload[n] == var) {
+            v = *val;
+            return true;
+        }
+        return false;
+    }
+
+    CondValue evaluate(uint32_t n, Atom var = 0, const Value *val = nullptr) {
+        if (ast.kind[n] != NK_CONDITION)
+            return COND_UNKNOWN;
+        uint32_t op = ast.payload[n];
+        uint32_t l = ast.firstChild[n];
+        uint32_t r = ast.nextSibling[l];
+        const char *name = condition_ops[op];
+        if (name[0] == '|' || name[0] == '&') {
+            CondValue left = evaluate(l, var, val);
+            if (left == COND_UNKNOWN || left == (name[0] == '|' ? COND_TRUE : COND_FALSE))
+                return left;
+            return evaluate(r, var, val);
+        }
+        Value a, b;
+        if (!operand(l, var, val, a) || !operand(r, var, val, b))
+            return COND_UNKNOWN;
+        return cond_compare(op, a, b);
+    }
+
+    void simplifyCondition(uint32_t n) {
+        const char *name = condition_ops[ast.payload[n]];
+        if (name[0] != '|' && name[0] != '&')
+            return;
+        uint32_t l = ast.firstChild[n];
+        if (evaluate(l) != (name[0] == '&' ? COND_TRUE : COND_FALSE))
+            return;
+        removed += size(l) + 1;
+        uint32_t r = ast.nextSibling[l];
+        ast.kind[n] = ast.kind[r];
+        ast.line[n] = ast.line[r];
+        ast.payload[n] = ast.payload[r];
+        ast.firstChild[n] = ast.firstChild[r];
+    }
+
+    uint32_t live(uint32_t s) {
+        uint32_t cond = ast.child(s, ast.kind[s] == NK_LOOP ? 1 : 0);
+        switch (ast.kind[s]) {
+        case NK_IF:
+            switch (evaluate(cond)) {
+            case COND_TRUE:
+                removed += size(cond) + 1;
+                return ast.nextSibling[cond];
+            case COND_FALSE:
+                removed += size(s);
+                return FlatAst::NONE;
+            default:
+                return s;
+            }
+        case NK_IFELSE: {
+            uint32_t ifBody = ast.nextSibling[cond];
+            uint32_t elseBody = ast.nextSibling[ifBody];
+            switch (evaluate(cond)) {
+            case COND_TRUE:
+                removed += size(cond) + size(elseBody) + 1;
+                return ifBody;
+            case COND_FALSE:
+                removed += size(cond) + size(ifBody) + 1;
+                return elseBody;
+            default:
+                return s;
+            }
+        }
+        case NK_LOOP: {
+            uint32_t decl = ast.firstChild[s];
+            uint32_t type = ast.firstChild[decl];
+            Value v;
+            if (!literal(ast.nextSibling[type], v) || !convert_value(v, (ValueType) ast.payload[type]))
+                return s;
+            if (evaluate(cond, ast.payload[decl], &v) != COND_FALSE)
+                return s;
+            removed += size(s);
+            return FlatAst::NONE;
+        }
+        default:
+            return s;
+        }
+    }
+
+    void prune(uint32_t list) {
+        uint32_t last = FlatAst::NONE;
+        uint32_t c = ast.firstChild[list];
+        ast.firstChild[list] = FlatAst::NONE;
+        while (c != FlatAst::NONE) {
+            uint32_t next = ast.nextSibling[c];
+            uint32_t s = live(c);
+            if (s != FlatAst::NONE) {
+                if (last == FlatAst::NONE)
+                    ast.firstChild[list] = s;
+                else
+                    ast.nextSibling[last] = s;
+                last = s;
+            }
+            c = next;
+        }
+        if (last != FlatAst::NONE)
+            ast.nextSibling[last] = FlatAst::NONE;
+        ast.payload[list] = last;
+    }
+
+public:
+    FlatDeadBranches(FlatAst &a) : ast(a) {}
+
+    size_t run(uint32_t root) {
+        ast.postorder(root, [&](uint32_t n) {
+            switch (ast.kind[n]) {
+            case NK_CONDITION: simplifyCondition(n); break;
+            case NK_STMTS:
+            case NK_BLOCK: prune(n); break;
+            default: break;
+            }
+        });
+        return removed;
+    }
+};
+
+#endif
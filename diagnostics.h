@@ -0,0 +1,124 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "atoms.h"
+
+using namespace std;
+
+// Junta os erros semanticos num buffer contiguo em vez de escrever (e dar
+// flush) um por um. flush() ordena o lote por (arquivo, linha), descarta
+// repetidos e formata tudo na saida pendente, junto com as mensagens de
+// progresso; write() manda essa saida para o stdout numa escrita so.
+class DiagnosticEngine {
+private:
+    struct Diagnostic {
+        Atom file;
+        uint32_t line;
+        uint32_t seq;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    vector<Diagnostic> pending;
+    string text;      // mensagens do lote pendente
+    string out;       // saida formatada ainda nao escrita
+    Atom file = 0;
+    uint32_t seq = 0;
+    size_t reported = 0;
+    size_t maxErrors = 0;
+    bool limitHit = false;
+
+    string_view message(const Diagnostic &d) const {
+        return string_view(text.data() + d.offset, d.length);
+    }
+
+    // Ordena o lote pendente e tira as repeticoes, sem formatar nada.
+    void compact() {
+        sort(pending.begin(), pending.end(), [](const Diagnostic &x, const Diagnostic &y) {
+            if (x.file != y.file)
+                return x.file < y.file;
+            if (x.line != y.line)
+                return x.line < y.line;
+            return x.seq < y.seq;
+        });
+        pending.erase(unique(pending.begin(), pending.end(), [this](const Diagnostic &x, const Diagnostic &y) {
+            return x.file == y.file && x.line == y.line && message(x) == message(y);
+        }), pending.end());
+    }
+
+    void appendNumber(uint64_t v) {
+        char buf[24];
+        auto res = to_chars(buf, buf + sizeof buf, v);
+        out.append(buf, res.ptr - buf);
+    }
+
+public:
+    DiagnosticEngine() {}
+
+    void setFile(const char *name) {
+        file = atoms.intern(name, strlen(name));
+    }
+
+    // 0 = sem limite
+    void setMaxErrors(size_t max) {
+        maxErrors = max;
+    }
+
+    size_t count() const {
+        return reported + pending.size();
+    }
+
+    bool limitReached() const {
+        return limitHit;
+    }
+
+    void error(int line, string_view a, string_view b = {}, string_view c = {}) {
+        if (limitHit)
+            return;
+        uint32_t offset = (uint32_t) text.size();
+        text.append(a).append(b).append(c);
+        pending.push_back({file, (uint32_t) line, seq++, offset, (uint32_t) (text.size() - offset)});
+        if (maxErrors != 0 && count() >= maxErrors) {
+            compact();
+            limitHit = count() >= maxErrors;
+        }
+    }
+
+    void note(string_view line) {
+        out.append(line).push_back('\n');
+    }
+
+    void note(string_view prefix, size_t n, string_view suffix = {}) {
+        out.append(prefix);
+        appendNumber(n);
+        out.append(suffix).push_back('\n');
+    }
+
+    void flush() {
+        compact();
+        for (const Diagnostic &d : pending) {
+            out.append(atoms.name(d.file)).push_back(':');
+            appendNumber(d.line);
+            out.append(":0: semantic error: ").append(message(d)).push_back('\n');
+        }
+        reported += pending.size();
+        pending.clear();
+        text.clear();
+    }
+
+    void write(FILE *f = stdout) {
+        flush();
+        fwrite(out.data(), 1, out.size(), f);
+        out.clear();
+    }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef DOT_H
+#define DOT_H
+
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+
+using namespace std;
+
+// Escritor do grafo DOT da arvore: acumula em blocos grandes e escreve com
+// fwrite, formata numeros com to_chars (sem locale) e escapa os rotulos.
+class DotWriter {
+private:
+    static const size_t BUFFER_SIZE = 256 * 1024;
+
+    FILE *out;
+    char *buf;
+    size_t used = 0;
+
+    void reserve(size_t n) {
+        if (used + n > BUFFER_SIZE)
+            flush();
+    }
+
+    void put(char c) {
+        reserve(1);
+        buf[used++] = c;
+    }
+
+    void put(string_view s) {
+        if (s.size() > BUFFER_SIZE) {
+            flush();
+            fwrite(s.data(), 1, s.size(), out);
+            return;
+        }
+        reserve(s.size());
+        for (char c : s)
+            buf[used++] = c;
+    }
+
+    template <typename T>
+    void putNumber(T v) {
+        reserve(32);
+        used = to_chars(buf + used, buf + BUFFER_SIZE, v).ptr - buf;
+    }
+
+public:
+    DotWriter(FILE *f) : out(f) {
+        buf = (char*) malloc(BUFFER_SIZE);
+    }
+    DotWriter(const DotWriter&) = delete;
+    DotWriter& operator=(const DotWriter&) = delete;
+
+    ~DotWriter() {
+        flush();
+        free(buf);
+    }
+
+    void flush() {
+        fwrite(buf, 1, used, out);
+        used = 0;
+    }
+
+    void begin() {
+        put("graph {\n");
+    }
+
+    void end() {
+        put("}\n");
+        flush();
+        fflush(out);
+    }
+
+    void nodeStart(uint32_t id) {
+        put('N');
+        putNumber(id);
+        put("[label=\"");
+    }
+
+    void nodeEnd() {
+        put("\"];\n");
+    }
+
+    void label(string_view s) {
+        for (char c : s) {
+            if (c == '"' || c == '\\')
+                put('\\');
+            put(c);
+        }
+    }
+
+    void label(char c) {
+        label(string_view(&c, 1));
+    }
+
+    void label(int v) {
+        putNumber(v);
+    }
+
+    // mesmo texto de to_string(float): "%f"
+    void label(float v) {
+        reserve(64);
+        used = to_chars(buf + used, buf + BUFFER_SIZE, (double) v, chars_format::fixed, 6).ptr - buf;
+    }
+
+    void edge(uint32_t from, uint32_t to) {
+        put('N');
+        putNumber(from);
+        put("--N");
+        putNumber(to);
+        put(";\n");
+    }
+};
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include "atoms.h"
+#include "nodekind.h"
+#include "symtab.h"
+#include "diagnostics.h"
+#include "dot.h"
+
+using namespace std;
+
+// AST compacto: cada no e um indice de 32 bits em vetores paralelos.
+// Os filhos formam uma lista (firstChild/nextSibling); o payload guarda
+// o Atom, o valor literal, o operador ou o codigo de tipo conforme o kind.
+// Em NK_STMTS e NK_PROGRAM o payload guarda o ultimo filho, para append O(1).
+class FlatAst {
+public:
+    static constexpr uint32_t NONE = 0xffffffffu;
+    static constexpr uint32_t PASS_DEC = 0x80000000u;
+
+    vector<NodeKind> kind;
+    vector<uint32_t> line;
+    vector<uint32_t> firstChild;
+    vector<uint32_t> nextSibling;
+    vector<uint32_t> payload;
+
+    uint32_t add(NodeKind k, uint32_t lineno, uint32_t value) {
+        uint32_t id = (uint32_t) kind.size();
+        kind.push_back(k);
+        line.push_back(lineno);
+        firstChild.push_back(NONE);
+        nextSibling.push_back(NONE);
+        payload.push_back(value);
+        return id;
+    }
+
+    uint32_t add(NodeKind k, uint32_t lineno, uint32_t value, initializer_list<uint32_t> children) {
+        uint32_t id = add(k, lineno, value);
+        uint32_t prev = NONE;
+        for (uint32_t c : children) {
+            if (prev == NONE)
+                firstChild[id] = c;
+            else
+                nextSibling[prev] = c;
+            prev = c;
+        }
+        return id;
+    }
+
+    uint32_t addList(NodeKind k, uint32_t lineno) {
+        return add(k, lineno, NONE);
+    }
+
+    void append(uint32_t list, uint32_t child) {
+        if (payload[list] == NONE)
+            firstChild[list] = child;
+        else
+            nextSibling[payload[list]] = child;
+        payload[list] = child;
+    }
+
+    uint32_t child(uint32_t n, int i) const {
+        uint32_t c = firstChild[n];
+        while (i-- > 0 && c != NONE)
+            c = nextSibling[c];
+        return c;
+    }
+
+    int intValue(uint32_t n) const {
+        int v;
+        memcpy(&v, &payload[n], sizeof v);
+        return v;
+    }
+
+    float floatValue(uint32_t n) const {
+        float v;
+        memcpy(&v, &payload[n], sizeof v);
+        return v;
+    }
+
+    static uint32_t bits(int v) {
+        uint32_t b;
+        memcpy(&b, &v, sizeof b);
+        return b;
+    }
+
+    static uint32_t bits(float v) {
+        uint32_t b;
+        memcpy(&b, &v, sizeof b);
+        return b;
+    }
+
+    size_t size() const {
+        return kind.size();
+    }
+
+    size_t bytes() const {
+        return kind.capacity() * sizeof(NodeKind)
+            + (line.capacity() + firstChild.capacity() + nextSibling.capacity() + payload.capacity()) * sizeof(uint32_t);
+    }
+
+    void release() {
+        vector<NodeKind>().swap(kind);
+        vector<uint32_t>().swap(line);
+        vector<uint32_t>().swap(firstChild);
+        vector<uint32_t>().swap(nextSibling);
+        vector<uint32_t>().swap(payload);
+    }
+
+    // Mesmo texto que Node::toStr() do no equivalente.
+    string label(uint32_t n) const {
+        switch (kind[n]) {
+        case NK_STMTS:
+        case NK_BLOCK: return "stmts";
+        case NK_PROGRAM: return "Program";
+        case NK_TYPEDEC: return type_names[payload[n]];
+        case NK_IDENT:
+        case NK_STRING: return atom_str(payload[n]);
+        case NK_INTEGER: return to_string(intValue(n));
+        case NK_FLOAT: return to_string(floatValue(n));
+        case NK_BOOLEAN: return payload[n] ? "true" : "false";
+        case NK_TRUE: return "true";
+        case NK_FALSE: return "false";
+        case NK_VARIABLE:
+        case NK_ATTRIBUTION: return atom_str(payload[n]) + "=";
+        case NK_UNARY:
+        case NK_BINARYOP: return string(1, (char) payload[n]);
+        case NK_CONDITION: return condition_ops[payload[n]];
+        case NK_PASS: return atom_str(payload[n] & ~PASS_DEC) + (payload[n] & PASS_DEC ? "--" : "++");
+        case NK_IF: return "if";
+        case NK_IFELSE: return "if-else";
+        case NK_LOOP: return "loop";
+        case NK_SCAN:
+            if (firstChild[n] != NONE)
+                return "scan(" + label(firstChild[n]) + ")";
+            return "sem tipo";
+        case NK_PRINT: return "print";
+        default: return "?";
+        }
+    }
+
+    // Percorre a subarvore com pilha explicita, chamando enter() na ida e
+    // visit() na volta (filhos antes do pai).
+    template <typename E, typename F, typename S>
+    void walk(uint32_t root, E enter, F visit, S stop) const {
+        vector<uint32_t> stack;
+        uint32_t n = root;
+        while (!stop()) {
+            enter(n);
+            while (firstChild[n] != NONE) {
+                stack.push_back(n);
+                n = firstChild[n];
+                enter(n);
+            }
+            visit(n);
+            while (n != root && nextSibling[n] == NONE) {
+                n = stack.back();
+                stack.pop_back();
+                visit(n);
+            }
+            if (n == root)
+                return;
+            n = nextSibling[n];
+        }
+    }
+
+    template <typename E, typename F>
+    void walk(uint32_t root, E enter, F visit) const {
+        walk(root, enter, visit, [] { return false; });
+    }
+
+    template <typename F>
+    void postorder(uint32_t root, F visit) const {
+        walk(root, [](uint32_t) {}, visit);
+    }
+};
+
+class FlatCheckVarDecl {
+private:
+    DiagnosticEngine &diagnostics;
+    SymbolTable symbols;
+public:
+    FlatCheckVarDecl(DiagnosticEngine &d) : diagnostics(d) {}
+
+    void check(const FlatAst &ast, uint32_t root) {
+        ast.walk(root, [&](uint32_t n) { enter(ast, n); }, [&](uint32_t n) { visit(ast, n); }, [this] { return done(); });
+    }
+
+    bool done() {
+        return diagnostics.limitReached();
+    }
+
+    void enter(const FlatAst &ast, uint32_t n) {
+        if (opens_scope(ast.kind[n]))
+            symbols.push();
+    }
+
+    void visit(const FlatAst &ast, uint32_t n) {
+        if (opens_scope(ast.kind[n])) {
+            symbols.pop();
+        } else if (ast.kind[n] == NK_IDENT) {
+            Atom a = ast.payload[n];
+            if (symbols.lookup(a) == nullptr) {
+                diagnostics.error(ast.line[n], atoms.name(a), " undefined.");
+            }
+        } else if (ast.kind[n] == NK_VARIABLE) {
+            symbols.declare(ast.payload[n], ast.line[n]);
+        }
+    }
+};
+
+class FlatCheckVarMix {
+private:
+    DiagnosticEngine &diagnostics;
+
+public:
+    FlatCheckVarMix(DiagnosticEngine &d) : diagnostics(d) {}
+
+    void check(const FlatAst &ast, uint32_t root) {
+        ast.walk(root, [](uint32_t) {}, [&](uint32_t n) { visit(ast, n); }, [this] { return done(); });
+    }
+
+    bool done() {
+        return diagnostics.limitReached();
+    }
+
+    void enter(const FlatAst &, uint32_t) {}
+
+    void visit(const FlatAst &ast, uint32_t n) {
+        if (ast.kind[n] != NK_BINARYOP)
+            return;
+        bool i0 = ast.kind[ast.child(n, 0)] == NK_INTEGER;
+        bool i1 = ast.kind[ast.child(n, 1)] == NK_INTEGER;
+        if (i0 != i1) {
+            diagnostics.error(ast.line[n], " tipo mesclado proibido.");
+        }
+    }
+};
+
+class FlatCheckDuplicateVariable {
+private:
+    DiagnosticEngine &diagnostics;
+    SymbolTable symbols;
+
+public:
+    FlatCheckDuplicateVariable(DiagnosticEngine &d) : diagnostics(d) {}
+
+    void check(const FlatAst &ast, uint32_t root) {
+        ast.walk(root, [&](uint32_t n) { enter(ast, n); }, [&](uint32_t n) { visit(ast, n); }, [this] { return done(); });
+    }
+
+    bool done() {
+        return diagnostics.limitReached();
+    }
+
+    void enter(const FlatAst &ast, uint32_t n) {
+        if (opens_scope(ast.kind[n]))
+            symbols.push();
+    }
+
+    void visit(const FlatAst &ast, uint32_t n) {
+        if (opens_scope(ast.kind[n])) {
+            symbols.pop();
+        } else if (ast.kind[n] != NK_VARIABLE) {
+            return;
+        } else if (symbols.declaredHere(ast.payload[n])) {
+            diagnostics.error(ast.line[n], "variável duplicada: ", atoms.name(ast.payload[n]));
+        } else {
+            symbols.declare(ast.payload[n], ast.line[n]);
+        }
+    }
+};
+
+inline void dot_label(DotWriter &out, const FlatAst &ast, uint32_t n) {
+    uint32_t p = ast.payload[n];
+    switch (ast.kind[n]) {
+    case NK_IDENT:
+    case NK_STRING: out.label(atoms.name(p)); break;
+    case NK_INTEGER: out.label(ast.intValue(n)); break;
+    case NK_FLOAT: out.label(ast.floatValue(n)); break;
+    case NK_VARIABLE:
+    case NK_ATTRIBUTION:
+        out.label(atoms.name(p));
+        out.label('=');
+        break;
+    case NK_UNARY:
+    case NK_BINARYOP: out.label((char) p); break;
+    case NK_PASS:
+        out.label(atoms.name(p & ~FlatAst::PASS_DEC));
+        out.label(p & FlatAst::PASS_DEC ? "--" : "++");
+        break;
+    default: out.label(ast.label(n)); break;
+    }
+}
+
+// Mesma numeracao em pos-ordem do printf_tree da arvore de ponteiros.
+inline void flat_printf_tree(const FlatAst &ast, uint32_t root, FILE *f = stdout) {
+    DotWriter out(f);
+    vector<uint32_t> ids;
+    uint32_t next = 0;
+    out.begin();
+    ast.postorder(root, [&](uint32_t n) {
+        uint32_t id = next++;
+        out.nodeStart(id);
+        dot_label(out, ast, n);
+        out.nodeEnd();
+
+        size_t children = 0;
+        for (uint32_t c = ast.firstChild[n]; c != FlatAst::NONE; c = ast.nextSibling[c])
+            children++;
+        size_t first = ids.size() - children;
+        for (size_t i = first; i < ids.size(); i++)
+            out.edge(id, ids[i]);
+        ids.resize(first);
+        ids.push_back(id);
+    });
+    out.end();
+}
+
+#endif
@@ -0,0 +1,390 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "nodes.h"
+#include "flat_ast.h"
+#include "interpreter.h"
+
+using namespace std;
+
+// Dobra de constantes (-O), rodada depois das checagens e sem erros. O
+// resultado tem que ser o mesmo que o interpretador daria, entao as contas
+// seguem Interpreter::arith: giez em 32 bits dando a volta, bevumbagon em
+// double. O que so falha ao executar (divisao por zero) fica na arvore.
+
+// Tipo de uma expressao que nao e numerica ou nao e conhecida.
+static constexpr int NOT_NUMERIC = -1;
+
+struct Constant {
+    ValueType type;
+    int i;
+    double f;
+
+    double number() const {
+        return type == VT_INT ? (double) i : f;
+    }
+};
+
+// Um resultado bevumbagon so vira no Float se couber exato no float do
+// no; senao a conta em double da execucao daria outro valor.
+inline bool fits_float(double v) {
+    return (double) (float) v == v;
+}
+
+inline bool fold_arith(char op, Constant a, Constant b, Constant &r) {
+    if (a.type == VT_INT && b.type == VT_INT) {
+        unsigned x = (unsigned) a.i, y = (unsigned) b.i;
+        r.type = VT_INT;
+        switch (op) {
+        case '+': r.i = (int) (x + y); return true;
+        case '-': r.i = (int) (x - y); return true;
+        case '*': r.i = (int) (x * y); return true;
+        default:
+            if (b.i == 0)
+                return false;
+            if (b.i == -1)
+                r.i = op == '/' ? (int) (0u - x) : 0;
+            else
+                r.i = op == '/' ? a.i / b.i : a.i % b.i;
+            return true;
+        }
+    }
+    double x = a.number(), y = b.number();
+    r.type = VT_FLOAT;
+    switch (op) {
+    case '+': r.f = x + y; break;
+    case '-': r.f = x - y; break;
+    case '*': r.f = x * y; break;
+    case '/': r.f = x / y; break;
+    default: r.f = fmod(x, y); break;
+    }
+    return fits_float(r.f);
+}
+
+// Identidades de giez: x*1, 1*x, x+0, 0+x, x-0 e x/1 viram x (devolve o
+// lado que fica: 0 ou 1); x*0 e 0*x viram 0 (devolve 2). -1 se nenhuma.
+inline int int_identity(char op, bool k0, int v0, bool k1, int v1) {
+    if (op == '*' && ((k0 && v0 == 0) || (k1 && v1 == 0)))
+        return 2;
+    if (k1 && ((v1 == 1 && (op == '*' || op == '/')) || (v1 == 0 && (op == '+' || op == '-'))))
+        return 0;
+    if (k0 && ((v0 == 1 && op == '*') || (v0 == 0 && op == '+')))
+        return 1;
+    return -1;
+}
+
+class ConstantFolder : public Visitor<ConstantFolder> {
+private:
+    SymbolTable symbols; // o slot guarda o tipo declarado do nome
+    unordered_map<Node*, int> exprTypes;
+    size_t removed = 0;
+
+    int typeOf(Node *n) {
+        switch (n->getKind()) {
+        case NK_INTEGER: return VT_INT;
+        case NK_FLOAT: return VT_FLOAT;
+        case NK_IDENT: {
+            Symbol *sym = symbols.lookup(static_cast<Ident*>(n)->getAtom());
+            return sym != nullptr ? (int) sym->slot : NOT_NUMERIC;
+        }
+        case NK_UNARY:
+        case NK_BINARYOP: {
+            auto it = exprTypes.find(n);
+            return it != exprTypes.end() ? it->second : NOT_NUMERIC;
+        }
+        default:
+            return NOT_NUMERIC;
+        }
+    }
+
+    static bool constant(Node *n, Constant &c) {
+        if (n->getKind() == NK_INTEGER) {
+            c = {VT_INT, static_cast<Integer*>(n)->getValue(), 0};
+            return true;
+        }
+        if (n->getKind() == NK_FLOAT) {
+            c = {VT_FLOAT, 0, static_cast<Float*>(n)->getValue()};
+            return true;
+        }
+        return false;
+    }
+
+    Node *make(Constant c, int line) {
+        Node *n = c.type == VT_INT ? (Node*) new Integer(c.i) : (Node*) new Float((float) c.f);
+        n->setLineNo(line);
+        return n;
+    }
+
+    // Tamanho da subarvore, ou 0 se ela pode falhar ao executar (tem / ou
+    // %) e portanto nao pode sumir.
+    static size_t removableSize(Node *root) {
+        vector<Node*> stack{root};
+        size_t size = 0;
+        while (!stack.empty()) {
+            Node *n = stack.back();
+            stack.pop_back();
+            if (n->getKind() == NK_BINARYOP) {
+                char op = static_cast<BinaryOp*>(n)->getOperation();
+                if (op == '/' || op == '%')
+                    return 0;
+            }
+            size++;
+            for (Node *c : n->getChildren())
+                stack.push_back(c);
+        }
+        return size;
+    }
+
+    Node *simplify(Node *n) {
+        if (n->getKind() == NK_UNARY) {
+            Node *v = n->getChildren()[0];
+            Constant c{};
+            int t = v->getKind() == NK_UNARY ? typeOf(v->getChildren()[0]) : NOT_NUMERIC;
+            if (t == VT_INT || t == VT_FLOAT) {
+                // --x so com numeros: com engos ou iderennon o erro de execucao fica
+                removed += 2;
+                return v->getChildren()[0];
+            }
+            if (constant(v, c)) {
+                removed += 1;
+                if (c.type == VT_INT)
+                    c.i = (int) (0u - (unsigned) c.i);
+                else
+                    c.f = -c.f;
+                return make(c, n->getLineNo());
+            }
+            return n;
+        }
+        if (n->getKind() != NK_BINARYOP)
+            return n;
+
+        char op = static_cast<BinaryOp*>(n)->getOperation();
+        Node *a = n->getChildren()[0];
+        Node *b = n->getChildren()[1];
+        Constant ca{}, cb{}, r{};
+        bool ka = constant(a, ca), kb = constant(b, cb);
+        if (ka && kb) {
+            if (!fold_arith(op, ca, cb, r))
+                return n;
+            removed += 2;
+            return make(r, n->getLineNo());
+        }
+        if (typeOf(a) != VT_INT || typeOf(b) != VT_INT)
+            return n;
+        switch (int_identity(op, ka, ca.i, kb, cb.i)) {
+        case 0:
+            removed += 2;
+            return a;
+        case 1:
+            removed += 2;
+            return b;
+        case 2: {
+            size_t size = removableSize(ka ? b : a);
+            if (size == 0)
+                return n;
+            removed += size + 1;
+            return make({VT_INT, 0, 0}, n->getLineNo());
+        }
+        default:
+            return n;
+        }
+    }
+
+public:
+    // Devolve quantos nos sairam da arvore.
+    size_t fold(Node *program) {
+        walk(program);
+        return removed;
+    }
+
+    // Os filhos ja foram dobrados; troca os que ainda dao para simplificar
+    // e so depois registra o proprio no.
+    void dispatch(Node *n) {
+        ArenaList<Node*> &c = n->getChildren();
+        for (size_t i = 0; i < c.size(); i++) {
+            Node *r = simplify(c[i]);
+            if (r != c[i])
+                n->setChild(i, r);
+        }
+        Visitor<ConstantFolder>::dispatch(n);
+    }
+
+    void enter(Node *n) {
+        if (opens_scope(n->getKind()))
+            symbols.push();
+    }
+
+    void visitBlock(Node *) {
+        symbols.pop();
+    }
+
+    void visitLoop(Loop *) {
+        symbols.pop();
+    }
+
+    void visitVariable(Variable *var) {
+        symbols.declare(var->getAtom(), var->getLineNo(), value_type(var->getType()));
+    }
+
+    void visitUnary(Unary *u) {
+        int t = typeOf(u->getChildren()[0]);
+        exprTypes[u] = t;
+    }
+
+    void visitBinaryOp(BinaryOp *bo) {
+        int a = typeOf(bo->getChildren()[0]);
+        int b = typeOf(bo->getChildren()[1]);
+        if ((a != VT_INT && a != VT_FLOAT) || (b != VT_INT && b != VT_FLOAT))
+            exprTypes[bo] = NOT_NUMERIC;
+        else
+            exprTypes[bo] = a == VT_INT && b == VT_INT ? VT_INT : VT_FLOAT;
+    }
+};
+
+// O mesmo sobre o AST compacto. Aqui nao ha ponteiros de pai para trocar:
+// o no dobrado e reescrito no lugar, mantendo o seu nextSibling.
+class FlatConstantFolder {
+private:
+    FlatAst &ast;
+    SymbolTable symbols;
+    vector<int> types;
+    size_t removed = 0;
+
+    int typeOf(uint32_t n) {
+        switch (ast.kind[n]) {
+        case NK_INTEGER: return VT_INT;
+        case NK_FLOAT: return VT_FLOAT;
+        case NK_IDENT: {
+            Symbol *sym = symbols.lookup(ast.payload[n]);
+            return sym != nullptr ? (int) sym->slot : NOT_NUMERIC;
+        }
+        case NK_UNARY:
+        case NK_BINARYOP: return types[n];
+        default: return NOT_NUMERIC;
+        }
+    }
+
+    bool constant(uint32_t n, Constant &c) {
+        if (ast.kind[n] == NK_INTEGER) {
+            c = {VT_INT, ast.intValue(n), 0};
+            return true;
+        }
+        if (ast.kind[n] == NK_FLOAT) {
+            c = {VT_FLOAT, 0, ast.floatValue(n)};
+            return true;
+        }
+        return false;
+    }
+
+    void become(uint32_t n, Constant c) {
+        ast.kind[n] = c.type == VT_INT ? NK_INTEGER : NK_FLOAT;
+        ast.payload[n] = c.type == VT_INT ? FlatAst::bits(c.i) : FlatAst::bits((float) c.f);
+        ast.firstChild[n] = FlatAst::NONE;
+    }
+
+    void become(uint32_t n, uint32_t x) {
+        ast.kind[n] = ast.kind[x];
+        ast.line[n] = ast.line[x];
+        ast.payload[n] = ast.payload[x];
+        ast.firstChild[n] = ast.firstChild[x];
+        types[n] = types[x];
+    }
+
+    size_t removableSize(uint32_t root) {
+        vector<uint32_t> stack{root};
+        size_t size = 0;
+        while (!stack.empty()) {
+            uint32_t n = stack.back();
+            stack.pop_back();
+            if (ast.kind[n] == NK_BINARYOP && (ast.payload[n] == '/' || ast.payload[n] == '%'))
+                return 0;
+            size++;
+            for (uint32_t c = ast.firstChild[n]; c != FlatAst::NONE; c = ast.nextSibling[c])
+                stack.push_back(c);
+        }
+        return size;
+    }
+
+    void simplify(uint32_t n) {
+        uint32_t a = ast.firstChild[n];
+        Constant ca{}, cb{}, r{};
+        if (ast.kind[n] == NK_UNARY) {
+            types[n] = typeOf(a);
+            int t = ast.kind[a] == NK_UNARY ? typeOf(ast.firstChild[a]) : NOT_NUMERIC;
+            if (t == VT_INT || t == VT_FLOAT) {
+                // --x so com numeros, como acima
+                removed += 2;
+                become(n, ast.firstChild[a]);
+            } else if (constant(a, ca)) {
+                removed += 1;
+                if (ca.type == VT_INT)
+                    ca.i = (int) (0u - (unsigned) ca.i);
+                else
+                    ca.f = -ca.f;
+                become(n, ca);
+            }
+            return;
+        }
+
+        uint32_t b = ast.nextSibling[a];
+        char op = (char) ast.payload[n];
+        int ta = typeOf(a), tb = typeOf(b);
+        if ((ta != VT_INT && ta != VT_FLOAT) || (tb != VT_INT && tb != VT_FLOAT))
+            types[n] = NOT_NUMERIC;
+        else
+            types[n] = ta == VT_INT && tb == VT_INT ? VT_INT : VT_FLOAT;
+
+        bool ka = constant(a, ca), kb = constant(b, cb);
+        if (ka && kb) {
+            if (fold_arith(op, ca, cb, r)) {
+                removed += 2;
+                become(n, r);
+            }
+            return;
+        }
+        if (ta != VT_INT || tb != VT_INT)
+            return;
+        switch (int_identity(op, ka, ca.i, kb, cb.i)) {
+        case 0:
+            removed += 2;
+            become(n, a);
+            break;
+        case 1:
+            removed += 2;
+            become(n, b);
+            break;
+        case 2:
+            if (size_t size = removableSize(ka ? b : a)) {
+                removed += size + 1;
+                become(n, Constant{VT_INT, 0, 0});
+            }
+            break;
+        }
+    }
+
+public:
+    FlatConstantFolder(FlatAst &a) : ast(a), types(a.size(), NOT_NUMERIC) {}
+
+    size_t fold(uint32_t root) {
+        ast.walk(root,
+                 [&](uint32_t n) {
+                     if (opens_scope(ast.kind[n]))
+                         symbols.push();
+                 },
+                 [&](uint32_t n) {
+                     NodeKind k = ast.kind[n];
+                     if (opens_scope(k))
+                         symbols.pop();
+                     else if (k == NK_VARIABLE)
+                         symbols.declare(ast.payload[n], ast.line[n], ast.payload[ast.firstChild[n]]);
+                     else if (k == NK_UNARY || k == NK_BINARYOP)
+                         simplify(n);
+                 });
+        return removed;
+    }
+};
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef INDUCTION_H
+#define INDUCTION_H
+
+#include <unordered_map>
+#include <vector>
+#include "cfg.h"
+
+using namespace std;
+
+// Variaveis de inducao e lacos contados (-O, arvore de ponteiros): um syt
+// com valor inicial giez literal, limite literal e passo ++ ou -- da um
+// numero de voltas conhecido na compilacao. Se o corpo so tem reducoes
+// giez, s = s + e ou s = s - e com e afim no contador (base + coef * i,
+// base e coef invariantes no laco), o laco inteiro vira uma atribuicao
+// por reducao com a soma fechada: s = s + (base * N + coef * T), N o
+// numero de voltas e T a soma dos valores de i. Em giez as contas dao a
+// volta modulo 2^32, entao a soma fechada da o mesmo valor que as voltas;
+// bevumbagon fica de fora porque somar n vezes nao arredonda igual a
+// multiplicar. Um laco que so termina dando a volta no giez nao e contado.
+class InductionVariables : public Visitor<InductionVariables> {
+private:
+    // nullptr e zero
+    struct Affine {
+        Node *base;
+        Node *coef;
+    };
+
+    struct Reduction {
+        Attribution *node;
+        Ident *target;      // o s lido do lado direito
+        Node *step;         // o e
+        char sign;
+    };
+
+    IrFunction fn;
+    unordered_map<Node*, uint32_t> vars;    // Ident/Variable/Attribution/Pass -> IrVar
+    vector<uint32_t> written;               // written[var] == stamp: escrita no laco
+    uint32_t stamp = 0;
+    uint32_t counter = IR_NONE;
+    int line = 0;
+    vector<Reduction> reductions;
+    vector<Node*> items;
+    size_t closed = 0;
+
+    int varOf(Node *n) {
+        auto it = vars.find(n);
+        return it != vars.end() ? (int) it->second : -1;
+    }
+
+    bool isVar(Node *n, int var) {
+        return n->getKind() == NK_IDENT && varOf(n) == var;
+    }
+
+    Node *at(Node *n) {
+        n->setLineNo(line);
+        return n;
+    }
+
+    Node *combine(Node *x, Node *y, char op) {
+        if (y == nullptr)
+            return x;
+        if (x == nullptr)
+            return op == '-' ? at(new Unary(y, '-')) : y;
+        return at(new BinaryOp(x, y, op));
+    }
+
+    Node *scale(Node *x, uint32_t k) {
+        if (x == nullptr)
+            return nullptr;
+        return at(new BinaryOp(x, at(new Integer((int) k)), '*'));
+    }
+
+    // e como base + coef * i; false se nao e giez ou nao e afim no contador.
+    bool affine(Node *n, Affine &a) {
+        ArenaList<Node*> &c = n->getChildren();
+        switch (n->getKind()) {
+        case NK_INTEGER:
+            a = {n, nullptr};
+            return true;
+        case NK_IDENT: {
+            int var = varOf(n);
+            if (var < 0 || fn.vars[var].type != VT_INT)
+                return false;
+            if ((uint32_t) var == counter) {
+                a = {nullptr, at(new Integer(1))};
+                return true;
+            }
+            if (written[var] == stamp)
+                return false;
+            a = {n, nullptr};
+            return true;
+        }
+        case NK_UNARY: {
+            Affine v;
+            if (static_cast<Unary*>(n)->getOperation() != '-' || !affine(c[0], v))
+                return false;
+            if (v.coef == nullptr)
+                a = {n, nullptr};
+            else
+                a = {combine(nullptr, v.base, '-'), combine(nullptr, v.coef, '-')};
+            return true;
+        }
+        case NK_BINARYOP: {
+            char op = static_cast<BinaryOp*>(n)->getOperation();
+            Affine l, r;
+            if (!affine(c[0], l) || !affine(c[1], r))
+                return false;
+            if (l.coef == nullptr && r.coef == nullptr) {
+                // a conta toda e invariante, ate / e %
+                a = {n, nullptr};
+                return true;
+            }
+            switch (op) {
+            case '+':
+            case '-':
+                a = {combine(l.base, r.base, op), combine(l.coef, r.coef, op)};
+                return true;
+            case '*':
+                // invariante vezes coef * i; o outro fator nao se repete
+                if (l.coef == nullptr && r.base == nullptr)
+                    a = {nullptr, at(new BinaryOp(c[0], r.coef, '*'))};
+                else if (r.coef == nullptr && l.base == nullptr)
+                    a = {nullptr, at(new BinaryOp(l.coef, c[1], '*'))};
+                else
+                    return false;
+                return true;
+            default:
+                return false;
+            }
+        }
+        default:
+            return false;
+        }
+    }
+
+    // Voltas de i op k com i comecando em v0 e passo d; false se o laco so
+    // sai dando a volta no giez. Com d = -1 a conta e feita sobre -i.
+    static bool tripCount(int v0, uint32_t op, int k, int d, uint64_t &n) {
+        static const uint32_t flipped[] = {1, 0, 2, 3, 5, 4};
+        int64_t x = v0, b = k, max = INT32_MAX;
+        if (d < 0) {
+            x = -x;
+            b = -b;
+            op = flipped[op];
+            max = -(int64_t) INT32_MIN;
+        }
+        if (!compare_result(op, x < b ? -1 : x > b ? 1 : 0)) {
+            n = 0;
+            return true;
+        }
+        switch (op) {
+        case 4:     // <
+            n = (uint64_t) (b - x);
+            return true;
+        case 0:     // <=
+            if (b >= max)
+                return false;
+            n = (uint64_t) (b - x + 1);
+            return true;
+        case 3:     // !=
+            if (x > b)
+                return false;
+            n = (uint64_t) (b - x);
+            return true;
+        case 2:     // ==
+            n = 1;
+            return true;
+        default:    // > e >=: so saem dando a volta
+            return false;
+        }
+    }
+
+    // Voltas do laco, se ele e contado.
+    bool counted(Node *loop, int &v0, int &d, uint64_t &n) {
+        ArenaList<Node*> &c = loop->getChildren();
+        Variable *decl = static_cast<Variable*>(c[0]);
+        int var = varOf(decl);
+        if (var < 0 || fn.vars[var].type != VT_INT || varOf(c[2]) != var
+            || decl->getValue()->getKind() != NK_INTEGER)
+            return false;
+        v0 = static_cast<Integer*>(decl->getValue())->getValue();
+        d = static_cast<Pass*>(c[2])->getOperation()[0] == '-' ? -1 : 1;
+
+        if (c[1]->getKind() != NK_CONDITION)
+            return false;
+        const char *op = static_cast<Condition*>(c[1])->getOperation();
+        if (op[0] == '|' || op[0] == '&')
+            return false;
+        static const uint32_t flipped[] = {1, 0, 2, 3, 5, 4};
+        uint32_t code = condition_op_code(op);
+        Node *l = c[1]->getChildren()[0];
+        Node *r = c[1]->getChildren()[1];
+        Node *bound;
+        if (isVar(l, var))
+            bound = r;
+        else if (isVar(r, var)) {
+            bound = l;
+            code = flipped[code];
+        } else
+            return false;
+        if (bound->getKind() != NK_INTEGER)
+            return false;
+        counter = (uint32_t) var;
+        return tripCount(v0, code, static_cast<Integer*>(bound)->getValue(), d, n);
+    }
+
+    // Reducoes do corpo, ou false se ele tem outra coisa.
+    bool collect(Node *body) {
+        reductions.clear();
+        stamp++;
+        for (Node *s : body->getChildren()) {
+            if (s->getKind() != NK_ATTRIBUTION)
+                return false;
+            Attribution *a = static_cast<Attribution*>(s);
+            int var = varOf(a);
+            if (var < 0 || (uint32_t) var == counter || fn.vars[var].type != VT_INT)
+                return false;
+            Node *v = a->getValue();
+            if (v->getKind() != NK_BINARYOP)
+                return false;
+            char op = static_cast<BinaryOp*>(v)->getOperation();
+            Node *l = v->getChildren()[0];
+            Node *r = v->getChildren()[1];
+            if ((op == '+' || op == '-') && isVar(l, var))
+                reductions.push_back({a, static_cast<Ident*>(l), r, op});
+            else if (op == '+' && isVar(r, var))
+                reductions.push_back({a, static_cast<Ident*>(r), l, op});
+            else
+                return false;
+            written[var] = stamp;
+        }
+        return true;
+    }
+
+    // Troca o laco pelas reducoes fechadas em items; false se ele fica.
+    bool close(Node *loop) {
+        int v0, d;
+        uint64_t n;
+        if (!counted(loop, v0, d, n) || !collect(loop->getChildren()[3]))
+            return false;
+        if (n == 0)
+            return true;
+
+        vector<Affine> steps(reductions.size());
+        for (size_t k = 0; k < reductions.size(); k++) {
+            line = reductions[k].node->getLineNo();
+            if (!affine(reductions[k].step, steps[k]))
+                return false;
+        }
+
+        // T = n * v0 + d * n * (n - 1) / 2, modulo 2^64 e depois 2^32
+        uint64_t pairs = n % 2 == 0 ? (n / 2) * (n - 1) : n * ((n - 1) / 2);
+        uint64_t sum = n * (uint64_t) (int64_t) v0 + (d < 0 ? 0 - pairs : pairs);
+        for (size_t k = 0; k < reductions.size(); k++) {
+            Reduction &red = reductions[k];
+            line = red.node->getLineNo();
+            Node *total = combine(scale(steps[k].base, (uint32_t) n), scale(steps[k].coef, (uint32_t) sum), '+');
+            red.node->setChild(0, at(new BinaryOp(red.target, total, red.sign)));
+            items.push_back(red.node);
+        }
+        return true;
+    }
+
+public:
+    InductionVariables(Program *p) : fn(CfgBuilder().build(p)) {
+        for (const IrSource &src : fn.sources)
+            vars[src.node] = src.var;
+        written.assign(fn.vars.size(), 0);
+    }
+
+    // Devolve quantos lacos sairam da arvore.
+    size_t run(Node *program) {
+        walk(program);
+        return closed;
+    }
+
+    // Pos-ordem: um laco de dentro ja virou reducoes quando o de fora e
+    // visto, e o de fora pode fechar sobre elas.
+    void dispatch(Node *n) {
+        if (n->getKind() != NK_STMTS && n->getKind() != NK_BLOCK)
+            return;
+        ArenaList<Node*> &c = n->getChildren();
+        items.clear();
+        bool changed = false;
+        for (Node *s : c) {
+            if (s->getKind() == NK_LOOP && close(s)) {
+                closed++;
+                changed = true;
+                continue;
+            }
+            items.push_back(s);
+        }
+        if (changed) {
+            c.truncate(0);
+            for (Node *s : items)
+                c.push_back(s);
+        }
+    }
+};
+
+#endif
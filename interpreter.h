@@ -0,0 +1,532 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "nodes.h"
+
+using namespace std;
+
+// Tipos de valor em tempo de execucao, na ordem de type_names
+// (giez, bevumbagon, engos, iderennon).
+enum ValueType : uint8_t {
+    VT_INT,
+    VT_FLOAT,
+    VT_STRING,
+    VT_BOOL
+};
+
+// Valor tipado. Strings apontam para o texto internado nos atoms (literais
+// e o que foi lido por pikibagon), que vive ate o fim da compilacao.
+struct Value {
+    ValueType type;
+    uint32_t len;
+    union {
+        int i;
+        double f;
+        bool b;
+        const char *s;
+    };
+
+    static Value ofInt(int v) {
+        Value r;
+        r.type = VT_INT;
+        r.i = v;
+        return r;
+    }
+    static Value ofFloat(double v) {
+        Value r;
+        r.type = VT_FLOAT;
+        r.f = v;
+        return r;
+    }
+    static Value ofBool(bool v) {
+        Value r;
+        r.type = VT_BOOL;
+        r.b = v;
+        return r;
+    }
+    static Value ofString(string_view v) {
+        Value r;
+        r.type = VT_STRING;
+        r.s = v.data();
+        r.len = (uint32_t) v.size();
+        return r;
+    }
+
+    bool isNumber() const {
+        return type == VT_INT || type == VT_FLOAT;
+    }
+    double number() const {
+        return type == VT_INT ? (double) i : f;
+    }
+    string_view str() const {
+        return string_view(s, len);
+    }
+};
+
+inline ValueType value_type(TypeDec *t) {
+    return (ValueType) type_code(t->getType());
+}
+
+// Texto de um literal "..." sem as aspas.
+inline string_view literal_text(string_view lit) {
+    if (lit.size() >= 2 && lit.front() == '"' && lit.back() == '"')
+        return lit.substr(1, lit.size() - 2);
+    return lit;
+}
+
+// Le uma palavra da entrada e converte para o tipo pedido. Devolve a
+// mensagem de erro (com a palavra lida em buf) ou nullptr.
+inline const char *scan_value(FILE *in, ValueType type, Value &v, char (&buf)[256]) {
+    buf[0] = '\0';
+    if (fscanf(in, "%255s", buf) != 1)
+        return "fim da entrada em pikibagon";
+    char *end = buf;
+    switch (type) {
+    case VT_INT: {
+        long x = strtol(buf, &end, 10);
+        if (*end == '\0') {
+            v = Value::ofInt((int) x);
+            return nullptr;
+        }
+        break;
+    }
+    case VT_FLOAT: {
+        double x = strtod(buf, &end);
+        if (*end == '\0') {
+            v = Value::ofFloat(x);
+            return nullptr;
+        }
+        break;
+    }
+    case VT_BOOL:
+        if (strcmp(buf, "dreje") == 0 || strcmp(buf, "true") == 0) {
+            v = Value::ofBool(true);
+            return nullptr;
+        }
+        if (strcmp(buf, "pirta") == 0 || strcmp(buf, "false") == 0) {
+            v = Value::ofBool(false);
+            return nullptr;
+        }
+        break;
+    case VT_STRING:
+        v = Value::ofString(atoms.name(atoms.intern(buf, strlen(buf))));
+        return nullptr;
+    }
+    return "entrada inválida em pikibagon: ";
+}
+
+// Conversao de uma atribuicao para o tipo declarado: so entre numeros.
+inline bool convert_value(Value &v, ValueType to) {
+    if (v.type == to)
+        return true;
+    if (to == VT_INT && v.type == VT_FLOAT) {
+        v = Value::ofInt((int) v.f);
+        return true;
+    }
+    if (to == VT_FLOAT && v.type == VT_INT) {
+        v = Value::ofFloat((double) v.i);
+        return true;
+    }
+    return false;
+}
+
+// Comparacao de tres vias (c < 0, 0 ou > 0); false se os tipos nao se
+// comparam.
+inline bool three_way(Value a, Value b, int &c) {
+    if (a.isNumber() && b.isNumber()) {
+        double x = a.number(), y = b.number();
+        if (a.type == VT_INT && b.type == VT_INT)
+            c = (a.i > b.i) - (a.i < b.i);
+        else
+            c = (x > y) - (x < y);
+    } else if (a.type == b.type && a.type == VT_STRING) {
+        c = a.str().compare(b.str());
+    } else if (a.type == b.type && a.type == VT_BOOL) {
+        c = (int) a.b - (int) b.b;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// op e o codigo de condition_op_code.
+inline bool compare_result(uint32_t op, int c) {
+    switch (op) {
+    case 0: return c <= 0;
+    case 1: return c >= 0;
+    case 2: return c == 0;
+    case 3: return c != 0;
+    case 4: return c < 0;
+    default: return c > 0;
+    }
+}
+
+inline void print_value(FILE *out, Value v) {
+    switch (v.type) {
+    case VT_INT: fprintf(out, "%d\n", v.i); break;
+    case VT_FLOAT: fprintf(out, "%g\n", v.f); break;
+    case VT_BOOL: fputs(v.b ? "dreje\n" : "pirta\n", out); break;
+    case VT_STRING: fprintf(out, "%.*s\n", (int) v.len, v.s); break;
+    }
+}
+
+// Quem assume um syt quando o cabecalho dele fica quente no interpretador
+// (--jit e --trace, jit.h). resume continua o laco a partir do teste, sobre
+// as variaveis do frame. LOOP_KEPT devolve o laco ao interpretador,
+// LOOP_FAILED traz a linha e a mensagem de um erro de execucao e
+// LOOP_EXITED para no meio do corpo, num lo que saiu do caminho gravado:
+// o interpretador termina a volta dali e chama resume de novo.
+class LoopRunner {
+public:
+    enum Result { LOOP_KEPT, LOOP_DONE, LOOP_FAILED, LOOP_EXITED };
+    static constexpr uint32_t HOT_TURNS = 8;
+
+    // Cada lo ou daor da volta gravada e o lado que tomou.
+    typedef vector<pair<Node*, bool>> Trace;
+
+    struct Exit {
+        int line = 0;
+        string message;
+        // de dentro para fora: o bloco e a posicao do lo de saida, depois
+        // o de cada lo que contem esse bloco
+        vector<pair<Node*, uint32_t>> path;
+    };
+
+    // Se quer gravada a volta antes do cabecalho ficar quente.
+    virtual bool traces() {
+        return false;
+    }
+
+    virtual Result resume(Node *loop, Value *frame, const Trace &trace, Exit &exit) = 0;
+    virtual ~LoopRunner() {}
+};
+
+// Executa a arvore ja checada (--run). As variaveis ficam num vetor de
+// slots resolvidos pelo CheckVarDecl, sem busca por nome em tempo de
+// execucao. Um erro de execucao e reportado com a linha e para o programa.
+class Interpreter {
+private:
+    const char *file;
+    FILE *out;
+    FILE *in;
+    vector<Value> frame;
+    vector<Node*> spine;
+    LoopRunner *runner = nullptr;
+    unordered_map<Node*, uint32_t> hits;    // voltas de cada syt, para o runner
+    LoopRunner::Trace trace;
+    bool recording = false;
+    bool halted = false;
+
+    void fail(int line, string_view msg, string_view arg = "") {
+        if (halted)
+            return;
+        halted = true;
+        fprintf(out, "%s:%d:0: runtime error: %.*s%.*s\n", file, line,
+                (int) msg.size(), msg.data(), (int) arg.size(), arg.data());
+    }
+
+    // Converte para o tipo declarado da variavel.
+    bool convert(Value &v, ValueType to, int line) {
+        if (convert_value(v, to))
+            return true;
+        fail(line, "tipo incompatível na atribuição");
+        return false;
+    }
+
+    void store(uint32_t slot, Atom name, Value v, int line) {
+        if (slot == Node::NO_SLOT) {
+            fail(line, "variável não declarada: ", atoms.name(name));
+            return;
+        }
+        if (convert(v, frame[slot].type, line))
+            frame[slot] = v;
+    }
+
+    Value arith(char op, Value a, Value b, int line) {
+        if (!a.isNumber() || !b.isNumber()) {
+            fail(line, "operação aritmética com valor não numérico");
+            return Value::ofInt(0);
+        }
+        if (a.type == VT_INT && b.type == VT_INT) {
+            // giez tem 32 bits e da a volta no overflow, sem UB
+            unsigned x = (unsigned) a.i, y = (unsigned) b.i;
+            switch (op) {
+            case '+': return Value::ofInt((int) (x + y));
+            case '-': return Value::ofInt((int) (x - y));
+            case '*': return Value::ofInt((int) (x * y));
+            case '/':
+            case '%':
+                if (b.i == 0) {
+                    fail(line, "divisão por zero");
+                    return Value::ofInt(0);
+                }
+                if (b.i == -1)
+                    return Value::ofInt(op == '/' ? (int) (0u - x) : 0);
+                return Value::ofInt(op == '/' ? a.i / b.i : a.i % b.i);
+            }
+        }
+        double x = a.number(), y = b.number();
+        switch (op) {
+        case '+': return Value::ofFloat(x + y);
+        case '-': return Value::ofFloat(x - y);
+        case '*': return Value::ofFloat(x * y);
+        case '/': return Value::ofFloat(x / y);
+        default: return Value::ofFloat(fmod(x, y));
+        }
+    }
+
+    // Operando esquerdo de a+b+c+... e uma cadeia do tamanho da expressao;
+    // ela e percorrida com um vetor, entao a recursao fica limitada pela
+    // profundidade de parenteses (que o parser ja limita).
+    Value evalBinary(BinaryOp *bo) {
+        size_t base = spine.size();
+        Node *n = bo;
+        while (n->getKind() == NK_BINARYOP) {
+            spine.push_back(n);
+            n = n->getChildren()[0];
+        }
+        Value acc = eval(n);
+        while (spine.size() > base) {
+            BinaryOp *op = static_cast<BinaryOp*>(spine.back());
+            spine.pop_back();
+            if (!halted)
+                acc = arith(op->getOperation(), acc, eval(op->getChildren()[1]), op->getLineNo());
+        }
+        return acc;
+    }
+
+    Value eval(Node *n) {
+        switch (n->getKind()) {
+        case NK_INTEGER: return Value::ofInt(static_cast<Integer*>(n)->getValue());
+        case NK_FLOAT: return Value::ofFloat(static_cast<Float*>(n)->getValue());
+        case NK_TRUE: return Value::ofBool(true);
+        case NK_FALSE: return Value::ofBool(false);
+        case NK_STRING: return Value::ofString(literal_text(static_cast<String*>(n)->getValue()));
+        case NK_IDENT: return frame[static_cast<Ident*>(n)->getSlot()];
+        case NK_BINARYOP: return evalBinary(static_cast<BinaryOp*>(n));
+        case NK_UNARY: {
+            Value v = eval(n->getChildren()[0]);
+            if (v.type == VT_INT)
+                return Value::ofInt((int) (0u - (unsigned) v.i));
+            if (v.type == VT_FLOAT)
+                return Value::ofFloat(-v.f);
+            fail(n->getLineNo(), "operação aritmética com valor não numérico");
+            return v;
+        }
+        default:
+            fail(n->getLineNo(), "expressão inválida");
+            return Value::ofInt(0);
+        }
+    }
+
+    bool compare(const char *op, Value a, Value b, int line) {
+        int c;
+        if (!three_way(a, b, c)) {
+            fail(line, "comparação entre tipos diferentes");
+            return false;
+        }
+        return compare_result(condition_op_code(op), c);
+    }
+
+    bool test(Node *n) {
+        if (n->getKind() != NK_CONDITION) {
+            Value v = eval(n);
+            if (v.type != VT_BOOL) {
+                fail(n->getLineNo(), "condição não booleana");
+                return false;
+            }
+            return v.b;
+        }
+        Condition *c = static_cast<Condition*>(n);
+        const char *op = c->getOperation();
+        Node *l = c->getChildren()[0];
+        Node *r = c->getChildren()[1];
+        if (op[0] == '|')
+            return test(l) || (!halted && test(r));
+        if (op[0] == '&')
+            return test(l) && !halted && test(r);
+        Value a = eval(l);
+        Value b = eval(r);
+        return !halted && compare(op, a, b, c->getLineNo());
+    }
+
+    Value scan(ValueType type, int line) {
+        char buf[256];
+        Value v = Value::ofInt(0);
+        if (const char *err = scan_value(in, type, v, buf))
+            fail(line, err, buf);
+        return v;
+    }
+
+    void declare(Variable *var) {
+        ValueType type = value_type(var->getType());
+        Value v;
+        if (var->getValue()->getKind() == NK_SCAN)
+            v = scan(type, var->getLineNo());
+        else
+            v = eval(var->getValue());
+        if (halted)
+            return;
+        frame[var->getSlot()].type = type;
+        store(var->getSlot(), var->getAtom(), v, var->getLineNo());
+    }
+
+    void step(Pass *p) {
+        uint32_t slot = p->getSlot();
+        if (slot == Node::NO_SLOT) {
+            fail(p->getLineNo(), "variável não declarada: ", atoms.name(p->getAtom()));
+            return;
+        }
+        Value &v = frame[slot];
+        int d = p->getOperation()[0] == '-' ? -1 : 1;
+        if (v.type == VT_INT)
+            v.i = (int) ((unsigned) v.i + (unsigned) d);
+        else if (v.type == VT_FLOAT)
+            v.f += d;
+        else
+            fail(p->getLineNo(), "operação aritmética com valor não numérico");
+    }
+
+    // Termina a volta a partir do lo de uma saida do runner.
+    void finish(const vector<pair<Node*, uint32_t>> &path) {
+        for (size_t k = 0; k < path.size() && !halted; k++) {
+            ArenaList<Node*> &c = path[k].first->getChildren();
+            for (size_t i = path[k].second + (k > 0); i < c.size() && !halted; i++)
+                exec(c[i]);
+        }
+    }
+
+    // O resto do laco pelo runner, a partir do teste; false se ele ficou
+    // com o interpretador.
+    bool handOver(Node *loop) {
+        for (;;) {
+            LoopRunner::Exit exit;
+            switch (runner->resume(loop, frame.data(), trace, exit)) {
+            case LoopRunner::LOOP_KEPT:
+                return false;
+            case LoopRunner::LOOP_DONE:
+                return true;
+            case LoopRunner::LOOP_FAILED:
+                fail(exit.line, exit.message);
+                return true;
+            case LoopRunner::LOOP_EXITED:
+                finish(exit.path);
+                if (!halted)
+                    step(static_cast<Pass*>(loop->getChildren()[2]));
+                if (halted)
+                    return true;
+                break;
+            }
+        }
+    }
+
+    void exec(Node *n) {
+        ArenaList<Node*> &c = n->getChildren();
+        switch (n->getKind()) {
+        case NK_STMTS:
+        case NK_BLOCK:
+            for (size_t i = 0; i < c.size() && !halted; i++)
+                exec(c[i]);
+            break;
+        case NK_VARIABLE:
+            declare(static_cast<Variable*>(n));
+            break;
+        case NK_ATTRIBUTION: {
+            Attribution *a = static_cast<Attribution*>(n);
+            uint32_t slot = a->getSlot();
+            Value v;
+            if (a->getValue()->getKind() == NK_SCAN) {
+                if (slot == Node::NO_SLOT) {
+                    fail(a->getLineNo(), "variável não declarada: ", atoms.name(a->getAtom()));
+                    break;
+                }
+                v = scan(frame[slot].type, a->getLineNo());
+            }
+            else
+                v = eval(a->getValue());
+            if (!halted)
+                store(slot, a->getAtom(), v, a->getLineNo());
+            break;
+        }
+        case NK_PRINT: {
+            Value v = eval(c[0]);
+            if (!halted)
+                print_value(out, v);
+            break;
+        }
+        case NK_IF: {
+            bool t = test(c[0]);
+            if (recording)
+                trace.push_back({n, t});
+            if (t && !halted)
+                exec(c[1]);
+            break;
+        }
+        case NK_IFELSE: {
+            bool t = test(c[0]);
+            if (recording)
+                trace.push_back({n, t});
+            if (!halted)
+                exec(t ? c[1] : c[2]);
+            break;
+        }
+        case NK_LOOP: {
+            exec(c[0]);
+            uint32_t *turns = runner != nullptr ? &hits[n] : nullptr;
+            while (!halted) {
+                if (turns != nullptr && *turns >= LoopRunner::HOT_TURNS) {
+                    if (handOver(n))
+                        break;
+                    turns = nullptr;
+                    continue;
+                }
+                if (!test(c[1]) || halted)
+                    break;
+                bool record = turns != nullptr && *turns + 1 == LoopRunner::HOT_TURNS
+                    && !recording && runner->traces();
+                if (record) {
+                    trace.clear();
+                    recording = true;
+                }
+                exec(c[3]);
+                if (record)
+                    recording = false;
+                if (!halted)
+                    step(static_cast<Pass*>(c[2]));
+                if (turns != nullptr)
+                    ++*turns;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+public:
+    Interpreter(const char *file, FILE *out, FILE *in = stdin) : file(file), out(out), in(in) {}
+
+    void setLoopRunner(LoopRunner *r) {
+        runner = r;
+    }
+
+    // false se o programa parou num erro de execucao.
+    bool run(Program *program) {
+        frame.assign(program->getFrameSize(), Value::ofInt(0));
+        for (Node *n : program->getChildren())
+            exec(n);
+        fflush(out);
+        return !halted;
+    }
+};
+
+#endif
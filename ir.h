@@ -0,0 +1,211 @@
+#ifndef IR_H
+#define IR_H
+
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "interpreter.h"
+
+using namespace std;
+
+// Representacao intermediaria: um grafo de blocos basicos (CFG) com
+// instrucoes de tres enderecos. Cada instrucao que produz valor e o
+// proprio valor: o id dela em IrFunction::instrs. Antes do SSA as
+// variaveis sao lidas e escritas por IR_LOAD/IR_STORE; depois (ssa.h)
+// elas viram valores e IR_PHI nos pontos de juncao.
+
+static constexpr uint32_t IR_NONE = 0xffffffffu;
+
+enum IrOp : uint8_t {
+    IR_CONST,   // k
+    IR_UNDEF,   // valor de uma variavel antes de qualquer escrita
+    IR_PHI,     // args[i] vem de preds[i]
+    IR_ADD,     // a op b, no tipo type (giez ou bevumbagon)
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MOD,
+    IR_NEG,     // -a
+    IR_I2F,     // a giez para bevumbagon
+    IR_F2I,     // a bevumbagon para giez
+    IR_CMP,     // a cmp b, iderennon; cmp e o codigo de condition_op_code
+    IR_SCAN,    // pikibagon do tipo type
+    IR_PRINT,   // bardugon(a)
+    IR_LOAD,    // le var (so antes do SSA)
+    IR_STORE,   // var = a (so antes do SSA)
+    IR_NOP,     // apagada
+    IR_OP_COUNT
+};
+
+static const char *const ir_op_names[] = {
+    "const", "undef", "phi", "add", "sub", "mul", "div", "mod", "neg", "i2f", "f2i",
+    "cmp", "scan", "print", "load", "store", "nop"
+};
+static_assert(sizeof(ir_op_names) / sizeof(*ir_op_names) == IR_OP_COUNT, "um nome por IrOp");
+
+// Nomes dos codigos de condition_op_code no texto do IR.
+static const char *const ir_cmp_names[] = {"le", "ge", "eq", "ne", "lt", "gt"};
+
+inline bool ir_has_value(IrOp op) {
+    return op != IR_PRINT && op != IR_STORE && op != IR_NOP;
+}
+
+struct IrInstr {
+    IrOp op = IR_NOP;
+    ValueType type = VT_INT;    // tipo do resultado; PRINT/STORE: do operando
+    uint8_t cmp = 0;
+    uint32_t a = IR_NONE;
+    uint32_t b = IR_NONE;
+    uint32_t var = IR_NONE;     // LOAD/STORE/PHI: variavel de origem
+    uint32_t block = IR_NONE;
+    int line = 0;
+    Value k{};                  // IR_CONST
+    vector<uint32_t> args;      // IR_PHI
+};
+
+enum IrTerm : uint8_t {
+    TERM_NONE,
+    TERM_JMP,   // succ[0]
+    TERM_BR,    // cond ? succ[0] : succ[1]
+    TERM_RET,
+    TERM_FAIL   // erro de execucao messages[message]
+};
+
+struct IrBlock {
+    vector<uint32_t> code;      // ids das instrucoes, phis primeiro
+    vector<uint32_t> preds;
+    IrTerm term = TERM_NONE;
+    uint32_t cond = IR_NONE;
+    uint32_t succ[2] = {IR_NONE, IR_NONE};
+    uint32_t message = IR_NONE;
+    int line = 0;
+
+    size_t succCount() const {
+        return term == TERM_BR ? 2 : term == TERM_JMP ? 1 : 0;
+    }
+};
+
+struct IrVar {
+    Atom name;
+    ValueType type;
+};
+
+// No da arvore que le ou escreve uma variavel: Ident (value e o valor que
+// ele le, IR_NONE se o bloco dele sumiu), Variable, Attribution ou Pass.
+// Serve aos passes que analisam o IR e reescrevem a arvore.
+struct IrSource {
+    Node *node;
+    uint32_t var;
+    uint32_t value;
+};
+
+struct IrFunction {
+    vector<IrInstr> instrs;
+    vector<IrBlock> blocks;     // blocks[0] e a entrada
+    vector<IrVar> vars;
+    vector<string> messages;
+    vector<IrSource> sources;
+    vector<Atom> unresolved;    // nomes lidos ou escritos sem declaracao
+    bool ssa = false;
+
+    uint32_t newBlock() {
+        blocks.emplace_back();
+        return (uint32_t) blocks.size() - 1;
+    }
+
+    uint32_t add(uint32_t block, IrInstr in) {
+        in.block = block;
+        instrs.push_back(std::move(in));
+        uint32_t id = (uint32_t) instrs.size() - 1;
+        blocks[block].code.push_back(id);
+        return id;
+    }
+
+    // Recalcula preds a partir dos sucessores, na ordem dos blocos.
+    void computePreds() {
+        for (IrBlock &b : blocks)
+            b.preds.clear();
+        for (uint32_t i = 0; i < blocks.size(); i++)
+            for (size_t s = 0; s < blocks[i].succCount(); s++)
+                blocks[blocks[i].succ[s]].preds.push_back(i);
+    }
+};
+
+inline const char *ir_type_suffix(ValueType t) {
+    static const char *const suffixes[] = {"i", "f", "s", "b"};
+    return suffixes[t];
+}
+
+inline void print_ir_constant(FILE *out, const Value &k) {
+    switch (k.type) {
+    case VT_INT: fprintf(out, "%d", k.i); break;
+    case VT_FLOAT: fprintf(out, "%.9g", k.f); break;
+    case VT_STRING: fprintf(out, "\"%.*s\"", (int) k.len, k.s); break;
+    case VT_BOOL: fputs(k.b ? "dreje" : "pirta", out); break;
+    }
+}
+
+// Texto do IR (--emit-ssa): um bloco por rotulo, os predecessores em
+// comentario e o nome da variavel ao lado dos phis.
+inline void print_ir(const IrFunction &fn, FILE *out) {
+    for (uint32_t bi = 0; bi < fn.blocks.size(); bi++) {
+        const IrBlock &b = fn.blocks[bi];
+        fprintf(out, "bb%u:", bi);
+        if (!b.preds.empty()) {
+            fputs("    ; preds", out);
+            for (uint32_t p : b.preds)
+                fprintf(out, " bb%u", p);
+        }
+        fputc('\n', out);
+        for (uint32_t id : b.code) {
+            const IrInstr &in = fn.instrs[id];
+            fputs("    ", out);
+            if (ir_has_value(in.op))
+                fprintf(out, "v%u = ", id);
+            if (in.op == IR_CMP)
+                fprintf(out, "%s.%s", ir_cmp_names[in.cmp], ir_type_suffix(fn.instrs[in.a].type));
+            else
+                fprintf(out, "%s.%s", ir_op_names[in.op], ir_type_suffix(in.type));
+            switch (in.op) {
+            case IR_CONST:
+                fputc(' ', out);
+                print_ir_constant(out, in.k);
+                break;
+            case IR_PHI:
+                for (size_t i = 0; i < in.args.size(); i++)
+                    fprintf(out, "%s [v%u, bb%u]", i ? "," : "", in.args[i], b.preds[i]);
+                break;
+            case IR_LOAD:
+                fprintf(out, " %.*s", (int) atoms.name(fn.vars[in.var].name).size(),
+                        atoms.name(fn.vars[in.var].name).data());
+                break;
+            case IR_STORE:
+                fprintf(out, " %.*s, v%u", (int) atoms.name(fn.vars[in.var].name).size(),
+                        atoms.name(fn.vars[in.var].name).data(), in.a);
+                break;
+            default:
+                if (in.a != IR_NONE)
+                    fprintf(out, " v%u", in.a);
+                if (in.b != IR_NONE)
+                    fprintf(out, ", v%u", in.b);
+                break;
+            }
+            if (in.op == IR_PHI && in.var != IR_NONE) {
+                string_view name = atoms.name(fn.vars[in.var].name);
+                fprintf(out, "    ; %.*s", (int) name.size(), name.data());
+            }
+            fputc('\n', out);
+        }
+        switch (b.term) {
+        case TERM_JMP: fprintf(out, "    jmp bb%u\n", b.succ[0]); break;
+        case TERM_BR: fprintf(out, "    br v%u, bb%u, bb%u\n", b.cond, b.succ[0], b.succ[1]); break;
+        case TERM_RET: fputs("    ret\n", out); break;
+        case TERM_FAIL: fprintf(out, "    fail \"%s\"\n", fn.messages[b.message].c_str()); break;
+        case TERM_NONE: fputs("    ; sem terminador\n", out); break;
+        }
+    }
+    fflush(out);
+}
+
+#endif
@@ -0,0 +1,741 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <sys/mman.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "interpreter.h"
+
+using namespace std;
+
+// JIT de lacos (--jit): o Interpreter roda o programa e, depois de
+// LoopRunner::HOT_TURNS voltas de um syt, passa o resto do laco para
+// codigo de maquina x86-64 gerado direto na memoria (mmap, depois
+// mprotect para executavel). O codigo trabalha sobre o proprio frame do
+// interpretador, com %rbx apontando para ele, entao entrar no meio do laco
+// e so pular para o teste. Os tipos sao os do interpretador: giez em
+// registradores de 32 bits, bevumbagon em SSE2, conversao so na
+// atribuicao. bardugon e pikibagon chamam funcoes daqui; divisao por zero
+// e entrada invalida voltam com a linha para o interpretador reportar.
+// Um laco com engos, iderennon ou outra coisa que o gerador nao conhece
+// fica com o interpretador (os lacos de dentro dele ainda podem ir).
+//
+// Com tracing (--trace) o laco vira um trace: o interpretador grava o lado
+// que cada lo e daor tomou na volta antes do cabecalho ficar quente, e so
+// esse caminho e compilado, com o teste de cada lo como guarda. Uma guarda
+// que falha sai do codigo com o lugar do lo (LOOP_EXITED) e o
+// interpretador termina a volta. Um lo que sai HOT_TURNS vezes e instavel:
+// o trace e refeito com os dois lados dele. Os lo dentro de um syt de
+// dentro do trace sao compilados inteiros.
+
+// Contexto que o codigo gerado recebe em %r12. line fica no comeco para os
+// stubs de erro escreverem em (%r12).
+struct JitContext {
+    int32_t line;
+    int32_t exit;       // saida lateral do trace
+    FILE *out;
+    FILE *in;
+    const char *message;
+    char buf[256];
+};
+
+// Bytes de maquina x86-64 e os saltos rel32 ainda por remendar.
+class X64Code {
+public:
+    vector<uint8_t> bytes;
+
+    size_t size() const {
+        return bytes.size();
+    }
+
+    void emit(initializer_list<uint8_t> b) {
+        bytes.insert(bytes.end(), b);
+    }
+
+    void emit32(uint32_t v) {
+        for (int k = 0; k < 4; k++)
+            bytes.push_back((uint8_t) (v >> (8 * k)));
+    }
+
+    void emit64(uint64_t v) {
+        emit32((uint32_t) v);
+        emit32((uint32_t) (v >> 32));
+    }
+
+    // op reg, disp(%rbx)
+    void frame(initializer_list<uint8_t> op, uint8_t reg, uint32_t disp) {
+        emit(op);
+        bytes.push_back((uint8_t) (0x80 | (reg << 3) | 3));
+        emit32(disp);
+    }
+
+    // jcc (cc e o segundo byte, 0x80 a 0x8f) ou jmp com cc == 0; devolve
+    // onde fica o rel32.
+    size_t jump(uint8_t cc) {
+        if (cc == 0)
+            emit({0xE9});
+        else
+            emit({0x0F, cc});
+        emit32(0);
+        return size() - 4;
+    }
+
+    void patch(size_t at, size_t target) {
+        uint32_t rel = (uint32_t) ((int64_t) target - (int64_t) (at + 4));
+        memcpy(&bytes[at], &rel, 4);
+    }
+
+    template<class F>
+    void call(F *fn) {
+        emit({0x48, 0xB8});     // movabs $fn, %rax
+        emit64(reinterpret_cast<uint64_t>(fn));
+        emit({0xFF, 0xD0});     // call *%rax
+    }
+};
+
+// Codigo executavel; vazio se o mmap falhou.
+class ExecMemory {
+private:
+    void *code = nullptr;
+    size_t length = 0;
+
+public:
+    ExecMemory() {}
+
+    explicit ExecMemory(const vector<uint8_t> &bytes) {
+        void *p = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return;
+        memcpy(p, bytes.data(), bytes.size());
+        if (mprotect(p, bytes.size(), PROT_READ | PROT_EXEC) != 0) {
+            munmap(p, bytes.size());
+            return;
+        }
+        code = p;
+        length = bytes.size();
+    }
+
+    ExecMemory(const ExecMemory &) = delete;
+    ExecMemory &operator=(const ExecMemory &) = delete;
+
+    ExecMemory(ExecMemory &&o) : code(o.code), length(o.length) {
+        o.code = nullptr;
+    }
+
+    ExecMemory &operator=(ExecMemory &&o) {
+        swap(code, o.code);
+        swap(length, o.length);
+        return *this;
+    }
+
+    ~ExecMemory() {
+        if (code != nullptr)
+            munmap(code, length);
+    }
+
+    void *get() const {
+        return code;
+    }
+};
+
+class Jit : public LoopRunner {
+private:
+    typedef int (*Entry)(Value *frame, JitContext *ctx);
+
+    enum Status { JIT_OK, JIT_SCAN_FAILED, JIT_DIV_ZERO, JIT_EXITED };
+
+    // jcc de condition_op_code quando a comparacao e verdadeira e quando e
+    // falsa; em bevumbagon o ucomisd troca os operandos de < e >=, e
+    // unordered (NaN) conta como igual, como no three_way.
+    static constexpr uint8_t JE = 0x84, JNE = 0x85, JBE = 0x86, JA = 0x87;
+    static constexpr uint8_t JL = 0x8C, JGE = 0x8D, JLE = 0x8E, JG = 0x8F;
+    static constexpr uint8_t intTrue[] = {JLE, JGE, JE, JNE, JL, JG};
+    static constexpr uint8_t intFalse[] = {JG, JL, JNE, JE, JGE, JLE};
+    static constexpr uint8_t floatTrue[] = {JBE, JBE, JE, JNE, JA, JA};
+    static constexpr uint8_t floatFalse[] = {JA, JA, JNE, JE, JBE, JBE};
+    static constexpr bool floatSwap[] = {false, true, false, false, true, false};
+
+    struct SideExit {
+        Node *branch;
+        vector<pair<Node*, uint32_t>> path;     // como em LoopRunner::Exit
+        uint32_t taken = 0;
+    };
+
+    struct Compiled {
+        ExecMemory code;
+        vector<pair<uint32_t, ValueType>> guards;  // tipos de fora que o codigo supos
+        vector<SideExit> exits;
+    };
+
+    JitContext ctx;
+    bool tracing;
+    unordered_map<Node*, Compiled> loops;
+    unordered_map<Node*, unordered_map<Node*, bool>> recorded;  // syt -> lo -> lado
+    unordered_set<Node*> unstable;            // lo que saem demais
+
+    // estado da compilacao de um laco
+    X64Code x;
+    Value *frame = nullptr;
+    unordered_map<uint32_t, ValueType> types;
+    vector<pair<uint32_t, ValueType>> guards;
+    vector<pair<size_t, int>> divFails;     // salto, linha
+    vector<size_t> scanFails;
+    vector<Node*> spine;
+    size_t depth = 0;                       // temporarios de 8 bytes na pilha
+    bool ok = true;
+    const unordered_map<Node*, bool> *path = nullptr;  // lados gravados do trace
+    size_t nested = 0;                      // syt de dentro do trace
+    vector<pair<Node*, uint32_t>> blocks;   // bloco e posicao, de fora para dentro
+    vector<SideExit> exits;
+    vector<vector<size_t>> exitJumps;
+
+    static void printInt(JitContext *c, int v) {
+        print_value(c->out, Value::ofInt(v));
+    }
+
+    static void printFloat(JitContext *c, double v) {
+        print_value(c->out, Value::ofFloat(v));
+    }
+
+    static void printString(JitContext *c, const char *s, uint32_t len) {
+        print_value(c->out, Value::ofString(string_view(s, len)));
+    }
+
+    static int scanSlot(JitContext *c, Value *slot, int type, int line) {
+        Value v = Value::ofInt(0);
+        if (const char *err = scan_value(c->in, (ValueType) type, v, c->buf)) {
+            c->line = line;
+            c->message = err;
+            return JIT_SCAN_FAILED;
+        }
+        *slot = v;
+        return JIT_OK;
+    }
+
+    static uint32_t valueAt(uint32_t slot) {
+        return (uint32_t) (slot * sizeof(Value) + offsetof(Value, i));
+    }
+
+    static uint32_t typeAt(uint32_t slot) {
+        return (uint32_t) (slot * sizeof(Value) + offsetof(Value, type));
+    }
+
+    static bool numeric(ValueType t) {
+        return t == VT_INT || t == VT_FLOAT;
+    }
+
+    ValueType unsupported() {
+        ok = false;
+        return VT_INT;
+    }
+
+    // Tipo de um slot: o da declaracao ja compilada ou, para uma variavel
+    // de fora do laco, o que esta no frame agora.
+    ValueType slotType(uint32_t slot) {
+        auto it = types.find(slot);
+        if (it != types.end())
+            return it->second;
+        ValueType t = frame[slot].type;
+        guards.push_back({slot, t});
+        types[slot] = t;
+        return t;
+    }
+
+    void push(ValueType t) {
+        x.emit({0x48, 0x83, 0xEC, 0x08});           // sub $8, %rsp
+        if (t == VT_INT)
+            x.emit({0x89, 0x04, 0x24});             // mov %eax, (%rsp)
+        else
+            x.emit({0xF2, 0x0F, 0x11, 0x04, 0x24}); // movsd %xmm0, (%rsp)
+        depth++;
+    }
+
+    // Esquerdo da pilha e direito de %eax/%xmm0: giez em %eax e %ecx,
+    // senao os dois em bevumbagon em %xmm0 e %xmm1. true se bevumbagon.
+    bool operands(ValueType a, ValueType b) {
+        bool fp = a == VT_FLOAT || b == VT_FLOAT;
+        if (!fp) {
+            x.emit({0x89, 0xC1});                   // mov %eax, %ecx
+            x.emit({0x8B, 0x04, 0x24});             // mov (%rsp), %eax
+        } else {
+            if (b == VT_INT)
+                x.emit({0xF2, 0x0F, 0x2A, 0xC8});   // cvtsi2sd %eax, %xmm1
+            else
+                x.emit({0x66, 0x0F, 0x28, 0xC8});   // movapd %xmm0, %xmm1
+            if (a == VT_INT) {
+                x.emit({0x8B, 0x04, 0x24});
+                x.emit({0xF2, 0x0F, 0x2A, 0xC0});   // cvtsi2sd %eax, %xmm0
+            } else {
+                x.emit({0xF2, 0x0F, 0x10, 0x04, 0x24});
+            }
+        }
+        x.emit({0x48, 0x83, 0xC4, 0x08});           // add $8, %rsp
+        depth--;
+        return fp;
+    }
+
+    ValueType arith(char op, ValueType a, ValueType b, int line) {
+        if (!operands(a, b)) {
+            switch (op) {
+            case '+': x.emit({0x01, 0xC8}); break;          // add %ecx, %eax
+            case '-': x.emit({0x29, 0xC8}); break;          // sub %ecx, %eax
+            case '*': x.emit({0x0F, 0xAF, 0xC1}); break;    // imul %ecx, %eax
+            default: {
+                x.emit({0x85, 0xC9});                       // test %ecx, %ecx
+                divFails.push_back({x.jump(JE), line});
+                x.emit({0x83, 0xF9, 0xFF});                 // cmp $-1, %ecx
+                size_t normal = x.jump(JNE);
+                if (op == '/')
+                    x.emit({0xF7, 0xD8});                   // neg %eax
+                else
+                    x.emit({0x31, 0xC0});                   // xor %eax, %eax
+                size_t end = x.jump(0);
+                x.patch(normal, x.size());
+                x.emit({0x99, 0xF7, 0xF9});                 // cltd; idiv %ecx
+                if (op == '%')
+                    x.emit({0x89, 0xD0});                   // mov %edx, %eax
+                x.patch(end, x.size());
+                break;
+            }
+            }
+            return VT_INT;
+        }
+        switch (op) {
+        case '+': x.emit({0xF2, 0x0F, 0x58, 0xC1}); break;  // addsd %xmm1, %xmm0
+        case '-': x.emit({0xF2, 0x0F, 0x5C, 0xC1}); break;
+        case '*': x.emit({0xF2, 0x0F, 0x59, 0xC1}); break;
+        case '/': x.emit({0xF2, 0x0F, 0x5E, 0xC1}); break;
+        default: {
+            // a pilha precisa estar alinhada em 16 na chamada
+            double (*mod)(double, double) = fmod;
+            if (depth % 2 != 0)
+                x.emit({0x48, 0x83, 0xEC, 0x08});
+            x.call(mod);
+            if (depth % 2 != 0)
+                x.emit({0x48, 0x83, 0xC4, 0x08});
+            break;
+        }
+        }
+        return VT_FLOAT;
+    }
+
+    // Mesmo percurso do Interpreter::evalBinary: a cadeia da esquerda vai
+    // num vetor, entao a recursao fica na profundidade dos parenteses.
+    ValueType binary(BinaryOp *bo) {
+        size_t base = spine.size();
+        Node *n = bo;
+        while (n->getKind() == NK_BINARYOP) {
+            spine.push_back(n);
+            n = n->getChildren()[0];
+        }
+        ValueType acc = expr(n);
+        while (spine.size() > base) {
+            BinaryOp *op = static_cast<BinaryOp*>(spine.back());
+            spine.pop_back();
+            if (!ok)
+                continue;
+            push(acc);
+            ValueType r = expr(op->getChildren()[1]);
+            acc = arith(op->getOperation(), acc, r, op->getLineNo());
+        }
+        return acc;
+    }
+
+    // Valor em %eax (giez) ou %xmm0 (bevumbagon).
+    ValueType expr(Node *n) {
+        switch (n->getKind()) {
+        case NK_INTEGER:
+            x.emit({0xB8});
+            x.emit32((uint32_t) static_cast<Integer*>(n)->getValue());
+            return VT_INT;
+        case NK_FLOAT: {
+            double v = static_cast<Float*>(n)->getValue();
+            uint64_t bits;
+            memcpy(&bits, &v, 8);
+            x.emit({0x48, 0xB8});
+            x.emit64(bits);
+            x.emit({0x66, 0x48, 0x0F, 0x6E, 0xC0});         // movq %rax, %xmm0
+            return VT_FLOAT;
+        }
+        case NK_IDENT: {
+            uint32_t slot = static_cast<Ident*>(n)->getSlot();
+            if (slot == Node::NO_SLOT)
+                return unsupported();
+            ValueType t = slotType(slot);
+            if (t == VT_INT)
+                x.frame({0x8B}, 0, valueAt(slot));
+            else if (t == VT_FLOAT)
+                x.frame({0xF2, 0x0F, 0x10}, 0, valueAt(slot));
+            else
+                return unsupported();
+            return t;
+        }
+        case NK_UNARY: {
+            ValueType t = expr(n->getChildren()[0]);
+            if (t == VT_INT)
+                x.emit({0xF7, 0xD8});
+            else
+                x.emit({0x66, 0x48, 0x0F, 0x7E, 0xC0,       // movq %xmm0, %rax
+                        0x48, 0x0F, 0xBA, 0xF8, 0x3F,       // btc $63, %rax
+                        0x66, 0x48, 0x0F, 0x6E, 0xC0});
+            return t;
+        }
+        case NK_BINARYOP:
+            return binary(static_cast<BinaryOp*>(n));
+        default:
+            return unsupported();
+        }
+    }
+
+    // Saltos para quando a condicao da when, como no BytecodeCompiler.
+    void branch(Node *n, bool when, vector<size_t> &jumps) {
+        if (n->getKind() != NK_CONDITION) {
+            unsupported();
+            return;
+        }
+        const char *op = static_cast<Condition*>(n)->getOperation();
+        Node *l = n->getChildren()[0];
+        Node *r = n->getChildren()[1];
+        if (op[0] == '|' || op[0] == '&') {
+            if ((op[0] == '|') == when) {
+                branch(l, when, jumps);
+                branch(r, when, jumps);
+            } else {
+                vector<size_t> skip;
+                branch(l, !when, skip);
+                branch(r, when, jumps);
+                for (size_t at : skip)
+                    x.patch(at, x.size());
+            }
+            return;
+        }
+        ValueType a = expr(l);
+        push(a);
+        ValueType b = expr(r);
+        uint32_t code = condition_op_code(op);
+        if (!operands(a, b)) {
+            x.emit({0x39, 0xC8});                           // cmp %ecx, %eax
+            jumps.push_back(x.jump(when ? intTrue[code] : intFalse[code]));
+            return;
+        }
+        if (floatSwap[code])
+            x.emit({0x66, 0x0F, 0x2E, 0xC8});               // ucomisd %xmm0, %xmm1
+        else
+            x.emit({0x66, 0x0F, 0x2E, 0xC1});               // ucomisd %xmm1, %xmm0
+        jumps.push_back(x.jump(when ? floatTrue[code] : floatFalse[code]));
+    }
+
+    void store(uint32_t slot, ValueType to, ValueType from) {
+        if (to == VT_INT) {
+            if (from == VT_FLOAT)
+                x.emit({0xF2, 0x0F, 0x2C, 0xC0});           // cvttsd2si %xmm0, %eax
+            x.frame({0x89}, 0, valueAt(slot));
+        } else {
+            if (from == VT_INT)
+                x.emit({0xF2, 0x0F, 0x2A, 0xC0});
+            x.frame({0xF2, 0x0F, 0x11}, 0, valueAt(slot));
+        }
+    }
+
+    void scan(uint32_t slot, ValueType type, int line) {
+        x.emit({0x4C, 0x89, 0xE7});                         // mov %r12, %rdi
+        x.frame({0x48, 0x8D}, 6, slot * (uint32_t) sizeof(Value));  // lea slot, %rsi
+        x.emit({0xBA});
+        x.emit32(type);
+        x.emit({0xB9});
+        x.emit32((uint32_t) line);
+        x.call(scanSlot);
+        x.emit({0x85, 0xC0});                               // test %eax, %eax
+        scanFails.push_back(x.jump(JNE));
+    }
+
+    void step(Pass *p) {
+        uint32_t slot = p->getSlot();
+        if (slot == Node::NO_SLOT) {
+            unsupported();
+            return;
+        }
+        int d = p->getOperation()[0] == '-' ? -1 : 1;
+        ValueType t = slotType(slot);
+        if (t == VT_INT) {
+            x.frame({0x81}, 0, valueAt(slot));              // addl $d, slot
+            x.emit32((uint32_t) d);
+        } else if (t == VT_FLOAT) {
+            double one = d;
+            uint64_t bits;
+            memcpy(&bits, &one, 8);
+            x.frame({0xF2, 0x0F, 0x10}, 0, valueAt(slot));
+            x.emit({0x48, 0xB8});
+            x.emit64(bits);
+            x.emit({0x66, 0x48, 0x0F, 0x6E, 0xC8});         // movq %rax, %xmm1
+            x.emit({0xF2, 0x0F, 0x58, 0xC1});
+            x.frame({0xF2, 0x0F, 0x11}, 0, valueAt(slot));
+        } else {
+            unsupported();
+        }
+    }
+
+    // lo do caminho do trace: so o lado gravado, com o teste como guarda.
+    bool guarded(Node *n) {
+        if (path == nullptr || nested > 0 || unstable.count(n) > 0)
+            return false;
+        auto it = path->find(n);
+        if (it == path->end())
+            return false;
+        bool side = it->second;
+        SideExit e;
+        e.branch = n;
+        e.path.assign(blocks.rbegin(), blocks.rend());
+        exits.push_back(e);
+        exitJumps.emplace_back();
+        branch(n->getChildren()[0], !side, exitJumps.back());
+        if (side)
+            stmt(n->getChildren()[1]);
+        else if (n->getKind() == NK_IFELSE)
+            stmt(n->getChildren()[2]);
+        return true;
+    }
+
+    // Do teste ao salto de volta; o valor inicial fica com quem chama.
+    void loop(Node *n) {
+        ArenaList<Node*> &c = n->getChildren();
+        size_t head = x.size();
+        vector<size_t> exits;
+        branch(c[1], false, exits);
+        stmt(c[3]);
+        step(static_cast<Pass*>(c[2]));
+        x.patch(x.jump(0), head);
+        for (size_t at : exits)
+            x.patch(at, x.size());
+    }
+
+    void stmt(Node *n) {
+        ArenaList<Node*> &c = n->getChildren();
+        switch (n->getKind()) {
+        case NK_STMTS:
+        case NK_BLOCK:
+            blocks.push_back({n, 0});
+            for (size_t i = 0; i < c.size() && ok; i++) {
+                blocks.back().second = (uint32_t) i;
+                stmt(c[i]);
+            }
+            blocks.pop_back();
+            break;
+        case NK_VARIABLE: {
+            Variable *var = static_cast<Variable*>(n);
+            uint32_t slot = var->getSlot();
+            ValueType type = value_type(var->getType());
+            if (slot == Node::NO_SLOT || !numeric(type)) {
+                unsupported();
+                break;
+            }
+            if (var->getValue()->getKind() == NK_SCAN) {
+                scan(slot, type, var->getLineNo());
+            } else {
+                store(slot, type, expr(var->getValue()));
+                x.frame({0xC6}, 0, typeAt(slot));           // movb $type, slot
+                x.emit({(uint8_t) type});
+            }
+            types[slot] = type;
+            break;
+        }
+        case NK_ATTRIBUTION: {
+            Attribution *a = static_cast<Attribution*>(n);
+            uint32_t slot = a->getSlot();
+            if (slot == Node::NO_SLOT || !numeric(slotType(slot))) {
+                unsupported();
+                break;
+            }
+            if (a->getValue()->getKind() == NK_SCAN)
+                scan(slot, slotType(slot), a->getLineNo());
+            else
+                store(slot, slotType(slot), expr(a->getValue()));
+            break;
+        }
+        case NK_PRINT: {
+            if (c[0]->getKind() == NK_STRING) {
+                string_view s = literal_text(static_cast<String*>(c[0])->getValue());
+                x.emit({0x4C, 0x89, 0xE7});
+                x.emit({0x48, 0xBE});                       // movabs $s, %rsi
+                x.emit64(reinterpret_cast<uint64_t>(s.data()));
+                x.emit({0xBA});
+                x.emit32((uint32_t) s.size());
+                x.call(printString);
+                break;
+            }
+            ValueType t = expr(c[0]);
+            x.emit({0x4C, 0x89, 0xE7});
+            if (t == VT_INT) {
+                x.emit({0x89, 0xC6});                       // mov %eax, %esi
+                x.call(printInt);
+            } else {
+                x.call(printFloat);
+            }
+            break;
+        }
+        case NK_IF: {
+            if (guarded(n))
+                break;
+            vector<size_t> skip;
+            branch(c[0], false, skip);
+            stmt(c[1]);
+            for (size_t at : skip)
+                x.patch(at, x.size());
+            break;
+        }
+        case NK_IFELSE: {
+            if (guarded(n))
+                break;
+            vector<size_t> other;
+            branch(c[0], false, other);
+            stmt(c[1]);
+            size_t end = x.jump(0);
+            for (size_t at : other)
+                x.patch(at, x.size());
+            stmt(c[2]);
+            x.patch(end, x.size());
+            break;
+        }
+        case NK_LOOP:
+            stmt(c[0]);
+            nested++;
+            loop(n);
+            nested--;
+            break;
+        default:
+            unsupported();
+            break;
+        }
+    }
+
+    // int f(Value *frame, JitContext *ctx), que roda o laco do teste em
+    // diante e devolve um Status.
+    Compiled compile(Node *n, Value *f, const unordered_map<Node*, bool> *p) {
+        x.bytes.clear();
+        frame = f;
+        types.clear();
+        guards.clear();
+        divFails.clear();
+        scanFails.clear();
+        depth = 0;
+        ok = true;
+        path = p;
+        nested = 0;
+        blocks.clear();
+        exits.clear();
+        exitJumps.clear();
+
+        x.emit({0x55,                                       // push %rbp
+                0x48, 0x89, 0xE5,                           // mov %rsp, %rbp
+                0x53, 0x41, 0x54,                           // push %rbx; push %r12
+                0x48, 0x89, 0xFB,                           // mov %rdi, %rbx
+                0x49, 0x89, 0xF4});                         // mov %rsi, %r12
+        loop(n);
+        x.emit({0x31, 0xC0});
+        size_t done = x.size();
+        for (size_t at : scanFails)
+            x.patch(at, done);
+        x.emit({0x48, 0x8D, 0x65, 0xF0,                     // lea -16(%rbp), %rsp
+                0x41, 0x5C, 0x5B, 0x5D, 0xC3});             // pop %r12; pop %rbx; pop %rbp; ret
+        for (auto &[at, line] : divFails) {
+            x.patch(at, x.size());
+            x.emit({0x41, 0xC7, 0x04, 0x24});               // movl $line, (%r12)
+            x.emit32((uint32_t) line);
+            x.emit({0xB8});
+            x.emit32(JIT_DIV_ZERO);
+            x.patch(x.jump(0), done);
+        }
+        for (size_t k = 0; k < exits.size(); k++) {
+            for (size_t at : exitJumps[k])
+                x.patch(at, x.size());
+            x.emit({0x41, 0xC7, 0x44, 0x24, 0x04});         // movl $k, 4(%r12)
+            x.emit32((uint32_t) k);
+            x.emit({0xB8});
+            x.emit32(JIT_EXITED);
+            x.patch(x.jump(0), done);
+        }
+
+        Compiled r;
+        if (ok) {
+            r.code = ExecMemory(x.bytes);
+            r.guards = guards;
+            r.exits = exits;
+        }
+        return r;
+    }
+
+public:
+    Jit(FILE *out, bool tracing = false, FILE *in = stdin) : tracing(tracing) {
+        ctx.line = 0;
+        ctx.exit = 0;
+        ctx.out = out;
+        ctx.in = in;
+        ctx.message = "";
+        ctx.buf[0] = '\0';
+    }
+
+    bool traces() override {
+        return tracing;
+    }
+
+    Result resume(Node *loop, Value *frame, const Trace &trace, Exit &exit) override {
+        auto it = loops.find(loop);
+        if (it != loops.end() && it->second.code.get() != nullptr) {
+            for (auto &[slot, type] : it->second.guards)
+                if (frame[slot].type != type) {
+                    loops.erase(it);
+                    it = loops.end();
+                    break;
+                }
+        }
+        if (it == loops.end()) {
+            const unordered_map<Node*, bool> *p = nullptr;
+            if (tracing) {
+                // a primeira gravacao de cada lo fica para as recompilacoes
+                auto rec = recorded.find(loop);
+                if (rec == recorded.end()) {
+                    rec = recorded.emplace(loop, unordered_map<Node*, bool>()).first;
+                    for (auto &[branch, side] : trace)
+                        rec->second.emplace(branch, side);
+                }
+                p = &rec->second;
+            }
+            it = loops.emplace(loop, compile(loop, frame, p)).first;
+        }
+        void *code = it->second.code.get();
+        if (code == nullptr)
+            return LOOP_KEPT;
+
+        switch (reinterpret_cast<Entry>(code)(frame, &ctx)) {
+        case JIT_OK:
+            return LOOP_DONE;
+        case JIT_SCAN_FAILED:
+            exit.line = ctx.line;
+            exit.message = string(ctx.message) + ctx.buf;
+            return LOOP_FAILED;
+        case JIT_DIV_ZERO:
+            exit.line = ctx.line;
+            exit.message = "divisão por zero";
+            return LOOP_FAILED;
+        default: {
+            SideExit &e = it->second.exits[ctx.exit];
+            exit.path = e.path;
+            if (++e.taken >= HOT_TURNS) {
+                unstable.insert(e.branch);
+                loops.erase(it);
+            }
+            return LOOP_EXITED;
+        }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef LICM_H
+#define LICM_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cfg.h"
+#include "fold.h"
+
+using namespace std;
+
+// Movimento de codigo invariante (-O, arvore de ponteiros): uma conta
+// (BinaryOp ou Unary) dentro de um syt cujas variaveis nao sao escritas no
+// laco, nem pelo Pass nem por Variable ou Attribution do corpo, sai para
+// uma variavel nova declarada logo antes do syt (o pre-cabecalho) e o
+// lugar dela passa a ler essa variavel. Vale para o teste do laco, o
+// corpo e as condicoes de lo la dentro; o valor inicial do syt ja roda uma
+// vez so e fica onde esta. A conta passa a rodar mesmo quando o laco nao
+// roda nenhuma vez, entao so sai o que nao pode falhar: operandos
+// numericos e divisao de giez so por literal diferente de zero.
+class LoopInvariantMotion {
+private:
+    struct Entry {
+        Node *node;
+        Node *parent;
+        uint32_t index;     // posicao entre os filhos do pai
+        uint32_t parentEntry;
+        uint32_t end;       // fim da subarvore em entries
+        int type;           // ValueType ou NOT_NUMERIC
+        bool invariant;
+        bool reads;         // le alguma variavel
+    };
+
+    Program *program;
+    IrFunction fn;
+    unordered_map<Node*, uint32_t> vars;    // Ident/Variable/Attribution/Pass -> IrVar
+    vector<uint32_t> written;               // written[var] == stamp: escrita no laco
+    uint32_t stamp = 0;
+    vector<Entry> entries;
+    size_t hoisted = 0;
+
+    static bool isOperation(Node *n) {
+        return n->getKind() == NK_BINARYOP || n->getKind() == NK_UNARY;
+    }
+
+    int varOf(Node *n) {
+        auto it = vars.find(n);
+        return it != vars.end() ? (int) it->second : -1;
+    }
+
+    // A subarvore de loop em pre-ordem, com o que cada no sabe de si.
+    void collect(Node *loop) {
+        entries.clear();
+        vector<uint32_t> stack;
+        auto push = [&](Node *n, Node *parent, uint32_t index, uint32_t parentEntry) {
+            Entry e{n, parent, index, parentEntry, 0, NOT_NUMERIC, false, false};
+            switch (n->getKind()) {
+            case NK_INTEGER: e.type = VT_INT; e.invariant = true; break;
+            case NK_FLOAT: e.type = VT_FLOAT; e.invariant = true; break;
+            case NK_TRUE:
+            case NK_FALSE:
+            case NK_STRING: e.invariant = true; break;
+            case NK_BINARYOP:
+            case NK_UNARY: e.type = VT_INT; e.invariant = true; break;
+            case NK_IDENT:
+                e.reads = true;
+                break;
+            case NK_VARIABLE:
+            case NK_ATTRIBUTION:
+            case NK_PASS: {
+                int var = varOf(n);
+                if (var >= 0)
+                    written[var] = stamp;
+                break;
+            }
+            default:
+                break;
+            }
+            entries.push_back(e);
+            stack.push_back((uint32_t) entries.size() - 1);
+        };
+        stamp++;
+        push(loop, nullptr, 0, IR_NONE);
+        vector<size_t> next{0};
+        while (!stack.empty()) {
+            uint32_t top = stack.back();
+            ArenaList<Node*> &c = entries[top].node->getChildren();
+            size_t &i = next.back();
+            if (i < c.size()) {
+                Node *child = c[i];
+                uint32_t index = (uint32_t) i++;
+                push(child, entries[top].node, index, top);
+                next.push_back(0);
+                continue;
+            }
+            entries[top].end = (uint32_t) entries.size();
+            stack.pop_back();
+            next.pop_back();
+        }
+        // agora que as escritas do laco todo sao conhecidas
+        for (Entry &e : entries) {
+            if (e.node->getKind() != NK_IDENT)
+                continue;
+            int var = varOf(e.node);
+            if (var >= 0 && written[var] != stamp) {
+                e.invariant = true;
+                ValueType t = fn.vars[var].type;
+                e.type = t == VT_INT || t == VT_FLOAT ? t : NOT_NUMERIC;
+            }
+        }
+        // filhos antes dos pais
+        for (size_t k = entries.size(); k-- > 1;) {
+            Entry &e = entries[k];
+            if (isOperation(e.node)) {
+                Node *n = e.node;
+                char op = n->getKind() == NK_BINARYOP ? static_cast<BinaryOp*>(n)->getOperation() : '-';
+                Node *divisor = n->getKind() == NK_BINARYOP ? n->getChildren()[1] : nullptr;
+                if (e.type == VT_INT && (op == '/' || op == '%')
+                    && (divisor->getKind() != NK_INTEGER || static_cast<Integer*>(divisor)->getValue() == 0))
+                    e.invariant = false;
+            }
+            Entry &p = entries[e.parentEntry];
+            if (!isOperation(p.node))
+                continue;
+            p.reads |= e.reads;
+            if (!e.invariant || e.type == NOT_NUMERIC) {
+                p.invariant = false;
+                p.type = NOT_NUMERIC;
+            } else if (p.type != NOT_NUMERIC && e.type == VT_FLOAT) {
+                p.type = VT_FLOAT;
+            }
+        }
+    }
+
+    Node *hoist(Entry &e) {
+        uint32_t slot = program->getFrameSize();
+        program->setFrameSize(slot + 1);
+        string name = "inv." + to_string(hoisted++);
+        Atom atom = atoms.intern(name.data(), name.size());
+        int line = e.node->getLineNo();
+
+        Variable *decl = new Variable(new TypeDec(type_names[e.type]), atom, e.node);
+        decl->setSlot(slot);
+        decl->setLineNo(line);
+        Ident *use = new Ident(atom);
+        use->setSlot(slot);
+        use->setLineNo(line);
+        e.parent->setChild(e.index, use);
+
+        // a variavel nova nunca e escrita dentro de laco nenhum
+        fn.vars.push_back({atom, (ValueType) e.type});
+        written.push_back(0);
+        vars[use] = (uint32_t) fn.vars.size() - 1;
+        return decl;
+    }
+
+    // Declaracoes que vao para antes do laco, na ordem em que aparecem.
+    void process(Node *loop, vector<Node*> &decls) {
+        collect(loop);
+        for (size_t k = 1; k < entries.size();) {
+            Entry &e = entries[k];
+            // o valor inicial e o Pass rodam uma vez por volta do laco de fora
+            if (e.parent == loop && (e.index == 0 || e.index == 2)) {
+                k = e.end;
+                continue;
+            }
+            if (isOperation(e.node) && e.invariant && e.type != NOT_NUMERIC && e.reads) {
+                decls.push_back(hoist(e));
+                k = e.end;
+                continue;
+            }
+            k++;
+        }
+    }
+
+public:
+    LoopInvariantMotion(Program *p) : program(p), fn(CfgBuilder().build(p)) {
+        for (const IrSource &src : fn.sources)
+            vars[src.node] = src.var;
+        written.assign(fn.vars.size(), 0);
+    }
+
+    // Devolve quantas contas sairam de dentro de lacos.
+    size_t run() {
+        // de fora para dentro: o que nao varia no laco de fora sai de vez
+        vector<Node*> stack{program};
+        vector<Node*> items, decls;
+        while (!stack.empty()) {
+            Node *n = stack.back();
+            stack.pop_back();
+            ArenaList<Node*> &c = n->getChildren();
+            if (n->getKind() == NK_STMTS || n->getKind() == NK_BLOCK) {
+                items.clear();
+                bool changed = false;
+                for (Node *s : c) {
+                    if (s->getKind() == NK_LOOP) {
+                        decls.clear();
+                        process(s, decls);
+                        changed |= !decls.empty();
+                        items.insert(items.end(), decls.begin(), decls.end());
+                    }
+                    items.push_back(s);
+                }
+                if (changed) {
+                    c.truncate(0);
+                    for (Node *s : items)
+                        c.push_back(s);
+                }
+            }
+            for (Node *child : c)
+                stack.push_back(child);
+        }
+        return hoisted;
+    }
+};
+
+#endif
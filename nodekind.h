@@ -0,0 +1,57 @@
+#ifndef NODEKIND_H
+#define NODEKIND_H
+
+#include <cstdint>
+
+enum NodeKind : uint8_t {
+    NK_STMTS,
+    NK_BLOCK,
+    NK_PROGRAM,
+    NK_TYPEDEC,
+    NK_IDENT,
+    NK_INTEGER,
+    NK_FLOAT,
+    NK_BOOLEAN,
+    NK_STRING,
+    NK_TRUE,
+    NK_FALSE,
+    NK_VARIABLE,
+    NK_ATTRIBUTION,
+    NK_UNARY,
+    NK_BINARYOP,
+    NK_CONDITION,
+    NK_PASS,
+    NK_IF,
+    NK_IFELSE,
+    NK_LOOP,
+    NK_SCAN,
+    NK_PRINT,
+    NK_COUNT
+};
+
+// Nos que abrem um escopo: o syt inteiro (a variavel de controle e local
+// ao laco) e os corpos de lo/daor/syt.
+inline bool opens_scope(NodeKind k) {
+    return k == NK_BLOCK || k == NK_LOOP;
+}
+
+// Operadores de Condition e tipos de TypeDec, na ordem dos codigos
+// guardados no AST compacto.
+static const char *const condition_ops[] = {"<=", ">=", "==", "!=", "<", ">", "||", "&&"};
+static const char *const type_names[] = {"int", "float", "string", "bool"};
+
+inline uint32_t condition_op_code(const char *op) {
+    for (uint32_t i = 0; i < sizeof(condition_ops) / sizeof(*condition_ops); i++)
+        if (condition_ops[i][0] == op[0] && condition_ops[i][1] == op[1])
+            return i;
+    return 0;
+}
+
+inline uint32_t type_code(const char *t) {
+    for (uint32_t i = 0; i < sizeof(type_names) / sizeof(*type_names); i++)
+        if (type_names[i][0] == t[0])
+            return i;
+    return 0;
+}
+
+#endif
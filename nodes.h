@@ -1,27 +1,53 @@
+#ifndef NODES_H
+#define NODES_H
+
 #include <iostream>
 #include <vector>
 #include <map>
 #include <set>
 #include <stack> 
-
-extern int errorcount;
-extern int yylineno;
-extern char *build_file_name;
+#include <cstring>
+#include <type_traits>
+#include "atoms.h"
+#include "arena.h"
+#include "nodekind.h"
+#include "symtab.h"
+#include "diagnostics.h"
+#include "dot.h"
 
 using namespace std;
 
+// Todos os nos vivem na ast_arena e sao liberados juntos ao fim da
+// compilacao, sem destrutores: os campos precisam ser triviais.
 class Node {
+public:
+    // Slot de variavel ainda nao resolvido pelo CheckVarDecl.
+    static constexpr uint32_t NO_SLOT = 0xffffffffu;
+
 protected:
-    vector<Node*> children; 
+    ArenaList<Node*> children; 
     int lineno;
+    NodeKind kind = NK_STMTS;
 
 public:
-    Node() {
-        lineno = yylineno;
+    Node() {}
+    static void *operator new(size_t size) {
+        return ast_arena.alloc(size);
     }
+    static void operator delete(void *) {}
     int getLineNo() {
         return lineno;
     }
+    void setLineNo(int l) {
+        lineno = l;
+    }
+    NodeKind getKind() {
+        return kind;
+    }
+    // Lista de comandos que e corpo de lo/daor/syt (abre escopo).
+    void markBlock() {
+        kind = NK_BLOCK;
+    }
     virtual string toStr() {
         return "stmts";
     }
@@ -31,13 +57,34 @@ public:
     void append(Node *n) {
         children.push_back(n);
     }
-    vector<Node*>& getChildren() {
+    ArenaList<Node*>& getChildren() {
         return children;
     }
+    // As otimizacoes trocam subarvores por aqui; os getters dos filhos leem
+    // sempre de children.
+    void setChild(size_t i, Node *n) {
+        children[i] = n;
+    }
 };
 
 class Program : public Node {
+protected:
+    uint32_t frameSize = 0;
+
 public:
+    Program() {
+        kind = NK_PROGRAM;
+    }
+
+    // Quantos slots de variavel o programa usa ao mesmo tempo.
+    uint32_t getFrameSize() {
+        return frameSize;
+    }
+
+    void setFrameSize(uint32_t n) {
+        frameSize = n;
+    }
+
     virtual string toStr() override {
         return "Program";
     }
@@ -45,20 +92,24 @@ public:
 
 class TypeDec : public Node {
 protected:
-    string type; 
+    const char *type; 
 
 public:
-    TypeDec(string t){
+    TypeDec(const char *t){
+        kind = NK_TYPEDEC;
         type = t;
     }
+    const char *getType() {
+        return type;
+    }
     virtual string toStr() override{
-        if (type == "int") {
+        if (strcmp(type, "int") == 0) {
             return "int";
-        } else if (type == "float") {
+        } else if (strcmp(type, "float") == 0) {
             return "float";
-        } else if (type == "string") {
+        } else if (strcmp(type, "string") == 0) {
             return "string";
-        } else if (type == "bool") {
+        } else if (strcmp(type, "bool") == 0) {
             return "bool";
         } 
         else return "sem tipo";
@@ -67,19 +118,33 @@ public:
 
 class Ident : public Node{
 protected:
-    string name;
+    Atom name;
+    uint32_t slot = NO_SLOT;
 
 public:
-    Ident(const string n){
+    Ident(Atom n){
+        kind = NK_IDENT;
         name = n;
     }
 
-    const string getName(){
+    Atom getAtom(){
         return name;
     }
 
+    uint32_t getSlot() {
+        return slot;
+    }
+
+    void setSlot(uint32_t s) {
+        slot = s;
+    }
+
+    string_view getName(){
+        return atoms.name(name);
+    }
+
     virtual string toStr() override{
-        return name;
+        return atom_str(name);
     }
 };
 
@@ -89,9 +154,14 @@ protected:
 
 public:
     Integer(const int v) {
+        kind = NK_INTEGER;
         value = v;
     }
 
+    int getValue() {
+        return value;
+    }
+
     virtual string toStr() override {
         return to_string(value);
     }
@@ -103,9 +173,14 @@ protected:
 
 public:
     Float(const float v) {
+        kind = NK_FLOAT;
         value = v;
     }
 
+    float getValue() {
+        return value;
+    }
+
     virtual string toStr() override {
         return to_string(value);
     }
@@ -116,7 +191,9 @@ protected:
     bool value; 
 
 public:
-    Boolean(bool v) : value(v) {}
+    Boolean(bool v) : value(v) {
+        kind = NK_BOOLEAN;
+    }
 
     virtual string toStr() override {
         return value ? "true" : "false";
@@ -125,19 +202,20 @@ public:
 
 class String : public Node {
 protected:
-    string value; 
+    Atom value; 
 
 public:
-    String(const string v){
+    String(Atom v){
+        kind = NK_STRING;
         value = v;
     }
 
-    const string getValue(){
-        return value;
+    string_view getValue(){
+        return atoms.name(value);
     }
 
     virtual string toStr() override{
-        return value;
+        return atom_str(value);
     }
 };
 
@@ -145,7 +223,9 @@ class True: public Node{
 protected:
 
 public:
-    True(){}
+    True(){
+        kind = NK_TRUE;
+    }
 
     virtual string toStr() override{
         return "true";
@@ -160,7 +240,9 @@ class False: public Node{
 protected:
 
 public:
-    False(){}
+    False(){
+        kind = NK_FALSE;
+    }
 
     virtual string toStr() override{
         return "false";
@@ -175,30 +257,50 @@ class Variable : public Node
 {
 protected:
     TypeDec *type;
-    string name;
-    Node *value;
+    Atom name;
+    uint32_t slot = NO_SLOT;
 
 public:
-    Variable(TypeDec *t,const string n, Node *v)
+    Variable(TypeDec *t, Atom n, Node *v)
     {
+        kind = NK_VARIABLE;
         type = t;
         name = n;
-        value = v;
         children.push_back(t);
         children.push_back(v);
     }
 
-    const string getName(){
+    Atom getAtom(){
         return name;
     }
 
+    TypeDec *getType() {
+        return type;
+    }
+
+    Node *getValue() {
+        return children[1];
+    }
+
+    uint32_t getSlot() {
+        return slot;
+    }
+
+    void setSlot(uint32_t s) {
+        slot = s;
+    }
+
+    string_view getName(){
+        return atoms.name(name);
+    }
+
     virtual string toDebug() override{
-        return type->toStr() + name + "=" + value->toDebug();
+        return type->toStr() + atom_str(name) + "=" + getValue()->toDebug();
     }
 
     virtual string toStr() override
     {
-        return  name + "=";
+        return  atom_str(name) + "=";
     }
   
 };
@@ -206,28 +308,44 @@ public:
 class Attribution : public Node
 {
 protected:
-    string name;
-    Node *value;
+    Atom name;
+    uint32_t slot = NO_SLOT;
 
 public:
-    Attribution(const string n, Node *v)
+    Attribution(Atom n, Node *v)
     {
+        kind = NK_ATTRIBUTION;
         name = n;
-        value = v;
         children.push_back(v);
     }
 
-    const string getName(){
+    Atom getAtom(){
         return name;
     }
 
+    Node *getValue() {
+        return children[0];
+    }
+
+    uint32_t getSlot() {
+        return slot;
+    }
+
+    void setSlot(uint32_t s) {
+        slot = s;
+    }
+
+    string_view getName(){
+        return atoms.name(name);
+    }
+
     virtual string toStr() override
     {
-        return  name + "=";
+        return  atom_str(name) + "=";
     }
 
     virtual string toDebug() override{
-        return name + "=" + value->toDebug();
+        return atom_str(name) + "=" + getValue()->toDebug();
     }
 };
 
@@ -238,11 +356,16 @@ protected:
 
 public:
     Unary(Node *v, char op) {
+       kind = NK_UNARY;
        value = v;
        operation = op;
        children.push_back(v);
     }
 
+    char getOperation() {
+        return operation;
+    }
+
     virtual string toStr() override {
         string aux;
         aux.push_back(operation);
@@ -258,6 +381,7 @@ protected:
 
 public:
     BinaryOp(Node *v1, Node *v2, char op) {
+       kind = NK_BINARYOP;
        value1 = v1;
        value2 = v2;
        operation = op;
@@ -265,6 +389,10 @@ public:
        children.push_back(v2);
     }
 
+    char getOperation() {
+        return operation;
+    }
+
     virtual string toStr() override {
         string aux;
         aux.push_back(operation);
@@ -276,10 +404,11 @@ class Condition : public Node {
 protected:
     Node *value1; 
     Node *value2; 
-    string operation; 
+    const char *operation; 
 
 public:
-    Condition(Node *v1, Node *v2, string op){
+    Condition(Node *v1, Node *v2, const char *op){
+        kind = NK_CONDITION;
         value1 = v1;
         value2 = v2;
         operation = op;
@@ -287,26 +416,49 @@ public:
         children.push_back(v2);
     }
 
+    const char *getOperation() {
+        return operation;
+    }
+
     virtual string toStr() override{   
         return operation ;
     }
 
     virtual string toDebug() override{
-        return value1->toDebug() + operation + value2->toDebug(); 
+        return children[0]->toDebug() + operation + children[1]->toDebug();
     }
 };
 
 
 class Pass : public Node {
 protected:
-    string ident; 
-    string operation; 
+    Atom ident; 
+    const char *operation; 
+    uint32_t slot = NO_SLOT;
 
 public:
-    Pass(string id, string op) : ident(id), operation(op) {}
+    Pass(Atom id, const char *op) : ident(id), operation(op) {
+        kind = NK_PASS;
+    }
+
+    Atom getAtom() {
+        return ident;
+    }
+
+    uint32_t getSlot() {
+        return slot;
+    }
+
+    void setSlot(uint32_t s) {
+        slot = s;
+    }
+
+    const char *getOperation() {
+        return operation;
+    }
 
     virtual string toStr() override {
-        return ident + operation;
+        return atom_str(ident) + operation;
     }
 };
 
@@ -317,6 +469,8 @@ private:
 
 public:
     If(Node *cond, Node *b) : condition(cond), body(b) {
+        kind = NK_IF;
+        b->markBlock();
         children.push_back(cond);
         children.push_back(b);
     }
@@ -334,6 +488,9 @@ private:
 
 public:
     IfElse(Node *cond, Node *ifb, Node *elseb) : condition(cond), if_body(ifb), else_body(elseb) {
+        kind = NK_IFELSE;
+        ifb->markBlock();
+        elseb->markBlock();
         children.push_back(cond);
         children.push_back(ifb);
         children.push_back(elseb);
@@ -353,6 +510,8 @@ private:
 
 public:
     Loop(Node *decl, Node *cond, Node *pass, Node *globals) : declaration(decl), condition(cond), postLoop(pass), body(globals) {
+        kind = NK_LOOP;
+        globals->markBlock();
         children.push_back(decl);
         children.push_back(cond);
         children.push_back(pass);
@@ -368,8 +527,11 @@ class Scan : public Node {
 protected:
     Node *typeNode = NULL; 
 public:
-    Scan() {}
+    Scan() {
+        kind = NK_SCAN;
+    }
     Scan(Node *t) : typeNode(t) {
+        kind = NK_SCAN;
         children.push_back(t);
     }
 
@@ -396,6 +558,7 @@ protected:
 
 public:
     Print(Node *v) : value(v) {
+        kind = NK_PRINT;
         children.push_back(v);
     }
 
@@ -404,128 +567,358 @@ public:
     }
 
     virtual string toDebug() override {
-        return "print(" + value->toDebug() + ")";
+        return "print(" + children[0]->toDebug() + ")";
     }
 };
 
 
-class CheckVarDecl {
-private:
-    set<string> symbols;
-public:
-    CheckVarDecl() {}
+static_assert(is_trivially_destructible<Program>::value && is_trivially_destructible<TypeDec>::value
+              && is_trivially_destructible<Ident>::value && is_trivially_destructible<Integer>::value
+              && is_trivially_destructible<Float>::value && is_trivially_destructible<Boolean>::value
+              && is_trivially_destructible<String>::value && is_trivially_destructible<True>::value
+              && is_trivially_destructible<False>::value && is_trivially_destructible<Variable>::value
+              && is_trivially_destructible<Attribution>::value && is_trivially_destructible<Unary>::value
+              && is_trivially_destructible<BinaryOp>::value && is_trivially_destructible<Condition>::value
+              && is_trivially_destructible<Pass>::value && is_trivially_destructible<If>::value
+              && is_trivially_destructible<IfElse>::value && is_trivially_destructible<Loop>::value
+              && is_trivially_destructible<Scan>::value && is_trivially_destructible<Print>::value,
+              "AST nodes are released in bulk by ast_arena and must not need destructors");
+
+// Visitante CRTP: walk() desce pela arvore chamando enter() na ida e o
+// visitX() do tipo do no na volta (pos-ordem), com dispatch por switch no
+// kind. A classe derivada so redefine os metodos que lhe interessam.
+// Os primeiros MAX_NATIVE_DEPTH niveis descem por recursao (o caso comum e
+// o mais rapido); subarvores mais fundas que isso, como a + a + ... + a,
+// seguem com pilha explicita, entao a pilha nativa usada e limitada.
+template <typename Derived>
+class Visitor {
+protected:
+    static const int MAX_NATIVE_DEPTH = 256;
 
-    void check(Node *noh) {
-        for(Node *c : noh->getChildren()) {
-            check(c);
-        }
+    Derived &self() {
+        return *static_cast<Derived*>(this);
+    }
 
-        Ident *id = dynamic_cast<Ident*>(noh);
-        if (id) {
-            if (symbols.count(id->getName()) <= 0) {
-                cout << build_file_name
-                     << ":"
-                     << id->getLineNo()
-                     << ":0: semantic error: " 
-                     << id->getName()
-                     << " undefined."
-                     << endl;
-                errorcount++;
+    void walkAt(Node *n, int depth) {
+        if (self().done())
+            return;
+        if (depth == MAX_NATIVE_DEPTH) {
+            walkIterative(n);
+            return;
+        }
+        self().enter(n);
+        for (Node *c : n->getChildren()) {
+            walkAt(c, depth + 1);
+        }
+        self().dispatch(n);
+    }
+
+    void walkIterative(Node *root) {
+        struct Frame {
+            Node *node;
+            Node **next;
+            Node **end;
+        };
+        vector<Frame> stack(64);
+        size_t top = 0;
+
+        self().enter(root);
+        stack[0] = {root, root->getChildren().begin(), root->getChildren().end()};
+        while (!self().done()) {
+            Frame &f = stack[top];
+            if (f.next != f.end) {
+                Node *c = *f.next++;
+                self().enter(c);
+                if (c->getChildren().empty()) {
+                    // folha: visita direto, sem empilhar
+                    self().dispatch(c);
+                    continue;
+                }
+                if (++top == stack.size())
+                    stack.resize(stack.size() * 2);
+                stack[top] = {c, c->getChildren().begin(), c->getChildren().end()};
+            } else {
+                self().dispatch(f.node);
+                if (top-- == 0)
+                    break;
             }
         }
+    }
 
-        Variable *var = dynamic_cast<Variable*>(noh);
-        if (var) {
-            symbols.insert(var->getName());
+public:
+    // Quando devolve true a travessia para (por exemplo, --max-errors).
+    bool done() {
+        return false;
+    }
+
+    void enter(Node *) {}
+    void visitStmts(Node *) {}
+    void visitBlock(Node *) {}
+    void visitProgram(Program *) {}
+    void visitTypeDec(TypeDec *) {}
+    void visitIdent(Ident *) {}
+    void visitInteger(Integer *) {}
+    void visitFloat(Float *) {}
+    void visitBoolean(Boolean *) {}
+    void visitString(String *) {}
+    void visitTrue(True *) {}
+    void visitFalse(False *) {}
+    void visitVariable(Variable *) {}
+    void visitAttribution(Attribution *) {}
+    void visitUnary(Unary *) {}
+    void visitBinaryOp(BinaryOp *) {}
+    void visitCondition(Condition *) {}
+    void visitPass(Pass *) {}
+    void visitIf(If *) {}
+    void visitIfElse(IfElse *) {}
+    void visitLoop(Loop *) {}
+    void visitScan(Scan *) {}
+    void visitPrint(Print *) {}
+
+    void dispatch(Node *n) {
+        switch (n->getKind()) {
+        case NK_STMTS: self().visitStmts(n); break;
+        case NK_BLOCK: self().visitBlock(n); break;
+        case NK_PROGRAM: self().visitProgram(static_cast<Program*>(n)); break;
+        case NK_TYPEDEC: self().visitTypeDec(static_cast<TypeDec*>(n)); break;
+        case NK_IDENT: self().visitIdent(static_cast<Ident*>(n)); break;
+        case NK_INTEGER: self().visitInteger(static_cast<Integer*>(n)); break;
+        case NK_FLOAT: self().visitFloat(static_cast<Float*>(n)); break;
+        case NK_BOOLEAN: self().visitBoolean(static_cast<Boolean*>(n)); break;
+        case NK_STRING: self().visitString(static_cast<String*>(n)); break;
+        case NK_TRUE: self().visitTrue(static_cast<True*>(n)); break;
+        case NK_FALSE: self().visitFalse(static_cast<False*>(n)); break;
+        case NK_VARIABLE: self().visitVariable(static_cast<Variable*>(n)); break;
+        case NK_ATTRIBUTION: self().visitAttribution(static_cast<Attribution*>(n)); break;
+        case NK_UNARY: self().visitUnary(static_cast<Unary*>(n)); break;
+        case NK_BINARYOP: self().visitBinaryOp(static_cast<BinaryOp*>(n)); break;
+        case NK_CONDITION: self().visitCondition(static_cast<Condition*>(n)); break;
+        case NK_PASS: self().visitPass(static_cast<Pass*>(n)); break;
+        case NK_IF: self().visitIf(static_cast<If*>(n)); break;
+        case NK_IFELSE: self().visitIfElse(static_cast<IfElse*>(n)); break;
+        case NK_LOOP: self().visitLoop(static_cast<Loop*>(n)); break;
+        case NK_SCAN: self().visitScan(static_cast<Scan*>(n)); break;
+        case NK_PRINT: self().visitPrint(static_cast<Print*>(n)); break;
+        default: break;
         }
     }
+
+    void walk(Node *root) {
+        walkAt(root, 0);
+    }
 };
 
-class CheckVarMix {
+// Alem de apontar nomes nao declarados, resolve cada uso de variavel
+// (Ident, Attribution, Pass) para o slot da sua declaracao. Os slots
+// seguem os escopos como uma pilha: ao fechar um escopo os dele voltam
+// a ficar livres, e o Program guarda quantos foram usados no maximo.
+class CheckVarDecl : public Visitor<CheckVarDecl> {
 private:
+    DiagnosticEngine &diagnostics;
+    SymbolTable symbols;
+    vector<uint32_t> slotMarks;
+    uint32_t nextSlot = 0;
+    uint32_t frameSize = 0;
+
+    uint32_t slotOf(Atom name) {
+        Symbol *sym = symbols.lookup(name);
+        return sym != nullptr ? sym->slot : Node::NO_SLOT;
+    }
+
+    void popScope() {
+        symbols.pop();
+        nextSlot = slotMarks.back();
+        slotMarks.pop_back();
+    }
+
 public:
-    CheckVarMix() {}
+    CheckVarDecl(DiagnosticEngine &d) : diagnostics(d) {}
 
     void check(Node *noh) {
-        for(Node *c : noh->getChildren()) {
-            check(c);
+        walk(noh);
+    }
+
+    bool done() {
+        return diagnostics.limitReached();
+    }
+
+    void enter(Node *n) {
+        if (opens_scope(n->getKind())) {
+            symbols.push();
+            slotMarks.push_back(nextSlot);
         }
+    }
+
+    void visitBlock(Node *) {
+        popScope();
+    }
 
-        BinaryOp *bo = dynamic_cast<BinaryOp*>(noh);
-        if (bo) {
-           Integer *i0 = dynamic_cast<Integer*>(noh->getChildren()[0]);
-           Integer *i1 = dynamic_cast<Integer*>(noh->getChildren()[1]);
-           if((i0 == NULL && i1 != NULL) || (i0 !=  NULL && i1 == NULL)){
-            cout << build_file_name
-                << ":"
-                << bo->getLineNo()
-                << ":0: semantic error: " 
-                << " tipo mesclado proibido."
-                << endl;
-                errorcount++;
-           } 
+    void visitLoop(Loop *) {
+        popScope();
+    }
+
+    void visitProgram(Program *p) {
+        p->setFrameSize(frameSize);
+    }
+
+    void visitIdent(Ident *id) {
+        Symbol *sym = symbols.lookup(id->getAtom());
+        if (sym == nullptr) {
+            diagnostics.error(id->getLineNo(), id->getName(), " undefined.");
+        } else {
+            id->setSlot(sym->slot);
         }
     }
+
+    void visitAttribution(Attribution *a) {
+        a->setSlot(slotOf(a->getAtom()));
+    }
+
+    void visitPass(Pass *p) {
+        p->setSlot(slotOf(p->getAtom()));
+    }
+
+    void visitVariable(Variable *var) {
+        uint32_t slot = nextSlot++;
+        frameSize = max(frameSize, nextSlot);
+        var->setSlot(slot);
+        symbols.declare(var->getAtom(), var->getLineNo(), slot);
+    }
 };
 
-class CheckDuplicateVariable {
+class CheckVarMix : public Visitor<CheckVarMix> {
 private:
-    map<string, set<string>> scopeSymbols;
-
+    DiagnosticEngine &diagnostics;
 public:
-    CheckDuplicateVariable() {}
+    CheckVarMix(DiagnosticEngine &d) : diagnostics(d) {}
 
-    void check(Node *noh, string scope) {
-        for (Node *c : noh->getChildren()) {
-            check(c, scope);
-        }
+    void check(Node *noh) {
+        walk(noh);
+    }
 
-        Variable *var = dynamic_cast<Variable*>(noh);
-        if (var) {
-            if (scopeSymbols[scope].count(var->getName()) > 0) {
-                cout << build_file_name
-                     << ":"
-                     << var->getLineNo()
-                     << ":0: semantic error: "
-                     << "variável duplicada: " 
-                     << var->getName()
-                     << endl;
-                errorcount++;
-            } else {
-                scopeSymbols[scope].insert(var->getName());
-            }
+    bool done() {
+        return diagnostics.limitReached();
+    }
+
+    void visitBinaryOp(BinaryOp *bo) {
+        bool i0 = bo->getChildren()[0]->getKind() == NK_INTEGER;
+        bool i1 = bo->getChildren()[1]->getKind() == NK_INTEGER;
+        if (i0 != i1) {
+            diagnostics.error(bo->getLineNo(), " tipo mesclado proibido.");
         }
     }
 };
 
+class CheckDuplicateVariable : public Visitor<CheckDuplicateVariable> {
+private:
+    DiagnosticEngine &diagnostics;
+    SymbolTable symbols;
 
+public:
+    CheckDuplicateVariable(DiagnosticEngine &d) : diagnostics(d) {}
 
-void printf_tree_recursive(Node *noh) {
-    if (noh == nullptr) {
-        cout << "Node is null" << endl;
-        return;
+    void check(Node *noh) {
+        walk(noh);
+    }
+
+    bool done() {
+        return diagnostics.limitReached();
+    }
+
+    void enter(Node *n) {
+        if (opens_scope(n->getKind()))
+            symbols.push();
     }
-    for (Node *c : noh->getChildren()) {
-        printf_tree_recursive(c);
+
+    void visitBlock(Node *) {
+        symbols.pop();
     }
-    cout << "N" << (long int)noh << "[label=\"" <<
-        noh->toStr() << "\"];" << endl;
 
-    for (Node *c : noh->getChildren()) {
-        if (c != nullptr) {
-            cout << "N" << (long int)noh << "--" <<
-                "N" << (long int)c << ";" << endl;
+    void visitLoop(Loop *) {
+        symbols.pop();
+    }
+
+    void visitVariable(Variable *var) {
+        if (symbols.declaredHere(var->getAtom())) {
+            diagnostics.error(var->getLineNo(), "variável duplicada: ", var->getName());
+        } else {
+            symbols.declare(var->getAtom(), var->getLineNo());
         }
     }
+};
+
+
+
+// Escreve o rotulo do no direto no DotWriter, sem montar uma string.
+inline void dot_label(DotWriter &out, Node *noh) {
+    switch (noh->getKind()) {
+    case NK_STMTS:
+    case NK_BLOCK: out.label("stmts"); break;
+    case NK_PROGRAM: out.label("Program"); break;
+    case NK_IDENT: out.label(static_cast<Ident*>(noh)->getName()); break;
+    case NK_STRING: out.label(static_cast<String*>(noh)->getValue()); break;
+    case NK_INTEGER: out.label(static_cast<Integer*>(noh)->getValue()); break;
+    case NK_FLOAT: out.label(static_cast<Float*>(noh)->getValue()); break;
+    case NK_TRUE: out.label("true"); break;
+    case NK_FALSE: out.label("false"); break;
+    case NK_VARIABLE:
+        out.label(static_cast<Variable*>(noh)->getName());
+        out.label('=');
+        break;
+    case NK_ATTRIBUTION:
+        out.label(static_cast<Attribution*>(noh)->getName());
+        out.label('=');
+        break;
+    case NK_UNARY: out.label(static_cast<Unary*>(noh)->getOperation()); break;
+    case NK_BINARYOP: out.label(static_cast<BinaryOp*>(noh)->getOperation()); break;
+    case NK_CONDITION: out.label(static_cast<Condition*>(noh)->getOperation()); break;
+    case NK_PASS:
+        out.label(atoms.name(static_cast<Pass*>(noh)->getAtom()));
+        out.label(static_cast<Pass*>(noh)->getOperation());
+        break;
+    case NK_IF: out.label("if"); break;
+    case NK_IFELSE: out.label("if-else"); break;
+    case NK_LOOP: out.label("loop"); break;
+    case NK_PRINT: out.label("print"); break;
+    default: out.label(noh->toStr()); break;
+    }
 }
 
-void printf_tree(Node *root) {
+// Os ids dos nos sao sequenciais na ordem de visita (pos-ordem), entao a
+// saida e a mesma a cada execucao e igual a do AST compacto.
+class TreePrinter : public Visitor<TreePrinter> {
+private:
+    DotWriter &out;
+    vector<uint32_t> ids; // ids dos filhos ja visitados e ainda sem pai
+    uint32_t next = 0;
+
+public:
+    TreePrinter(DotWriter &w) : out(w) {}
+
+    void dispatch(Node *noh) {
+        uint32_t id = next++;
+        out.nodeStart(id);
+        dot_label(out, noh);
+        out.nodeEnd();
+
+        size_t first = ids.size() - noh->getChildren().size();
+        for (size_t i = first; i < ids.size(); i++)
+            out.edge(id, ids[i]);
+        ids.resize(first);
+        ids.push_back(id);
+    }
+};
+
+inline void printf_tree(Node *root, FILE *f = stdout) {
     if (root == nullptr) {
         cout << "Root is null" << endl;
         return;
     }
-    cout << "graph {" << endl;
-    printf_tree_recursive(root);
-    cout << "}" << endl;
+    DotWriter out(f);
+    out.begin();
+    TreePrinter printer(out);
+    printer.walk(root);
+    out.end();
 }
 
+#endif
@@ -0,0 +1,192 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <memory>
+#include <tuple>
+#include "nodes.h"
+#include "flat_ast.h"
+#include "fold.h"
+#include "deadbranch.h"
+#include "sccp.h"
+#include "licm.h"
+#include "induction.h"
+
+// Junta varios visitantes numa travessia so: cada no passa por todos eles,
+// na ordem dada, antes de seguir para o proximo. So serve para checagens
+// compativeis, isto e, que nao dependem de outra ter terminado a arvore toda.
+template <typename... Checks>
+class FusedChecks : public Visitor<FusedChecks<Checks...>> {
+private:
+    tuple<Checks&...> checks;
+
+public:
+    FusedChecks(Checks&... c) : checks(c...) {}
+
+    void enter(Node *n) {
+        apply([n](Checks&... c) { (c.enter(n), ...); }, checks);
+    }
+
+    void dispatch(Node *n) {
+        apply([n](Checks&... c) { (c.dispatch(n), ...); }, checks);
+    }
+
+    bool done() {
+        return apply([](Checks&... c) { return (c.done() || ...); }, checks);
+    }
+};
+
+template <typename... Checks>
+void flat_fused_check(const FlatAst &ast, uint32_t root, Checks&... checks) {
+    ast.walk(root,
+             [&](uint32_t n) { (checks.enter(ast, n), ...); },
+             [&](uint32_t n) { (checks.visit(ast, n), ...); },
+             [&] { return (checks.done() || ...); });
+}
+
+// Roda as checagens semanticas do programa, cada uma na sua travessia
+// (como antes) ou todas fundidas numa travessia unica.
+class PassManager {
+private:
+    DiagnosticEngine &diagnostics;
+    bool fused;
+    bool compact;
+
+    // Fecha o lote de erros da passada; false se --max-errors estourou.
+    bool report() {
+        diagnostics.flush();
+        diagnostics.note("erros: ", diagnostics.count());
+        return !diagnostics.limitReached();
+    }
+
+    void fold(NodeRef program, FlatAst &flat) {
+        diagnostics.note("Folding constants...");
+        size_t removed;
+        if (compact) {
+            FlatConstantFolder folder(flat);
+            removed = folder.fold(program.id);
+        } else {
+            ConstantFolder folder;
+            removed = folder.fold(program.node);
+        }
+        diagnostics.note("nós removidos: ", removed);
+    }
+
+    unique_ptr<ConstantPropagation> propagate(Program *tree, NodeRef program, FlatAst &flat) {
+        diagnostics.note("Propagating constants...");
+        auto propagation = make_unique<ConstantPropagation>(tree);
+        size_t replaced = propagation->rewrite(tree);
+        diagnostics.note("usos propagados: ", replaced);
+        if (replaced > 0)
+            fold(program, flat);
+        return propagation;
+    }
+
+    void runSeparate(Node *program) {
+        diagnostics.note("Checking variable declarations...");
+        CheckVarDecl cvd(diagnostics);
+        cvd.check(program);
+        if (!report())
+            return;
+
+        diagnostics.note("Checking type mix declarations...");
+        CheckVarMix cvm(diagnostics);
+        cvm.check(program);
+        if (!report())
+            return;
+
+        diagnostics.note("Checking duplicate variable declarations...");
+        CheckDuplicateVariable cdv(diagnostics);
+        cdv.check(program);
+        report();
+    }
+
+    void runSeparate(const FlatAst &ast, uint32_t program) {
+        diagnostics.note("Checking variable declarations...");
+        FlatCheckVarDecl cvd(diagnostics);
+        cvd.check(ast, program);
+        if (!report())
+            return;
+
+        diagnostics.note("Checking type mix declarations...");
+        FlatCheckVarMix cvm(diagnostics);
+        cvm.check(ast, program);
+        if (!report())
+            return;
+
+        diagnostics.note("Checking duplicate variable declarations...");
+        FlatCheckDuplicateVariable cdv(diagnostics);
+        cdv.check(ast, program);
+        report();
+    }
+
+public:
+    PassManager(DiagnosticEngine &d, bool fused, bool compact)
+        : diagnostics(d), fused(fused), compact(compact) {}
+
+    void run(NodeRef program, const FlatAst &flat) {
+        if (!fused) {
+            if (compact)
+                runSeparate(flat, program.id);
+            else
+                runSeparate(program.node);
+            return;
+        }
+
+        diagnostics.note("Checking variable declarations, type mix and duplicate variables...");
+        if (compact) {
+            FlatCheckVarDecl cvd(diagnostics);
+            FlatCheckVarMix cvm(diagnostics);
+            FlatCheckDuplicateVariable cdv(diagnostics);
+            flat_fused_check(flat, program.id, cvd, cvm, cdv);
+        } else {
+            CheckVarDecl cvd(diagnostics);
+            CheckVarMix cvm(diagnostics);
+            CheckDuplicateVariable cdv(diagnostics);
+            FusedChecks<CheckVarDecl, CheckVarMix, CheckDuplicateVariable> all(cvd, cvm, cdv);
+            all.walk(program.node);
+        }
+        report();
+    }
+
+    // Otimizacoes (-O) sobre a arvore ja checada e sem erros.
+    void optimize(NodeRef program, FlatAst &flat) {
+        fold(program, flat);
+
+        // a propagacao precisa dos slots, que so a arvore de ponteiros tem
+        Program *tree = compact ? nullptr : static_cast<Program*>(program.node);
+        unique_ptr<ConstantPropagation> propagation;
+        if (tree != nullptr) {
+            propagation = propagate(tree, program, flat);
+
+            // as somas fechadas podem ter virado constantes para propagar
+            diagnostics.note("Closing counted loops...");
+            size_t closed = InductionVariables(tree).run(tree);
+            diagnostics.note("laços fechados: ", closed);
+            if (closed > 0) {
+                fold(program, flat);
+                propagation = propagate(tree, program, flat);
+            }
+        }
+
+        diagnostics.note("Removing dead branches...");
+        size_t removed;
+        if (compact) {
+            FlatDeadBranches branches(flat);
+            removed = branches.run(program.id);
+        } else {
+            DeadBranches branches;
+            removed = branches.run(program.node);
+        }
+        diagnostics.note("nós removidos: ", removed);
+
+        if (propagation != nullptr) {
+            diagnostics.note("Removing dead stores...");
+            diagnostics.note("nós removidos: ", propagation->removeDeadStores(tree));
+
+            diagnostics.note("Hoisting loop invariants...");
+            diagnostics.note("expressões movidas: ", LoopInvariantMotion(tree).run());
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,447 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ssa.h"
+#include "fold.h"
+
+using namespace std;
+
+// Propagacao de constantes esparsa e condicional (Wegman e Zadeck) sobre o
+// SSA: cada valor comeca indefinido (TOP) e so desce na reticulado, e uma
+// aresta so conta depois que o br do seu bloco pode toma-la, entao um ramo
+// que nunca executa nao estraga os phis do ponto de juncao. pikibagon, e
+// tudo que depende dele, fica BOTTOM.
+
+enum LatticeState : uint8_t {
+    LAT_TOP,
+    LAT_CONST,
+    LAT_BOTTOM
+};
+
+struct Lattice {
+    LatticeState state = LAT_TOP;
+    Value k{};
+};
+
+inline bool same_value(const Value &a, const Value &b) {
+    if (a.type != b.type)
+        return false;
+    switch (a.type) {
+    case VT_INT: return a.i == b.i;
+    case VT_FLOAT: return memcmp(&a.f, &b.f, sizeof a.f) == 0;
+    case VT_BOOL: return a.b == b.b;
+    case VT_STRING: return a.str() == b.str();
+    }
+    return false;
+}
+
+// Resultado de uma instrucao com operandos constantes, com a mesma conta do
+// interpretador; false se ela daria erro ao executar (divisao por zero).
+inline bool ir_evaluate(const IrInstr &in, const Value &a, const Value &b, Value &r) {
+    switch (in.op) {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MOD:
+        if (in.type == VT_INT) {
+            unsigned x = (unsigned) a.i, y = (unsigned) b.i;
+            switch (in.op) {
+            case IR_ADD: r = Value::ofInt((int) (x + y)); return true;
+            case IR_SUB: r = Value::ofInt((int) (x - y)); return true;
+            case IR_MUL: r = Value::ofInt((int) (x * y)); return true;
+            default:
+                if (b.i == 0)
+                    return false;
+                if (b.i == -1)
+                    r = Value::ofInt(in.op == IR_DIV ? (int) (0u - x) : 0);
+                else
+                    r = Value::ofInt(in.op == IR_DIV ? a.i / b.i : a.i % b.i);
+                return true;
+            }
+        }
+        switch (in.op) {
+        case IR_ADD: r = Value::ofFloat(a.f + b.f); break;
+        case IR_SUB: r = Value::ofFloat(a.f - b.f); break;
+        case IR_MUL: r = Value::ofFloat(a.f * b.f); break;
+        case IR_DIV: r = Value::ofFloat(a.f / b.f); break;
+        default: r = Value::ofFloat(fmod(a.f, b.f)); break;
+        }
+        return true;
+    case IR_NEG:
+        r = in.type == VT_INT ? Value::ofInt((int) (0u - (unsigned) a.i)) : Value::ofFloat(-a.f);
+        return true;
+    case IR_I2F:
+    case IR_F2I:
+        r = a;
+        return convert_value(r, in.type);
+    case IR_CMP: {
+        int c;
+        if (!three_way(a, b, c))
+            return false;
+        r = Value::ofBool(compare_result(in.cmp, c));
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+class Sccp {
+private:
+    const IrFunction &fn;
+    vector<Lattice> values;
+    vector<vector<char>> edges;     // edges[b][j]: a aresta preds[j] -> b executa
+    vector<char> reached;
+    // usuarios de cada valor v em useList[useStart[v]..useStart[v + 1]):
+    // instrucoes, e blocos cujo br testa v marcados com USE_BLOCK
+    static constexpr uint32_t USE_BLOCK = 0x80000000u;
+    vector<uint32_t> useStart;
+    vector<uint32_t> useList;
+    vector<pair<uint32_t, uint32_t>> cfgWork;
+    vector<uint32_t> ssaWork;
+
+    void lower(uint32_t v, Lattice l) {
+        Lattice &cur = values[v];
+        if (cur.state == LAT_BOTTOM || l.state == LAT_TOP)
+            return;
+        if (cur.state == LAT_CONST && l.state == LAT_CONST && same_value(cur.k, l.k))
+            return;
+        if (cur.state == LAT_CONST)
+            l.state = LAT_BOTTOM;
+        cur = l;
+        ssaWork.push_back(v);
+    }
+
+    static Lattice constant(Value k) {
+        Lattice l;
+        l.state = LAT_CONST;
+        l.k = k;
+        return l;
+    }
+
+    static Lattice bottom() {
+        Lattice l;
+        l.state = LAT_BOTTOM;
+        return l;
+    }
+
+    void visitPhi(uint32_t id) {
+        const IrInstr &in = fn.instrs[id];
+        Lattice r;
+        for (size_t j = 0; j < in.args.size(); j++) {
+            if (!edges[in.block][j])
+                continue;
+            const Lattice &a = values[in.args[j]];
+            if (a.state == LAT_BOTTOM)
+                return lower(id, bottom());
+            if (a.state == LAT_TOP)
+                continue;
+            if (r.state == LAT_TOP)
+                r = a;
+            else if (!same_value(r.k, a.k))
+                return lower(id, bottom());
+        }
+        lower(id, r);
+    }
+
+    void visit(uint32_t id) {
+        const IrInstr &in = fn.instrs[id];
+        switch (in.op) {
+        case IR_PHI:
+            visitPhi(id);
+            return;
+        case IR_CONST:
+            lower(id, constant(in.k));
+            return;
+        case IR_SCAN:
+        case IR_UNDEF:
+            lower(id, bottom());
+            return;
+        case IR_PRINT:
+            return;
+        default:
+            break;
+        }
+        const Lattice &a = values[in.a];
+        const Lattice &b = in.b != IR_NONE ? values[in.b] : a;
+        if (a.state == LAT_BOTTOM || b.state == LAT_BOTTOM) {
+            lower(id, bottom());
+            return;
+        }
+        if (a.state == LAT_TOP || b.state == LAT_TOP)
+            return;
+        Value r;
+        lower(id, ir_evaluate(in, a.k, b.k, r) ? constant(r) : bottom());
+    }
+
+    void visitTerm(uint32_t b) {
+        const IrBlock &blk = fn.blocks[b];
+        if (blk.term == TERM_JMP) {
+            cfgWork.push_back({b, blk.succ[0]});
+        } else if (blk.term == TERM_BR) {
+            const Lattice &c = values[blk.cond];
+            if (c.state == LAT_BOTTOM) {
+                cfgWork.push_back({b, blk.succ[0]});
+                cfgWork.push_back({b, blk.succ[1]});
+            } else if (c.state == LAT_CONST) {
+                cfgWork.push_back({b, blk.succ[c.k.b ? 0 : 1]});
+            }
+        }
+    }
+
+    void visitBlock(uint32_t b) {
+        for (uint32_t id : fn.blocks[b].code)
+            visit(id);
+        visitTerm(b);
+    }
+
+    // Chama f(v, usuario) para cada uso.
+    template <typename F>
+    void eachUse(F f) {
+        for (uint32_t b = 0; b < fn.blocks.size(); b++) {
+            for (uint32_t id : fn.blocks[b].code) {
+                const IrInstr &in = fn.instrs[id];
+                if (in.a != IR_NONE)
+                    f(in.a, id);
+                if (in.b != IR_NONE)
+                    f(in.b, id);
+                for (uint32_t v : in.args)
+                    f(v, id);
+            }
+            if (fn.blocks[b].term == TERM_BR)
+                f(fn.blocks[b].cond, b | USE_BLOCK);
+        }
+    }
+
+public:
+    Sccp(const IrFunction &f) : fn(f) {}
+
+    void run() {
+        size_t n = fn.blocks.size();
+        values.assign(fn.instrs.size(), Lattice{});
+        reached.assign(n, 0);
+        edges.resize(n);
+        for (size_t b = 0; b < n; b++)
+            edges[b].assign(fn.blocks[b].preds.size(), 0);
+        useStart.assign(fn.instrs.size() + 1, 0);
+        eachUse([&](uint32_t v, uint32_t) { useStart[v + 1]++; });
+        for (size_t v = 0; v < fn.instrs.size(); v++)
+            useStart[v + 1] += useStart[v];
+        useList.resize(useStart.back());
+        vector<uint32_t> fill(useStart.begin(), useStart.end() - 1);
+        eachUse([&](uint32_t v, uint32_t user) { useList[fill[v]++] = user; });
+
+        reached[0] = 1;
+        visitBlock(0);
+        while (!cfgWork.empty() || !ssaWork.empty()) {
+            while (!cfgWork.empty()) {
+                auto [from, to] = cfgWork.back();
+                cfgWork.pop_back();
+                const vector<uint32_t> &preds = fn.blocks[to].preds;
+                bool added = false;
+                for (size_t j = 0; j < preds.size(); j++) {
+                    if (preds[j] == from && !edges[to][j]) {
+                        edges[to][j] = 1;
+                        added = true;
+                    }
+                }
+                if (!added)
+                    continue;
+                if (!reached[to]) {
+                    reached[to] = 1;
+                    visitBlock(to);
+                } else {
+                    // so os phis veem a aresta nova
+                    for (uint32_t id : fn.blocks[to].code) {
+                        if (fn.instrs[id].op != IR_PHI)
+                            break;
+                        visitPhi(id);
+                    }
+                }
+            }
+            while (!ssaWork.empty()) {
+                uint32_t v = ssaWork.back();
+                ssaWork.pop_back();
+                for (uint32_t i = useStart[v]; i < useStart[v + 1]; i++) {
+                    uint32_t u = useList[i];
+                    if (u & USE_BLOCK) {
+                        if (reached[u & ~USE_BLOCK])
+                            visitTerm(u & ~USE_BLOCK);
+                    } else if (reached[fn.instrs[u].block]) {
+                        visit(u);
+                    }
+                }
+            }
+        }
+    }
+
+    const Lattice &value(uint32_t v) const {
+        return values[v];
+    }
+
+    bool executable(uint32_t b) const {
+        return reached[b] != 0;
+    }
+};
+
+// Leva o resultado do Sccp de volta para a arvore (-O, so na arvore de
+// ponteiros, que tem os slots): cada Ident cujo valor e constante vira o
+// literal, e depois da dobra as escritas que ninguem mais le somem.
+class ConstantPropagation : public Visitor<ConstantPropagation> {
+private:
+    IrFunction fn;
+    unordered_map<Node*, Value> constants;  // Ident -> literal que o troca
+    size_t replaced = 0;
+
+    static Node *literal(const Value &v, int line) {
+        Node *n;
+        switch (v.type) {
+        case VT_INT: n = new Integer(v.i); break;
+        case VT_FLOAT: n = new Float((float) v.f); break;
+        case VT_BOOL: n = v.b ? (Node*) new True() : (Node*) new False(); break;
+        default: {
+            string text = "\"" + string(v.str()) + "\"";
+            n = new String(atoms.intern(text.data(), text.size()));
+            break;
+        }
+        }
+        n->setLineNo(line);
+        return n;
+    }
+
+    static bool literalValue(Node *n, Value &v) {
+        switch (n->getKind()) {
+        case NK_INTEGER: v = Value::ofInt(static_cast<Integer*>(n)->getValue()); return true;
+        case NK_FLOAT: v = Value::ofFloat(static_cast<Float*>(n)->getValue()); return true;
+        case NK_TRUE: v = Value::ofBool(true); return true;
+        case NK_FALSE: v = Value::ofBool(false); return true;
+        case NK_STRING: v = Value::ofString(literal_text(static_cast<String*>(n)->getValue())); return true;
+        default: return false;
+        }
+    }
+
+    // Declaracoes e atribuicoes de variaveis que nenhum Ident ou Pass le
+    // mais (os Idents trocados nao contam; os que a dobra tirou ainda
+    // contam, o que so deixa escritas a mais). Uma variavel so perde as
+    // escritas se todas forem de um literal do tipo dela.
+    class DeadStores : public Visitor<DeadStores> {
+    public:
+        const IrFunction &fn;
+        unordered_map<Node*, uint32_t> writes;  // Variable/Attribution -> IrVar
+        vector<uint32_t> reads;
+        vector<char> kept;          // tem uma escrita que fica
+        size_t removed = 0;
+        bool pruning = false;
+
+        DeadStores(const IrFunction &f, const unordered_map<Node*, Value> &constants)
+            : fn(f), reads(f.vars.size(), 0), kept(f.vars.size(), 0) {
+            for (const IrSource &src : fn.sources) {
+                switch (src.node->getKind()) {
+                case NK_IDENT:
+                    if (constants.find(src.node) == constants.end())
+                        reads[src.var]++;
+                    break;
+                case NK_PASS:
+                    reads[src.var]++;
+                    break;
+                default:
+                    writes[src.node] = src.var;
+                    break;
+                }
+            }
+            // um nome que o IR nao resolveu pode ser de qualquer uma
+            for (Atom name : fn.unresolved)
+                for (uint32_t v = 0; v < fn.vars.size(); v++)
+                    if (fn.vars[v].name == name)
+                        kept[v] = 1;
+        }
+
+        bool removable(Node *n, uint32_t var) {
+            Node *value = n->getKind() == NK_VARIABLE ? static_cast<Variable*>(n)->getValue()
+                                                      : static_cast<Attribution*>(n)->getValue();
+            Value v;
+            return literalValue(value, v) && convert_value(v, fn.vars[var].type);
+        }
+
+        bool dead(Node *s) {
+            if (s->getKind() != NK_VARIABLE && s->getKind() != NK_ATTRIBUTION)
+                return false;
+            auto it = writes.find(s);
+            return it != writes.end() && reads[it->second] == 0 && !kept[it->second];
+        }
+
+        void dispatch(Node *n) {
+            if (!pruning) {
+                if (n->getKind() != NK_VARIABLE && n->getKind() != NK_ATTRIBUTION)
+                    return;
+                auto it = writes.find(n);
+                if (it != writes.end() && !removable(n, it->second))
+                    kept[it->second] = 1;
+                return;
+            }
+            if (n->getKind() != NK_STMTS && n->getKind() != NK_BLOCK)
+                return;
+            ArenaList<Node*> &c = n->getChildren();
+            size_t keep = 0;
+            for (size_t i = 0; i < c.size(); i++) {
+                if (dead(c[i]))
+                    removed += 1 + c[i]->getChildren().size();
+                else
+                    c[keep++] = c[i];
+            }
+            c.truncate(keep);
+        }
+    };
+
+public:
+    // Constroi o SSA do programa checado e roda o Sccp.
+    ConstantPropagation(Program *program) : fn(build_ssa(program)) {
+        Sccp sccp(fn);
+        sccp.run();
+        for (const IrSource &src : fn.sources) {
+            if (src.value == IR_NONE || src.node->getKind() != NK_IDENT)
+                continue;
+            const Lattice &l = sccp.value(src.value);
+            if (l.state != LAT_CONST || (l.k.type == VT_FLOAT && !fits_float(l.k.f)))
+                continue;
+            constants[src.node] = l.k;
+        }
+    }
+
+    // Troca os Idents constantes pelos literais; devolve quantos.
+    size_t rewrite(Program *program) {
+        if (!constants.empty())
+            walk(program);
+        return replaced;
+    }
+
+    void dispatch(Node *n) {
+        ArenaList<Node*> &c = n->getChildren();
+        for (size_t i = 0; i < c.size(); i++) {
+            if (c[i]->getKind() != NK_IDENT)
+                continue;
+            auto it = constants.find(c[i]);
+            if (it == constants.end())
+                continue;
+            n->setChild(i, literal(it->second, c[i]->getLineNo()));
+            replaced++;
+        }
+    }
+
+    // Depois da dobra: tira as declaracoes e atribuicoes de literais cuja
+    // variavel nao e mais lida. Devolve quantos nos sairam.
+    size_t removeDeadStores(Program *program) {
+        DeadStores stores(fn, constants);
+        stores.walk(program);
+        stores.pruning = true;
+        stores.walk(program);
+        return stores.removed;
+    }
+};
+
+#endif
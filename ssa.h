@@ -0,0 +1,567 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "cfg.h"
+
+using namespace std;
+
+// Arvore de dominadores (Cooper, Harvey e Kennedy: iteracao sobre a
+// pos-ordem reversa) e fronteiras de dominancia. Supoe que todo bloco e
+// alcancavel a partir da entrada.
+struct DomTree {
+    vector<uint32_t> idom;      // idom[0] = 0
+    vector<uint32_t> rpo;       // blocos em pos-ordem reversa
+    vector<uint32_t> order;     // posicao de cada bloco em rpo
+    vector<vector<uint32_t>> children;
+    vector<vector<uint32_t>> frontier;
+    vector<uint32_t> pre, post; // numeracao da arvore, para dominates()
+
+    void compute(const IrFunction &fn) {
+        size_t n = fn.blocks.size();
+        rpo.clear();
+        order.assign(n, IR_NONE);
+        // pos-ordem com pilha explicita
+        vector<pair<uint32_t, size_t>> stack{{0, 0}};
+        vector<bool> seen(n, false);
+        seen[0] = true;
+        while (!stack.empty()) {
+            auto &[b, next] = stack.back();
+            const IrBlock &blk = fn.blocks[b];
+            if (next < blk.succCount()) {
+                uint32_t s = blk.succ[next++];
+                if (!seen[s]) {
+                    seen[s] = true;
+                    stack.push_back({s, 0});
+                }
+                continue;
+            }
+            rpo.push_back(b);
+            stack.pop_back();
+        }
+        reverse(rpo.begin(), rpo.end());
+        for (uint32_t i = 0; i < rpo.size(); i++)
+            order[rpo[i]] = i;
+
+        idom.assign(n, IR_NONE);
+        idom[0] = 0;
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t i = 1; i < rpo.size(); i++) {
+                uint32_t b = rpo[i];
+                uint32_t d = IR_NONE;
+                for (uint32_t p : fn.blocks[b].preds) {
+                    if (idom[p] == IR_NONE)
+                        continue;
+                    d = d == IR_NONE ? p : intersect(p, d);
+                }
+                if (d != idom[b]) {
+                    idom[b] = d;
+                    changed = true;
+                }
+            }
+        }
+
+        children.assign(n, {});
+        for (uint32_t b : rpo)
+            if (b != 0)
+                children[idom[b]].push_back(b);
+
+        frontier.assign(n, {});
+        for (uint32_t b : rpo) {
+            const vector<uint32_t> &preds = fn.blocks[b].preds;
+            if (preds.size() < 2)
+                continue;
+            for (uint32_t p : preds) {
+                for (uint32_t r = p; r != idom[b]; r = idom[r]) {
+                    vector<uint32_t> &f = frontier[r];
+                    if (f.empty() || f.back() != b)
+                        f.push_back(b);
+                }
+            }
+        }
+
+        pre.assign(n, 0);
+        post.assign(n, 0);
+        uint32_t clock = 0;
+        vector<pair<uint32_t, size_t>> walk{{0, 0}};
+        pre[0] = clock++;
+        while (!walk.empty()) {
+            auto &[b, next] = walk.back();
+            if (next < children[b].size()) {
+                uint32_t c = children[b][next++];
+                pre[c] = clock++;
+                walk.push_back({c, 0});
+                continue;
+            }
+            post[b] = clock++;
+            walk.pop_back();
+        }
+    }
+
+    uint32_t intersect(uint32_t a, uint32_t b) const {
+        while (a != b) {
+            while (order[a] > order[b])
+                a = idom[a];
+            while (order[b] > order[a])
+                b = idom[b];
+        }
+        return a;
+    }
+
+    bool dominates(uint32_t a, uint32_t b) const {
+        return pre[a] <= pre[b] && post[b] <= post[a];
+    }
+};
+
+// Renumera os blocos em pos-ordem reversa, com o primeiro sucessor antes
+// do segundo (o corpo de um lo logo depois do teste), e tira os que a
+// entrada nao alcanca, como o resto de um bloco depois de um fail.
+inline void order_blocks(IrFunction &fn) {
+    size_t n = fn.blocks.size();
+    vector<uint32_t> post;
+    vector<bool> seen(n, false);
+    vector<pair<uint32_t, size_t>> stack{{0, 0}};
+    seen[0] = true;
+    while (!stack.empty()) {
+        auto &[b, next] = stack.back();
+        const IrBlock &blk = fn.blocks[b];
+        if (next < blk.succCount()) {
+            uint32_t s = blk.succ[blk.succCount() - 1 - next++];
+            if (!seen[s]) {
+                seen[s] = true;
+                stack.push_back({s, 0});
+            }
+            continue;
+        }
+        post.push_back(b);
+        stack.pop_back();
+    }
+    vector<uint32_t> remap(n, IR_NONE);
+    for (size_t i = 0; i < post.size(); i++)
+        remap[post[post.size() - 1 - i]] = (uint32_t) i;
+
+    vector<IrBlock> blocks(post.size());
+    for (uint32_t b = 0; b < n; b++) {
+        IrBlock &blk = fn.blocks[b];
+        if (remap[b] == IR_NONE) {
+            for (uint32_t id : blk.code)
+                fn.instrs[id].op = IR_NOP;
+            continue;
+        }
+        for (size_t s = 0; s < blk.succCount(); s++)
+            blk.succ[s] = remap[blk.succ[s]];
+        for (uint32_t id : blk.code)
+            fn.instrs[id].block = remap[b];
+        blocks[remap[b]] = std::move(blk);
+    }
+    fn.blocks = std::move(blocks);
+    fn.computePreds();
+}
+
+// Tira as instrucoes apagadas e renumera os valores na ordem dos blocos.
+inline void compact_values(IrFunction &fn) {
+    vector<uint32_t> remap(fn.instrs.size(), IR_NONE);
+    vector<IrInstr> instrs;
+    for (IrBlock &blk : fn.blocks) {
+        for (uint32_t &id : blk.code) {
+            remap[id] = (uint32_t) instrs.size();
+            instrs.push_back(std::move(fn.instrs[id]));
+            id = remap[id];
+        }
+    }
+    auto map = [&](uint32_t v) {
+        return v == IR_NONE ? v : remap[v];
+    };
+    for (IrInstr &in : instrs) {
+        in.a = map(in.a);
+        in.b = map(in.b);
+        for (uint32_t &v : in.args)
+            v = map(v);
+    }
+    for (IrBlock &blk : fn.blocks)
+        blk.cond = map(blk.cond);
+    for (IrSource &src : fn.sources)
+        src.value = map(src.value);
+    fn.instrs = std::move(instrs);
+}
+
+// Constroi o SSA sobre o CFG (Cytron et al.): os phis de cada variavel vao
+// para a fronteira de dominancia iterada dos blocos que a escrevem, so
+// onde ela esta viva na entrada (SSA podado), e a renomeacao desce a arvore
+// de dominadores trocando cada IR_LOAD pelo valor que chega ate ele.
+class SsaBuilder {
+private:
+    IrFunction &fn;
+    DomTree dom;
+    vector<uint32_t> replace;   // IR_LOAD -> valor que ele le
+    uint32_t undef[4] = {IR_NONE, IR_NONE, IR_NONE, IR_NONE};
+
+    void placePhis() {
+        size_t nvars = fn.vars.size();
+        size_t nblocks = fn.blocks.size();
+        vector<vector<uint32_t>> defs(nvars), uses(nvars);
+        // ultimo bloco visto por variavel, para nao repetir
+        vector<uint32_t> lastDef(nvars, IR_NONE), lastUse(nvars, IR_NONE);
+        for (uint32_t b = 0; b < nblocks; b++) {
+            for (uint32_t id : fn.blocks[b].code) {
+                const IrInstr &in = fn.instrs[id];
+                if (in.op == IR_STORE && lastDef[in.var] != b) {
+                    lastDef[in.var] = b;
+                    defs[in.var].push_back(b);
+                } else if (in.op == IR_LOAD && lastDef[in.var] != b && lastUse[in.var] != b) {
+                    // leitura antes de qualquer escrita no bloco
+                    lastUse[in.var] = b;
+                    uses[in.var].push_back(b);
+                }
+            }
+        }
+
+        // marcas por variavel: stamp == var + 1 vale para a variavel atual
+        vector<uint32_t> liveIn(nblocks, 0), isDef(nblocks, 0), hasPhi(nblocks, 0);
+        vector<uint32_t> work;
+        for (uint32_t v = 0; v < nvars; v++) {
+            uint32_t stamp = v + 1;
+            if (uses[v].empty() || defs[v].empty())
+                continue;
+            for (uint32_t b : defs[v])
+                isDef[b] = stamp;
+            work.clear();
+            for (uint32_t b : uses[v]) {
+                liveIn[b] = stamp;
+                work.push_back(b);
+            }
+            while (!work.empty()) {
+                uint32_t b = work.back();
+                work.pop_back();
+                for (uint32_t p : fn.blocks[b].preds) {
+                    if (liveIn[p] != stamp && isDef[p] != stamp) {
+                        liveIn[p] = stamp;
+                        work.push_back(p);
+                    }
+                }
+            }
+            work = defs[v];
+            while (!work.empty()) {
+                uint32_t b = work.back();
+                work.pop_back();
+                for (uint32_t d : dom.frontier[b]) {
+                    if (hasPhi[d] == stamp || liveIn[d] != stamp)
+                        continue;
+                    hasPhi[d] = stamp;
+                    IrInstr phi;
+                    phi.op = IR_PHI;
+                    phi.type = fn.vars[v].type;
+                    phi.var = v;
+                    phi.args.assign(fn.blocks[d].preds.size(), IR_NONE);
+                    phi.block = d;
+                    fn.instrs.push_back(std::move(phi));
+                    vector<uint32_t> &code = fn.blocks[d].code;
+                    code.insert(code.begin(), (uint32_t) fn.instrs.size() - 1);
+                    if (isDef[d] != stamp) {
+                        isDef[d] = stamp;
+                        work.push_back(d);
+                    }
+                }
+            }
+        }
+    }
+
+    // Valor de uma variavel lida antes de ser escrita; fica na entrada.
+    uint32_t undefOf(ValueType type) {
+        if (undef[type] == IR_NONE) {
+            IrInstr in;
+            in.op = IR_UNDEF;
+            in.type = type;
+            in.block = 0;
+            fn.instrs.push_back(std::move(in));
+            undef[type] = (uint32_t) fn.instrs.size() - 1;
+            vector<uint32_t> &code = fn.blocks[0].code;
+            code.insert(code.begin(), undef[type]);
+        }
+        return undef[type];
+    }
+
+    uint32_t resolve(uint32_t v) const {
+        return v != IR_NONE && v < replace.size() && replace[v] != IR_NONE ? replace[v] : v;
+    }
+
+    void rename() {
+        vector<uint32_t> current(fn.vars.size(), IR_NONE);
+        vector<pair<uint32_t, uint32_t>> undo;  // (variavel, valor anterior)
+        replace.assign(fn.instrs.size(), IR_NONE);
+
+        auto reaching = [&](uint32_t var) {
+            return current[var] != IR_NONE ? current[var] : undefOf(fn.vars[var].type);
+        };
+        auto define = [&](uint32_t var, uint32_t v) {
+            undo.push_back({var, current[var]});
+            current[var] = v;
+        };
+
+        struct Frame {
+            uint32_t block;
+            size_t next;
+            size_t mark;
+        };
+        vector<Frame> stack{{0, 0, 0}};
+        bool entering = true;
+        while (!stack.empty()) {
+            Frame &f = stack.back();
+            if (entering) {
+                IrBlock &blk = fn.blocks[f.block];
+                for (uint32_t id : blk.code) {
+                    IrInstr &in = fn.instrs[id];
+                    switch (in.op) {
+                    case IR_PHI:
+                        define(in.var, id);
+                        break;
+                    case IR_LOAD:
+                        replace[id] = reaching(in.var);
+                        in.op = IR_NOP;
+                        break;
+                    case IR_STORE:
+                        define(in.var, resolve(in.a));
+                        in.op = IR_NOP;
+                        break;
+                    default:
+                        in.a = resolve(in.a);
+                        in.b = resolve(in.b);
+                        break;
+                    }
+                }
+                blk.cond = resolve(blk.cond);
+                for (size_t s = 0; s < blk.succCount(); s++) {
+                    IrBlock &succ = fn.blocks[blk.succ[s]];
+                    for (size_t j = 0; j < succ.preds.size(); j++) {
+                        if (succ.preds[j] != f.block)
+                            continue;
+                        for (uint32_t id : succ.code) {
+                            IrInstr &phi = fn.instrs[id];
+                            if (phi.op != IR_PHI)
+                                break;
+                            phi.args[j] = reaching(phi.var);
+                        }
+                    }
+                }
+            }
+            if (f.next < dom.children[f.block].size()) {
+                uint32_t c = dom.children[f.block][f.next++];
+                stack.push_back({c, 0, undo.size()});
+                entering = true;
+                continue;
+            }
+            while (undo.size() > f.mark) {
+                current[undo.back().first] = undo.back().second;
+                undo.pop_back();
+            }
+            stack.pop_back();
+            entering = false;
+        }
+
+        // as leituras da arvore passam a apontar para o valor que chega
+        for (IrSource &src : fn.sources)
+            if (src.value != IR_NONE)
+                src.value = replace[src.value];
+        for (IrBlock &blk : fn.blocks) {
+            blk.code.erase(remove_if(blk.code.begin(), blk.code.end(), [&](uint32_t id) {
+                return fn.instrs[id].op == IR_NOP;
+            }), blk.code.end());
+        }
+    }
+
+public:
+    SsaBuilder(IrFunction &f) : fn(f) {}
+
+    void build() {
+        order_blocks(fn);
+        dom.compute(fn);
+        placePhis();
+        rename();
+        compact_values(fn);
+        fn.ssa = true;
+    }
+};
+
+inline IrFunction build_ssa(Program *program) {
+    IrFunction fn = CfgBuilder().build(program);
+    SsaBuilder(fn).build();
+    return fn;
+}
+
+// Confere as invariantes do IR: terminadores e arestas consistentes, phis
+// no comeco do bloco com um argumento por predecessor, cada valor definido
+// uma vez, toda definicao dominando os seus usos e os tipos dos operandos.
+// Devolve uma mensagem por problema; vazio quando esta tudo certo.
+inline vector<string> verify_ir(const IrFunction &fn) {
+    vector<string> errors;
+    auto error = [&](uint32_t b, const string &msg) {
+        errors.push_back("bb" + to_string(b) + ": " + msg);
+    };
+    auto name = [](uint32_t v) {
+        return "v" + to_string(v);
+    };
+    size_t n = fn.blocks.size();
+    if (n == 0) {
+        errors.push_back("função sem blocos");
+        return errors;
+    }
+
+    vector<vector<uint32_t>> expected(n);
+    for (uint32_t b = 0; b < n; b++) {
+        const IrBlock &blk = fn.blocks[b];
+        if (blk.term == TERM_NONE)
+            error(b, "bloco sem terminador");
+        for (size_t s = 0; s < blk.succCount(); s++) {
+            if (blk.succ[s] >= n)
+                error(b, "sucessor inexistente");
+            else
+                expected[blk.succ[s]].push_back(b);
+        }
+        if (blk.term == TERM_FAIL && blk.message >= fn.messages.size())
+            error(b, "fail sem mensagem");
+    }
+    if (!errors.empty())
+        return errors;
+    for (uint32_t b = 0; b < n; b++) {
+        vector<uint32_t> preds = fn.blocks[b].preds;
+        sort(preds.begin(), preds.end());
+        sort(expected[b].begin(), expected[b].end());
+        if (preds != expected[b])
+            error(b, "predecessores não batem com as arestas");
+    }
+    if (!fn.blocks[0].preds.empty())
+        error(0, "a entrada tem predecessores");
+
+    // onde cada valor e definido
+    vector<uint32_t> defBlock(fn.instrs.size(), IR_NONE), defPos(fn.instrs.size(), 0);
+    for (uint32_t b = 0; b < n; b++) {
+        const vector<uint32_t> &code = fn.blocks[b].code;
+        bool phis = true;
+        for (uint32_t i = 0; i < code.size(); i++) {
+            uint32_t id = code[i];
+            if (id >= fn.instrs.size()) {
+                error(b, "instrução inexistente");
+                continue;
+            }
+            const IrInstr &in = fn.instrs[id];
+            if (defBlock[id] != IR_NONE)
+                error(b, name(id) + " aparece mais de uma vez");
+            defBlock[id] = b;
+            defPos[id] = i;
+            if (in.block != b)
+                error(b, name(id) + " marcado com o bloco errado");
+            if (in.op == IR_PHI) {
+                if (!phis)
+                    error(b, name(id) + ": phi depois de outra instrução");
+            } else {
+                phis = false;
+            }
+            if (in.op == IR_NOP)
+                error(b, name(id) + ": nop no bloco");
+            if (fn.ssa && (in.op == IR_LOAD || in.op == IR_STORE))
+                error(b, name(id) + ": load/store depois do SSA");
+            if (!fn.ssa && in.op == IR_PHI)
+                error(b, name(id) + ": phi antes do SSA");
+        }
+    }
+    if (!errors.empty())
+        return errors;
+
+    DomTree dom;
+    dom.compute(fn);
+    for (uint32_t b = 0; b < n; b++) {
+        if (dom.order[b] == IR_NONE) {
+            error(b, "bloco inalcançável");
+            return errors;
+        }
+    }
+
+    // v e usado no bloco b na posicao pos (pos = tamanho do bloco para o
+    // terminador e para os argumentos de phi, que valem no fim do pred)
+    auto use = [&](uint32_t b, uint32_t user, uint32_t v, size_t pos) -> ValueType {
+        string who = user == IR_NONE ? string("terminador") : name(user);
+        if (v == IR_NONE || v >= fn.instrs.size() || defBlock[v] == IR_NONE) {
+            error(b, who + " usa um valor inexistente");
+            return VT_INT;
+        }
+        if (!ir_has_value(fn.instrs[v].op))
+            error(b, who + " usa " + name(v) + ", que não produz valor");
+        else if (defBlock[v] == b ? defPos[v] >= pos : !dom.dominates(defBlock[v], b))
+            error(b, who + " usa " + name(v) + " sem que a definição o domine");
+        return fn.instrs[v].type;
+    };
+    auto numeric = [](ValueType t) {
+        return t == VT_INT || t == VT_FLOAT;
+    };
+
+    for (uint32_t b = 0; b < n; b++) {
+        const IrBlock &blk = fn.blocks[b];
+        for (uint32_t i = 0; i < blk.code.size(); i++) {
+            uint32_t id = blk.code[i];
+            const IrInstr &in = fn.instrs[id];
+            switch (in.op) {
+            case IR_CONST:
+                if (in.k.type != in.type)
+                    error(b, name(id) + ": constante com o tipo errado");
+                break;
+            case IR_PHI:
+                if (in.args.size() != blk.preds.size()) {
+                    error(b, name(id) + ": phi com " + to_string(in.args.size()) + " argumentos para "
+                          + to_string(blk.preds.size()) + " predecessores");
+                    break;
+                }
+                for (size_t j = 0; j < in.args.size(); j++) {
+                    uint32_t p = blk.preds[j];
+                    if (use(p, id, in.args[j], fn.blocks[p].code.size()) != in.type)
+                        error(b, name(id) + ": argumento de phi com outro tipo");
+                }
+                break;
+            case IR_ADD:
+            case IR_SUB:
+            case IR_MUL:
+            case IR_DIV:
+            case IR_MOD:
+                if (!numeric(in.type) || use(b, id, in.a, i) != in.type || use(b, id, in.b, i) != in.type)
+                    error(b, name(id) + ": operandos com tipo errado");
+                break;
+            case IR_NEG:
+                if (!numeric(in.type) || use(b, id, in.a, i) != in.type)
+                    error(b, name(id) + ": operando com tipo errado");
+                break;
+            case IR_I2F:
+                if (in.type != VT_FLOAT || use(b, id, in.a, i) != VT_INT)
+                    error(b, name(id) + ": conversão com tipo errado");
+                break;
+            case IR_F2I:
+                if (in.type != VT_INT || use(b, id, in.a, i) != VT_FLOAT)
+                    error(b, name(id) + ": conversão com tipo errado");
+                break;
+            case IR_CMP:
+                if (in.type != VT_BOOL || in.cmp > 5 || use(b, id, in.a, i) != use(b, id, in.b, i))
+                    error(b, name(id) + ": comparação com tipo errado");
+                break;
+            case IR_PRINT:
+            case IR_STORE:
+                if (use(b, id, in.a, i) != in.type)
+                    error(b, name(id) + ": operando com tipo errado");
+                if (in.op == IR_STORE && (in.var >= fn.vars.size() || fn.vars[in.var].type != in.type))
+                    error(b, name(id) + ": variável com tipo errado");
+                break;
+            case IR_LOAD:
+                if (in.var >= fn.vars.size() || fn.vars[in.var].type != in.type)
+                    error(b, name(id) + ": variável com tipo errado");
+                break;
+            default:
+                break;
+            }
+        }
+        if (blk.term == TERM_BR && use(b, IR_NONE, blk.cond, blk.code.size()) != VT_BOOL)
+            error(b, "br com condição não booleana");
+    }
+    return errors;
+}
+
+#endif
@@ -0,0 +1,601 @@
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "bytecode.h"
+#include "jit.h"
+#include "vm.h"
+
+using namespace std;
+
+// Compilador de base por copy-and-patch (--baseline): cada opcode do Chunk
+// tem um stencil, um pedaco de codigo de maquina ja montado junto com o
+// compilador (o asm abaixo), com buracos no lugar dos operandos. Compilar
+// e copiar os stencils um atras do outro e escrever nos buracos os
+// deslocamentos dos registradores, os imediatos, os enderecos das funcoes
+// de apoio e os saltos; nao ha selecao de instrucoes nem alocacao de
+// registradores, entao o custo e o de um memcpy por instrucao.
+//
+// O codigo roda sobre o mesmo vetor de registradores do --vm (%rbx), com
+// o contexto em %r12, e devolve um CpStatus. A saida e os erros sao os do
+// --vm.
+//
+// Os buracos sao constantes marcadas que nao aparecem em outro lugar dos
+// stencils; cada uma e procurada uma vez nos bytes montados. Os saltos vao
+// em .byte/.long para o rel32 ser o buraco.
+asm(R"(
+    .pushsection .rodata
+vl_stencil_PROLOGUE:
+    pushq %rbp
+    movq %rsp, %rbp
+    pushq %rbx
+    pushq %r12
+    movq %rdi, %rbx
+    movq %rsi, %r12
+vl_stencil_PROLOGUE_end:
+vl_stencil_EPILOGUE:
+    leaq -16(%rbp), %rsp
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+vl_stencil_EPILOGUE_end:
+vl_stencil_DIVZERO:
+    movl $0x0EADBE06, (%r12)
+    movl $3, %eax
+    .byte 0xe9
+    .long 0x0EADBE07
+vl_stencil_DIVZERO_end:
+
+vl_stencil_MOV:
+    movdqu 0x0EADBE02(%rbx), %xmm0
+    movdqu %xmm0, 0x0EADBE01(%rbx)
+vl_stencil_MOV_end:
+vl_stencil_I2F:
+    cvtsi2sdl 0x0EADBE02(%rbx), %xmm0
+    movsd %xmm0, 0x0EADBE01(%rbx)
+vl_stencil_I2F_end:
+vl_stencil_F2I:
+    cvttsd2si 0x0EADBE02(%rbx), %eax
+    movl %eax, 0x0EADBE01(%rbx)
+vl_stencil_F2I_end:
+
+vl_stencil_ADD_I:
+    movl 0x0EADBE02(%rbx), %eax
+    addl 0x0EADBE03(%rbx), %eax
+    movl %eax, 0x0EADBE01(%rbx)
+vl_stencil_ADD_I_end:
+vl_stencil_SUB_I:
+    movl 0x0EADBE02(%rbx), %eax
+    subl 0x0EADBE03(%rbx), %eax
+    movl %eax, 0x0EADBE01(%rbx)
+vl_stencil_SUB_I_end:
+vl_stencil_MUL_I:
+    movl 0x0EADBE02(%rbx), %eax
+    imull 0x0EADBE03(%rbx), %eax
+    movl %eax, 0x0EADBE01(%rbx)
+vl_stencil_MUL_I_end:
+vl_stencil_DIV_I:
+    movl 0x0EADBE03(%rbx), %ecx
+    testl %ecx, %ecx
+    .byte 0x0f, 0x84
+    .long 0x0EADBE09
+    movl 0x0EADBE02(%rbx), %eax
+    cmpl $-1, %ecx
+    jne 1f
+    negl %eax
+    jmp 2f
+1:  cltd
+    idivl %ecx
+2:  movl %eax, 0x0EADBE01(%rbx)
+vl_stencil_DIV_I_end:
+vl_stencil_MOD_I:
+    movl 0x0EADBE03(%rbx), %ecx
+    testl %ecx, %ecx
+    .byte 0x0f, 0x84
+    .long 0x0EADBE09
+    xorl %edx, %edx
+    cmpl $-1, %ecx
+    je 1f
+    movl 0x0EADBE02(%rbx), %eax
+    cltd
+    idivl %ecx
+1:  movl %edx, 0x0EADBE01(%rbx)
+vl_stencil_MOD_I_end:
+
+vl_stencil_ADD_F:
+    movsd 0x0EADBE02(%rbx), %xmm0
+    addsd 0x0EADBE03(%rbx), %xmm0
+    movsd %xmm0, 0x0EADBE01(%rbx)
+vl_stencil_ADD_F_end:
+vl_stencil_SUB_F:
+    movsd 0x0EADBE02(%rbx), %xmm0
+    subsd 0x0EADBE03(%rbx), %xmm0
+    movsd %xmm0, 0x0EADBE01(%rbx)
+vl_stencil_SUB_F_end:
+vl_stencil_MUL_F:
+    movsd 0x0EADBE02(%rbx), %xmm0
+    mulsd 0x0EADBE03(%rbx), %xmm0
+    movsd %xmm0, 0x0EADBE01(%rbx)
+vl_stencil_MUL_F_end:
+vl_stencil_DIV_F:
+    movsd 0x0EADBE02(%rbx), %xmm0
+    divsd 0x0EADBE03(%rbx), %xmm0
+    movsd %xmm0, 0x0EADBE01(%rbx)
+vl_stencil_DIV_F_end:
+vl_stencil_MOD_F:
+    movsd 0x0EADBE02(%rbx), %xmm0
+    movsd 0x0EADBE03(%rbx), %xmm1
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+    movsd %xmm0, 0x0EADBE01(%rbx)
+vl_stencil_MOD_F_end:
+
+vl_stencil_NEG_I:
+    movl 0x0EADBE02(%rbx), %eax
+    negl %eax
+    movl %eax, 0x0EADBE01(%rbx)
+vl_stencil_NEG_I_end:
+vl_stencil_NEG_F:
+    movq 0x0EADBE02(%rbx), %rax
+    btcq $63, %rax
+    movq %rax, 0x0EADBE01(%rbx)
+vl_stencil_NEG_F_end:
+vl_stencil_INC_I:
+    addl $0x0EADBE05, 0x0EADBE01(%rbx)
+vl_stencil_INC_I_end:
+vl_stencil_INC_F:
+    movl $0x0EADBE05, %eax
+    cvtsi2sdl %eax, %xmm1
+    movsd 0x0EADBE01(%rbx), %xmm0
+    addsd %xmm1, %xmm0
+    movsd %xmm0, 0x0EADBE01(%rbx)
+vl_stencil_INC_F_end:
+
+vl_stencil_JMP:
+    .byte 0xe9
+    .long 0x0EADBE04
+vl_stencil_JMP_end:
+vl_stencil_JT:
+    cmpl $0, 0x0EADBE01(%rbx)
+    .byte 0x0f, 0x85
+    .long 0x0EADBE04
+vl_stencil_JT_end:
+vl_stencil_JF:
+    cmpl $0, 0x0EADBE01(%rbx)
+    .byte 0x0f, 0x84
+    .long 0x0EADBE04
+vl_stencil_JF_end:
+
+vl_stencil_JLT_I:
+    movl 0x0EADBE01(%rbx), %eax
+    cmpl 0x0EADBE02(%rbx), %eax
+    .byte 0x0f, 0x8c
+    .long 0x0EADBE04
+vl_stencil_JLT_I_end:
+vl_stencil_JLE_I:
+    movl 0x0EADBE01(%rbx), %eax
+    cmpl 0x0EADBE02(%rbx), %eax
+    .byte 0x0f, 0x8e
+    .long 0x0EADBE04
+vl_stencil_JLE_I_end:
+vl_stencil_JEQ_I:
+    movl 0x0EADBE01(%rbx), %eax
+    cmpl 0x0EADBE02(%rbx), %eax
+    .byte 0x0f, 0x84
+    .long 0x0EADBE04
+vl_stencil_JEQ_I_end:
+vl_stencil_JNE_I:
+    movl 0x0EADBE01(%rbx), %eax
+    cmpl 0x0EADBE02(%rbx), %eax
+    .byte 0x0f, 0x85
+    .long 0x0EADBE04
+vl_stencil_JNE_I_end:
+
+# pelo resultado de tres vias, como no --vm: NaN conta como igual
+vl_stencil_JLT_F:
+    movsd 0x0EADBE02(%rbx), %xmm0
+    ucomisd 0x0EADBE01(%rbx), %xmm0
+    .byte 0x0f, 0x87
+    .long 0x0EADBE04
+vl_stencil_JLT_F_end:
+vl_stencil_JLE_F:
+    movsd 0x0EADBE01(%rbx), %xmm0
+    ucomisd 0x0EADBE02(%rbx), %xmm0
+    .byte 0x0f, 0x86
+    .long 0x0EADBE04
+vl_stencil_JLE_F_end:
+vl_stencil_JEQ_F:
+    movsd 0x0EADBE01(%rbx), %xmm0
+    ucomisd 0x0EADBE02(%rbx), %xmm0
+    .byte 0x0f, 0x84
+    .long 0x0EADBE04
+vl_stencil_JEQ_F_end:
+vl_stencil_JNE_F:
+    movsd 0x0EADBE01(%rbx), %xmm0
+    ucomisd 0x0EADBE02(%rbx), %xmm0
+    .byte 0x0f, 0x85
+    .long 0x0EADBE04
+vl_stencil_JNE_F_end:
+
+vl_stencil_JLT_S:
+    leaq 0x0EADBE01(%rbx), %rdi
+    leaq 0x0EADBE02(%rbx), %rsi
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+    testl %eax, %eax
+    .byte 0x0f, 0x88
+    .long 0x0EADBE04
+vl_stencil_JLT_S_end:
+vl_stencil_JLE_S:
+    leaq 0x0EADBE01(%rbx), %rdi
+    leaq 0x0EADBE02(%rbx), %rsi
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+    testl %eax, %eax
+    .byte 0x0f, 0x8e
+    .long 0x0EADBE04
+vl_stencil_JLE_S_end:
+vl_stencil_JEQ_S:
+    leaq 0x0EADBE01(%rbx), %rdi
+    leaq 0x0EADBE02(%rbx), %rsi
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+    testl %eax, %eax
+    .byte 0x0f, 0x84
+    .long 0x0EADBE04
+vl_stencil_JEQ_S_end:
+vl_stencil_JNE_S:
+    leaq 0x0EADBE01(%rbx), %rdi
+    leaq 0x0EADBE02(%rbx), %rsi
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+    testl %eax, %eax
+    .byte 0x0f, 0x85
+    .long 0x0EADBE04
+vl_stencil_JNE_S_end:
+
+# o tipo (ValueType) vai no imediato de %edx
+vl_stencil_SCAN_I:
+    movq %r12, %rdi
+    leaq 0x0EADBE01(%rbx), %rsi
+    movl $0, %edx
+    movl $0x0EADBE06, %ecx
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+    testl %eax, %eax
+    .byte 0x0f, 0x85
+    .long 0x0EADBE07
+vl_stencil_SCAN_I_end:
+vl_stencil_SCAN_F:
+    movq %r12, %rdi
+    leaq 0x0EADBE01(%rbx), %rsi
+    movl $1, %edx
+    movl $0x0EADBE06, %ecx
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+    testl %eax, %eax
+    .byte 0x0f, 0x85
+    .long 0x0EADBE07
+vl_stencil_SCAN_F_end:
+vl_stencil_SCAN_S:
+    movq %r12, %rdi
+    leaq 0x0EADBE01(%rbx), %rsi
+    movl $2, %edx
+    movl $0x0EADBE06, %ecx
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+    testl %eax, %eax
+    .byte 0x0f, 0x85
+    .long 0x0EADBE07
+vl_stencil_SCAN_S_end:
+vl_stencil_SCAN_B:
+    movq %r12, %rdi
+    leaq 0x0EADBE01(%rbx), %rsi
+    movl $3, %edx
+    movl $0x0EADBE06, %ecx
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+    testl %eax, %eax
+    .byte 0x0f, 0x85
+    .long 0x0EADBE07
+vl_stencil_SCAN_B_end:
+
+vl_stencil_PRINT_I:
+    movq %r12, %rdi
+    leaq 0x0EADBE01(%rbx), %rsi
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+vl_stencil_PRINT_I_end:
+vl_stencil_PRINT_F:
+    movq %r12, %rdi
+    leaq 0x0EADBE01(%rbx), %rsi
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+vl_stencil_PRINT_F_end:
+vl_stencil_PRINT_S:
+    movq %r12, %rdi
+    leaq 0x0EADBE01(%rbx), %rsi
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+vl_stencil_PRINT_S_end:
+vl_stencil_PRINT_B:
+    movq %r12, %rdi
+    leaq 0x0EADBE01(%rbx), %rsi
+    movabsq $0x0EADBE080EADBE08, %rax
+    call *%rax
+vl_stencil_PRINT_B_end:
+
+vl_stencil_FAIL:
+    movl $0x0EADBE06, (%r12)
+    movl $2, %eax
+    .byte 0xe9
+    .long 0x0EADBE07
+vl_stencil_FAIL_end:
+vl_stencil_HALT:
+    xorl %eax, %eax
+    .byte 0xe9
+    .long 0x0EADBE07
+vl_stencil_HALT_end:
+    .popsection
+)");
+
+#define STENCIL_DECL(name) extern "C" const uint8_t vl_stencil_##name[], vl_stencil_##name##_end[];
+#define STENCIL_RANGE(name) {vl_stencil_##name, vl_stencil_##name##_end, {}}
+
+STENCIL_DECL(PROLOGUE) STENCIL_DECL(EPILOGUE) STENCIL_DECL(DIVZERO)
+STENCIL_DECL(MOV) STENCIL_DECL(I2F) STENCIL_DECL(F2I)
+STENCIL_DECL(ADD_I) STENCIL_DECL(SUB_I) STENCIL_DECL(MUL_I) STENCIL_DECL(DIV_I) STENCIL_DECL(MOD_I)
+STENCIL_DECL(ADD_F) STENCIL_DECL(SUB_F) STENCIL_DECL(MUL_F) STENCIL_DECL(DIV_F) STENCIL_DECL(MOD_F)
+STENCIL_DECL(NEG_I) STENCIL_DECL(NEG_F) STENCIL_DECL(INC_I) STENCIL_DECL(INC_F)
+STENCIL_DECL(JMP) STENCIL_DECL(JT) STENCIL_DECL(JF)
+STENCIL_DECL(JLT_I) STENCIL_DECL(JLE_I) STENCIL_DECL(JEQ_I) STENCIL_DECL(JNE_I)
+STENCIL_DECL(JLT_F) STENCIL_DECL(JLE_F) STENCIL_DECL(JEQ_F) STENCIL_DECL(JNE_F)
+STENCIL_DECL(JLT_S) STENCIL_DECL(JLE_S) STENCIL_DECL(JEQ_S) STENCIL_DECL(JNE_S)
+STENCIL_DECL(SCAN_I) STENCIL_DECL(SCAN_F) STENCIL_DECL(SCAN_S) STENCIL_DECL(SCAN_B)
+STENCIL_DECL(PRINT_I) STENCIL_DECL(PRINT_F) STENCIL_DECL(PRINT_S) STENCIL_DECL(PRINT_B)
+STENCIL_DECL(FAIL) STENCIL_DECL(HALT)
+
+// Contexto que o codigo recebe em %r12; pc fica no comeco para os stencils
+// de erro escreverem em (%r12).
+struct StencilContext {
+    int32_t pc;
+    FILE *out;
+    FILE *in;
+    const char *message;
+    char buf[256];
+};
+
+class StencilCompiler {
+private:
+    // O que vai em cada buraco.
+    enum HoleKind : uint8_t {
+        HOLE_A = 1,     // deslocamento de R[a]
+        HOLE_B,         // de R[b]
+        HOLE_C,         // de R[c]
+        HOLE_TARGET,    // rel32 para a instrucao c
+        HOLE_IMM,       // b como imediato (INC_x)
+        HOLE_PC,        // indice da instrucao
+        HOLE_EXIT,      // rel32 para o epilogo
+        HOLE_FN,        // endereco de 64 bits da funcao de apoio
+        HOLE_DIVZERO    // rel32 para o stub de divisao por zero
+    };
+    static constexpr uint32_t HOLE_MARK = 0x0EADBE00;
+
+    struct Hole {
+        uint32_t offset;
+        HoleKind kind;
+    };
+
+    struct Stencil {
+        const uint8_t *begin, *end;
+        vector<Hole> holes;
+    };
+
+    enum Part { PART_PROLOGUE = OP_COUNT, PART_EPILOGUE, PART_DIVZERO, PART_COUNT };
+
+    static void printInt(StencilContext *c, Reg *r) {
+        print_value(c->out, Value::ofInt(r->i));
+    }
+
+    static void printFloat(StencilContext *c, Reg *r) {
+        print_value(c->out, Value::ofFloat(r->f));
+    }
+
+    static void printString(StencilContext *c, Reg *r) {
+        print_value(c->out, Value::ofString(string_view(r->str.s, r->str.len)));
+    }
+
+    static void printBool(StencilContext *c, Reg *r) {
+        print_value(c->out, Value::ofBool(r->i != 0));
+    }
+
+    static int compareString(Reg *a, Reg *b) {
+        return string_view(a->str.s, a->str.len).compare(string_view(b->str.s, b->str.len));
+    }
+
+    static int scanReg(StencilContext *c, Reg *r, int type, int pc) {
+        Value v;
+        if (const char *err = scan_value(c->in, (ValueType) type, v, c->buf)) {
+            c->pc = pc;
+            c->message = err;
+            return CP_SCAN_FAILED;
+        }
+        switch (v.type) {
+        case VT_INT: r->i = v.i; break;
+        case VT_FLOAT: r->f = v.f; break;
+        case VT_BOOL: r->i = v.b; break;
+        case VT_STRING: r->str.s = v.s; r->str.len = v.len; break;
+        }
+        return CP_OK;
+    }
+
+    static uint64_t helper(uint32_t op) {
+        double (*mod)(double, double) = fmod;
+        switch (op) {
+        case OP_MOD_F: return reinterpret_cast<uint64_t>(mod);
+        case OP_PRINT_I: return reinterpret_cast<uint64_t>(printInt);
+        case OP_PRINT_F: return reinterpret_cast<uint64_t>(printFloat);
+        case OP_PRINT_S: return reinterpret_cast<uint64_t>(printString);
+        case OP_PRINT_B: return reinterpret_cast<uint64_t>(printBool);
+        case OP_SCAN_I:
+        case OP_SCAN_F:
+        case OP_SCAN_S:
+        case OP_SCAN_B: return reinterpret_cast<uint64_t>(scanReg);
+        default: return reinterpret_cast<uint64_t>(compareString);
+        }
+    }
+
+    // Os stencils montados e onde ficam os buracos de cada um; feito uma
+    // vez por processo.
+    static const vector<Stencil> &stencils() {
+        static const vector<Stencil> table = [] {
+            vector<Stencil> t = {
+                STENCIL_RANGE(MOV), STENCIL_RANGE(I2F), STENCIL_RANGE(F2I),
+                STENCIL_RANGE(ADD_I), STENCIL_RANGE(SUB_I), STENCIL_RANGE(MUL_I),
+                STENCIL_RANGE(DIV_I), STENCIL_RANGE(MOD_I),
+                STENCIL_RANGE(ADD_F), STENCIL_RANGE(SUB_F), STENCIL_RANGE(MUL_F),
+                STENCIL_RANGE(DIV_F), STENCIL_RANGE(MOD_F),
+                STENCIL_RANGE(NEG_I), STENCIL_RANGE(NEG_F), STENCIL_RANGE(INC_I), STENCIL_RANGE(INC_F),
+                STENCIL_RANGE(JMP), STENCIL_RANGE(JT), STENCIL_RANGE(JF),
+                STENCIL_RANGE(JLT_I), STENCIL_RANGE(JLE_I), STENCIL_RANGE(JEQ_I), STENCIL_RANGE(JNE_I),
+                STENCIL_RANGE(JLT_F), STENCIL_RANGE(JLE_F), STENCIL_RANGE(JEQ_F), STENCIL_RANGE(JNE_F),
+                STENCIL_RANGE(JLT_S), STENCIL_RANGE(JLE_S), STENCIL_RANGE(JEQ_S), STENCIL_RANGE(JNE_S),
+                STENCIL_RANGE(SCAN_I), STENCIL_RANGE(SCAN_F), STENCIL_RANGE(SCAN_S), STENCIL_RANGE(SCAN_B),
+                STENCIL_RANGE(PRINT_I), STENCIL_RANGE(PRINT_F), STENCIL_RANGE(PRINT_S), STENCIL_RANGE(PRINT_B),
+                STENCIL_RANGE(FAIL), STENCIL_RANGE(HALT),
+                STENCIL_RANGE(PROLOGUE), STENCIL_RANGE(EPILOGUE), STENCIL_RANGE(DIVZERO),
+            };
+            for (Stencil &s : t) {
+                size_t n = s.end - s.begin;
+                for (size_t k = 0; k + 4 <= n; k++) {
+                    uint32_t w;
+                    memcpy(&w, s.begin + k, 4);
+                    if ((w & ~0xFFu) != HOLE_MARK || (w & 0xFF) < HOLE_A || (w & 0xFF) > HOLE_DIVZERO)
+                        continue;
+                    s.holes.push_back({(uint32_t) k, (HoleKind) (w & 0xFF)});
+                    k += (w & 0xFF) == HOLE_FN ? 7 : 3;
+                }
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    static void put32(X64Code &x, size_t at, uint32_t v) {
+        memcpy(&x.bytes[at], &v, 4);
+    }
+
+    static void put64(X64Code &x, size_t at, uint64_t v) {
+        memcpy(&x.bytes[at], &v, 8);
+    }
+
+public:
+    enum CpStatus { CP_OK, CP_SCAN_FAILED, CP_FAIL, CP_DIV_ZERO };
+
+    typedef int (*Entry)(Reg *regs, StencilContext *ctx);
+
+    // int f(Reg *regs, StencilContext *ctx) para o chunk inteiro.
+    ExecMemory compile(const Chunk &chunk) {
+        static_assert(PART_COUNT == OP_COUNT + 3, "um stencil por opcode e as partes fixas");
+        const vector<Stencil> &st = stencils();
+        X64Code x;
+        vector<size_t> start(chunk.code.size() + 1);
+        vector<pair<size_t, uint32_t>> targets, stubs;  // rel32, instrucao
+        vector<size_t> exits;
+
+        auto copy = [&](uint32_t part, const Instr *ins, uint32_t pc) {
+            const Stencil &s = st[part];
+            size_t base = x.size();
+            x.bytes.insert(x.bytes.end(), s.begin, s.end);
+            for (const Hole &h : s.holes) {
+                size_t at = base + h.offset;
+                switch (h.kind) {
+                case HOLE_A: put32(x, at, ins->a * (uint32_t) sizeof(Reg)); break;
+                case HOLE_B: put32(x, at, ins->b * (uint32_t) sizeof(Reg)); break;
+                case HOLE_C: put32(x, at, ins->c * (uint32_t) sizeof(Reg)); break;
+                case HOLE_TARGET: targets.push_back({at, ins->c}); break;
+                case HOLE_IMM: put32(x, at, ins->b); break;
+                case HOLE_PC: put32(x, at, pc); break;
+                case HOLE_EXIT: exits.push_back(at); break;
+                case HOLE_FN: put64(x, at, helper(part)); break;
+                case HOLE_DIVZERO: stubs.push_back({at, pc}); break;
+                }
+            }
+        };
+
+        copy(PART_PROLOGUE, nullptr, 0);
+        for (uint32_t pc = 0; pc < chunk.code.size(); pc++) {
+            start[pc] = x.size();
+            copy(chunk.code[pc].op, &chunk.code[pc], pc);
+        }
+        start[chunk.code.size()] = x.size();
+        size_t epilogue = x.size();
+        copy(PART_EPILOGUE, nullptr, 0);
+        for (auto &[at, pc] : stubs) {
+            x.patch(at, x.size());
+            copy(PART_DIVZERO, nullptr, pc);
+        }
+        for (auto &[at, target] : targets)
+            x.patch(at, start[target]);
+        for (size_t at : exits)
+            x.patch(at, epilogue);
+        return ExecMemory(x.bytes);
+    }
+};
+
+#undef STENCIL_DECL
+#undef STENCIL_RANGE
+
+// Compila o Chunk com o StencilCompiler e roda (--baseline). Sem memoria
+// executavel, roda na VM.
+class BaselineRunner {
+private:
+    const char *file;
+    FILE *out;
+    FILE *in;
+
+public:
+    BaselineRunner(const char *file, FILE *out, FILE *in = stdin) : file(file), out(out), in(in) {}
+
+    // false se o programa parou num erro de execucao.
+    bool run(const Chunk &chunk) {
+        ExecMemory code = StencilCompiler().compile(chunk);
+        if (code.get() == nullptr)
+            return VM(file, out, in).run(chunk);
+
+        vector<Reg> regs(chunk.numRegs, Reg{});
+        if (!chunk.consts.empty())
+            memcpy(&regs[chunk.constBase], chunk.consts.data(), chunk.consts.size() * sizeof(Reg));
+        StencilContext ctx{0, out, in, "", {0}};
+        int status = reinterpret_cast<StencilCompiler::Entry>(code.get())(regs.data(), &ctx);
+
+        string_view msg, arg;
+        switch (status) {
+        case StencilCompiler::CP_OK:
+            fflush(out);
+            return true;
+        case StencilCompiler::CP_SCAN_FAILED:
+            msg = ctx.message;
+            arg = ctx.buf;
+            break;
+        case StencilCompiler::CP_FAIL:
+            msg = chunk.messages[chunk.code[ctx.pc].a];
+            break;
+        default:
+            msg = "divisão por zero";
+            break;
+        }
+        fprintf(out, "%s:%d:0: runtime error: %.*s%.*s\n", file, chunk.lines[ctx.pc],
+                (int) msg.size(), msg.data(), (int) arg.size(), arg.data());
+        fflush(out);
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <cstdint>
+#include <vector>
+#include "atoms.h"
+
+using namespace std;
+
+struct Symbol {
+    uint32_t scope;  // profundidade do escopo que declarou
+    uint32_t line;
+    uint32_t slot;   // livre para quem usa a tabela
+};
+
+// Tabela de simbolos com escopos: hash de enderecamento aberto sobre os
+// Atoms e um log de desfazer. declare() guarda no log o valor anterior do
+// nome; pop() desfaz o log ate a marca do escopo, restaurando quem estava
+// sombreado. Chaves nunca saem da tabela, so deixam de estar vivas.
+class SymbolTable {
+private:
+    struct Entry {
+        Atom key;
+        bool used;
+        bool live;
+        Symbol sym;
+    };
+
+    struct Undo {
+        Atom key;
+        bool live;
+        Symbol sym;
+    };
+
+    vector<Entry> entries;
+    size_t count = 0;
+    unsigned shift = 64;
+    vector<Undo> log;
+    vector<size_t> marks;
+
+    size_t home(Atom a) const {
+        return (size_t) (((uint64_t) a * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    Entry &find(Atom a) {
+        size_t mask = entries.size() - 1;
+        size_t i = home(a);
+        while (entries[i].used && entries[i].key != a)
+            i = (i + 1) & mask;
+        return entries[i];
+    }
+
+    void grow() {
+        vector<Entry> old(entries.empty() ? 64 : entries.size() * 2);
+        old.swap(entries);
+        shift = 64 - __builtin_ctzll(entries.size());
+        for (Entry &e : old)
+            if (e.used)
+                find(e.key) = e;
+    }
+
+public:
+    SymbolTable() {
+        grow();
+    }
+
+    uint32_t depth() const {
+        return (uint32_t) marks.size();
+    }
+
+    void push() {
+        marks.push_back(log.size());
+    }
+
+    void pop() {
+        size_t mark = marks.back();
+        marks.pop_back();
+        while (log.size() > mark) {
+            Undo &u = log.back();
+            Entry &e = find(u.key);
+            e.live = u.live;
+            e.sym = u.sym;
+            log.pop_back();
+        }
+    }
+
+    Symbol *lookup(Atom a) {
+        Entry &e = find(a);
+        return e.used && e.live ? &e.sym : nullptr;
+    }
+
+    // Nome ja declarado no escopo corrente (redeclaracao, nao sombreamento).
+    bool declaredHere(Atom a) {
+        Symbol *s = lookup(a);
+        return s != nullptr && s->scope == depth();
+    }
+
+    Symbol &declare(Atom a, uint32_t line, uint32_t slot = 0) {
+        if ((count + 1) * 2 > entries.size())
+            grow();
+        Entry &e = find(a);
+        if (!e.used) {
+            e.used = true;
+            e.key = a;
+            e.live = false;
+            count++;
+        }
+        if (!marks.empty())
+            log.push_back({a, e.live, e.sym});
+        e.live = true;
+        e.sym = {depth(), line, slot};
+        return e.sym;
+    }
+};
+
+#endif
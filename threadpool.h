@@ -0,0 +1,58 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Roda tarefas numeradas 0..count-1 num conjunto fixo de threads, que vao
+// pegando o proximo indice livre. done(i) roda na thread que chamou run(),
+// na ordem dos indices, assim que a tarefa i termina; assim a saida fica
+// na mesma ordem da entrada mesmo com as tarefas terminando fora de ordem.
+class ThreadPool {
+private:
+    size_t threads;
+
+public:
+    ThreadPool(size_t n) : threads(n ? n : 1) {}
+
+    template <typename Task, typename Done>
+    void run(size_t count, Task task, Done done) {
+        vector<char> finished(count, 0);
+        atomic<size_t> next(0);
+        mutex lock;
+        condition_variable ready;
+
+        auto worker = [&] {
+            for (size_t i = next++; i < count; i = next++) {
+                task(i);
+                {
+                    lock_guard<mutex> guard(lock);
+                    finished[i] = 1;
+                }
+                ready.notify_one();
+            }
+        };
+
+        vector<thread> pool;
+        for (size_t t = 0; t < min(threads, count); t++)
+            pool.emplace_back(worker);
+
+        for (size_t i = 0; i < count; i++) {
+            unique_lock<mutex> guard(lock);
+            ready.wait(guard, [&] { return finished[i] != 0; });
+            guard.unlock();
+            done(i);
+        }
+
+        for (thread &t : pool)
+            t.join();
+    }
+};
+
+#endif
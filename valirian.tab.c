@@ -55,7 +55,7 @@
 #define YYSKELETON_NAME "yacc.c"
 
 /* Pure parsers.  */
-#define YYPURE 0
+#define YYPURE 2
 
 /* Push parsers.  */
 #define YYPUSH 0
@@ -66,17 +66,6 @@
 
 
 
-/* First part of user prologue.  */
-#line 1 "valirian.y"
-
-#include "nodes.h"
-
-int yyerror(const char *s);
-int yylex(void);
-int errorcount = 0;
-extern bool force_print_tree;
-
-#line 80 "valirian.tab.c"
 
 # ifndef YY_CAST
 #  ifdef __cplusplus
@@ -164,6 +153,23 @@ typedef enum yysymbol_kind_t yysymbol_kind_t;
 
 
 
+/* Unqualified %code blocks.  */
+#line 20 "valirian.y"
+
+#include "compilation.h"
+#include "passes.h"
+#include "interpreter.h"
+#include "vm.h"
+#include "jit.h"
+#include "stencil.h"
+#include "ssa.h"
+#include "asm.h"
+#include "cgen.h"
+
+int yyerror(yyscan_t scanner, Compilation &ctx, const char *s);
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+
+#line 173 "valirian.tab.c"
 
 #ifdef short
 # undef short
@@ -547,11 +553,11 @@ static const yytype_int8 yytranslate[] =
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_int16 yyrline[] =
 {
-       0,    58,    58,    86,    91,    97,   101,   105,   109,   113,
-     117,   121,   125,   129,   133,   137,   141,   145,   149,   153,
-     157,   161,   165,   169,   173,   177,   181,   185,   189,   193,
-     197,   201,   205,   209,   213,   217,   221,   225,   229,   232,
-     236,   240,   244,   249,   254,   258,   262,   266,   270
+       0,    89,    89,   169,   173,   177,   181,   185,   189,   193,
+     197,   201,   205,   209,   213,   217,   221,   225,   229,   233,
+     237,   241,   245,   249,   253,   257,   261,   265,   269,   273,
+     277,   281,   285,   289,   293,   297,   301,   305,   309,   312,
+     316,   320,   324,   328,   332,   336,   340,   344,   348
 };
 #endif
 
@@ -750,7 +756,7 @@ enum { YYENOMEM = -2 };
       }                                                           \
     else                                                          \
       {                                                           \
-        yyerror (YY_("syntax error: cannot back up")); \
+        yyerror (scanner, ctx, YY_("syntax error: cannot back up")); \
         YYERROR;                                                  \
       }                                                           \
   while (0)
@@ -783,7 +789,7 @@ do {                                                                      \
     {                                                                     \
       YYFPRINTF (stderr, "%s ", Title);                                   \
       yy_symbol_print (stderr,                                            \
-                  Kind, Value); \
+                  Kind, Value, scanner, ctx); \
       YYFPRINTF (stderr, "\n");                                           \
     }                                                                     \
 } while (0)
@@ -795,151 +801,153 @@ do {                                                                      \
 
 static void
 yy_symbol_value_print (FILE *yyo,
-                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, yyscan_t scanner, Compilation &ctx)
 {
   FILE *yyoutput = yyo;
   YY_USE (yyoutput);
+  YY_USE (scanner);
+  YY_USE (ctx);
   if (!yyvaluep)
     return;
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
   switch (yykind)
     {
     case YYSYMBOL_TOK_IDENT: /* TOK_IDENT  */
-#line 48 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).str));}
-#line 811 "valirian.tab.c"
+#line 79 "valirian.y"
+         { fprintf(yyo, "%s", atoms.c_str(((*yyvaluep).atom)));}
+#line 819 "valirian.tab.c"
         break;
 
     case YYSYMBOL_TOK_FLOAT: /* TOK_FLOAT  */
-#line 50 "valirian.y"
+#line 81 "valirian.y"
          { fprintf(yyo, "%f", ((*yyvaluep).flt));}
-#line 817 "valirian.tab.c"
+#line 825 "valirian.tab.c"
         break;
 
     case YYSYMBOL_TOK_INT: /* TOK_INT  */
-#line 49 "valirian.y"
+#line 80 "valirian.y"
          { fprintf(yyo, "%d", ((*yyvaluep).itg));}
-#line 823 "valirian.tab.c"
+#line 831 "valirian.tab.c"
         break;
 
     case YYSYMBOL_TOK_STRING: /* TOK_STRING  */
-#line 48 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).str));}
-#line 829 "valirian.tab.c"
+#line 79 "valirian.y"
+         { fprintf(yyo, "%s", atoms.c_str(((*yyvaluep).atom)));}
+#line 837 "valirian.tab.c"
         break;
 
     case YYSYMBOL_TOK_SCAN: /* TOK_SCAN  */
-#line 48 "valirian.y"
+#line 78 "valirian.y"
          { fprintf(yyo, "%s", ((*yyvaluep).str));}
-#line 835 "valirian.tab.c"
+#line 843 "valirian.tab.c"
         break;
 
     case YYSYMBOL_TOK_TIPOINT: /* TOK_TIPOINT  */
-#line 48 "valirian.y"
+#line 78 "valirian.y"
          { fprintf(yyo, "%s", ((*yyvaluep).str));}
-#line 841 "valirian.tab.c"
+#line 849 "valirian.tab.c"
         break;
 
     case YYSYMBOL_TOK_TIPOFLOAT: /* TOK_TIPOFLOAT  */
-#line 48 "valirian.y"
+#line 78 "valirian.y"
          { fprintf(yyo, "%s", ((*yyvaluep).str));}
-#line 847 "valirian.tab.c"
+#line 855 "valirian.tab.c"
         break;
 
     case YYSYMBOL_TOK_TIPOSTRING: /* TOK_TIPOSTRING  */
-#line 48 "valirian.y"
+#line 78 "valirian.y"
          { fprintf(yyo, "%s", ((*yyvaluep).str));}
-#line 853 "valirian.tab.c"
+#line 861 "valirian.tab.c"
         break;
 
     case YYSYMBOL_TOK_TIPOBOOL: /* TOK_TIPOBOOL  */
-#line 48 "valirian.y"
+#line 78 "valirian.y"
          { fprintf(yyo, "%s", ((*yyvaluep).str));}
-#line 859 "valirian.tab.c"
+#line 867 "valirian.tab.c"
         break;
 
     case YYSYMBOL_globals: /* globals  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 865 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 873 "valirian.tab.c"
         break;
 
     case YYSYMBOL_global: /* global  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 871 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 879 "valirian.tab.c"
         break;
 
     case YYSYMBOL_expr: /* expr  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 877 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 885 "valirian.tab.c"
         break;
 
     case YYSYMBOL_term: /* term  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 883 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 891 "valirian.tab.c"
         break;
 
     case YYSYMBOL_factor: /* factor  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 889 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 897 "valirian.tab.c"
         break;
 
     case YYSYMBOL_unary: /* unary  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 895 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 903 "valirian.tab.c"
         break;
 
     case YYSYMBOL_pass: /* pass  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 901 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 909 "valirian.tab.c"
         break;
 
     case YYSYMBOL_cond: /* cond  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 907 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 915 "valirian.tab.c"
         break;
 
     case YYSYMBOL_decl: /* decl  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 913 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 921 "valirian.tab.c"
         break;
 
     case YYSYMBOL_der: /* der  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 919 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 927 "valirian.tab.c"
         break;
 
     case YYSYMBOL_if: /* if  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 925 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 933 "valirian.tab.c"
         break;
 
     case YYSYMBOL_print: /* print  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 931 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 939 "valirian.tab.c"
         break;
 
     case YYSYMBOL_tip: /* tip  */
-#line 48 "valirian.y"
+#line 78 "valirian.y"
          { fprintf(yyo, "%s", ((*yyvaluep).str));}
-#line 937 "valirian.tab.c"
+#line 945 "valirian.tab.c"
         break;
 
     case YYSYMBOL_scan: /* scan  */
-#line 51 "valirian.y"
-         { fprintf(yyo, "%s", ((*yyvaluep).node)-> toDebug().c_str());}
-#line 943 "valirian.tab.c"
+#line 82 "valirian.y"
+         { fprintf(yyo, "%s", ctx.ast.toDebug(((*yyvaluep).node)).c_str());}
+#line 951 "valirian.tab.c"
         break;
 
       default:
@@ -955,12 +963,12 @@ yy_symbol_value_print (FILE *yyo,
 
 static void
 yy_symbol_print (FILE *yyo,
-                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, yyscan_t scanner, Compilation &ctx)
 {
   YYFPRINTF (yyo, "%s %s (",
              yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
 
-  yy_symbol_value_print (yyo, yykind, yyvaluep);
+  yy_symbol_value_print (yyo, yykind, yyvaluep, scanner, ctx);
   YYFPRINTF (yyo, ")");
 }
 
@@ -994,7 +1002,7 @@ do {                                                            \
 
 static void
 yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
-                 int yyrule)
+                 int yyrule, yyscan_t scanner, Compilation &ctx)
 {
   int yylno = yyrline[yyrule];
   int yynrhs = yyr2[yyrule];
@@ -1007,7 +1015,7 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
       YYFPRINTF (stderr, "   $%d = ", yyi + 1);
       yy_symbol_print (stderr,
                        YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
-                       &yyvsp[(yyi + 1) - (yynrhs)]);
+                       &yyvsp[(yyi + 1) - (yynrhs)], scanner, ctx);
       YYFPRINTF (stderr, "\n");
     }
 }
@@ -1015,7 +1023,7 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
 # define YY_REDUCE_PRINT(Rule)          \
 do {                                    \
   if (yydebug)                          \
-    yy_reduce_print (yyssp, yyvsp, Rule); \
+    yy_reduce_print (yyssp, yyvsp, Rule, scanner, ctx); \
 } while (0)
 
 /* Nonzero means print parse trace.  It is left uninitialized so that
@@ -1323,9 +1331,11 @@ yysyntax_error (YYPTRDIFF_T *yymsg_alloc, char **yymsg,
 
 static void
 yydestruct (const char *yymsg,
-            yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep, yyscan_t scanner, Compilation &ctx)
 {
   YY_USE (yyvaluep);
+  YY_USE (scanner);
+  YY_USE (ctx);
   if (!yymsg)
     yymsg = "Deleting";
   YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
@@ -1336,13 +1346,6 @@ yydestruct (const char *yymsg,
 }
 
 
-/* Lookahead token kind.  */
-int yychar;
-
-/* The semantic value of the lookahead symbol.  */
-YYSTYPE yylval;
-/* Number of syntax errors so far.  */
-int yynerrs;
 
 
 
@@ -1352,8 +1355,21 @@ int yynerrs;
 `----------*/
 
 int
-yyparse (void)
+yyparse (yyscan_t scanner, Compilation &ctx)
 {
+/* Lookahead token kind.  */
+int yychar;
+
+
+/* The semantic value of the lookahead symbol.  */
+/* Default value used for initialization, for pacifying older GCCs
+   or non-GCC compilers.  */
+YY_INITIAL_VALUE (static YYSTYPE yyval_default;)
+YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
+
+    /* Number of syntax errors so far.  */
+    int yynerrs = 0;
+
     yy_state_fast_t yystate = 0;
     /* Number of tokens to shift before error messages enabled.  */
     int yyerrstatus = 0;
@@ -1509,7 +1525,7 @@ yybackup:
   if (yychar == YYEMPTY)
     {
       YYDPRINTF ((stderr, "Reading a token\n"));
-      yychar = yylex ();
+      yychar = yylex (&yylval, scanner);
     }
 
   if (yychar <= YYEOF)
@@ -1597,411 +1613,458 @@ yyreduce:
   switch (yyn)
     {
   case 2: /* program: globals  */
-#line 58 "valirian.y"
+#line 89 "valirian.y"
                   {
-    Node *program = new Program();
-    program->append((yyvsp[0].node));
-
-    CheckVarDecl cvd;
-    cout << "Checking variable declarations..." << endl;
-    cvd.check(program);
-    cout << "erros: " << errorcount << endl;
-
-    CheckVarMix cvm;
-    cout << "Checking type mix declarations..." << endl;
-    cvm.check(program);
-    cout << "erros: " << errorcount << endl;
-
-    CheckDuplicateVariable cdv;
-    cout << "Checking duplicate variable declarations..." << endl;
-    cdv.check(program, "global"); 
-    cout << "erros: " << errorcount << endl;
-
-    if (errorcount > 0)
-        cout << errorcount << " error(s) found" << endl;
-    if (force_print_tree || errorcount == 0)
-        printf_tree(program);
+    NodeRef program = ctx.ast.program((yyvsp[0].node));
+
+    const Options &opts = ctx.options;
+    DiagnosticEngine &diagnostics = ctx.diagnostics;
+    PassManager passes(diagnostics, !opts.separate_passes, opts.compact_ast);
+    passes.run(program, ctx.ast.flat);
+
+    size_t errors = diagnostics.count();
+    if (diagnostics.limitReached())
+        diagnostics.note("Error limit reached, stopping.");
+    if (errors > 0)
+        diagnostics.note("", errors, " error(s) found");
+    if (opts.optimize && (errors == 0 || opts.force_print_tree))
+        passes.optimize(program, ctx.ast.flat);
+    if (opts.run || opts.vm || opts.jit || opts.trace || opts.baseline) {
+        diagnostics.write(ctx.out);
+        if (errors == 0 && opts.vm) {
+            Chunk chunk = BytecodeCompiler().compile(static_cast<Program*>(program.node));
+            ctx.failed = !VM(ctx.file_name, ctx.out).run(chunk);
+        }
+        else if (errors == 0 && opts.baseline) {
+            Chunk chunk = BytecodeCompiler().compile(static_cast<Program*>(program.node));
+            ctx.failed = !BaselineRunner(ctx.file_name, ctx.out).run(chunk);
+        }
+        else if (errors == 0 && (opts.jit || opts.trace)) {
+            Jit jit(ctx.out, opts.trace);
+            Interpreter interp(ctx.file_name, ctx.out);
+            interp.setLoopRunner(&jit);
+            ctx.failed = !interp.run(static_cast<Program*>(program.node));
+        }
+        else if (errors == 0) {
+            Interpreter interp(ctx.file_name, ctx.out);
+            ctx.failed = !interp.run(static_cast<Program*>(program.node));
+        }
+        else
+            diagnostics.note("Errors found, not running the program.");
+    }
+    else if (opts.emit_ssa) {
+        diagnostics.write(ctx.out);
+        if (errors == 0) {
+            IrFunction fn = build_ssa(static_cast<Program*>(program.node));
+            for (const string &e : verify_ir(fn))
+                diagnostics.note("Invalid SSA: " + e);
+            print_ir(fn, ctx.treeOutput());
+        }
+        else
+            diagnostics.note("Errors found, not emitting SSA.");
+    }
+    else if (opts.emit_asm || opts.native || opts.emit_c || opts.native_c) {
+        diagnostics.write(ctx.out);
+        Program *tree = static_cast<Program*>(program.node);
+        if (errors > 0)
+            diagnostics.note("Errors found, not generating code.");
+        else if (opts.emit_asm)
+            AsmGenerator(ctx.file_name, ctx.treeOutput()).generate(tree);
+        else if (opts.emit_c)
+            CGenerator(ctx.file_name).generate(tree, ctx.treeOutput());
+        else {
+            diagnostics.note(opts.native ? "Assembling and linking..." : "Compiling with gcc -O2...");
+            string exe;
+            string error = opts.native ? build_native(tree, ctx.file_name, exe) : build_native_c(tree, ctx.file_name, exe);
+            diagnostics.note(error.empty() ? "executável: " + exe : error);
+        }
+    }
+    else if (opts.force_print_tree || errors == 0) {
+        diagnostics.write(ctx.out);
+        if (opts.compact_ast)
+            flat_printf_tree(ctx.ast.flat, program.id, ctx.treeOutput());
+        else
+            printf_tree(program.node, ctx.treeOutput());
+    }
     else
-        cout << "Errors found, not printing the tree." << endl;
+        diagnostics.note("Errors found, not printing the tree.");
+    diagnostics.write(ctx.out);
+
+    ctx.ast.flat.release();
 }
-#line 1628 "valirian.tab.c"
+#line 1696 "valirian.tab.c"
     break;
 
   case 3: /* globals: globals global  */
-#line 86 "valirian.y"
+#line 169 "valirian.y"
                              {
-    (yyvsp[-1].node)->append((yyvsp[0].node));
-    (yyval.node) = (yyvsp[-1].node);
+    (yyval.node) = ctx.ast.append((yyvsp[-1].node), (yyvsp[0].node));
 }
-#line 1637 "valirian.tab.c"
+#line 1704 "valirian.tab.c"
     break;
 
   case 4: /* globals: global  */
-#line 91 "valirian.y"
+#line 173 "valirian.y"
                  {
-    Node *n = new Node();
-    n->append((yyvsp[0].node));
-    (yyval.node) = n;
+    (yyval.node) = ctx.ast.stmts((yyvsp[0].node));
 }
-#line 1647 "valirian.tab.c"
+#line 1712 "valirian.tab.c"
     break;
 
   case 5: /* global: TOK_IDENT '=' expr ';'  */
-#line 97 "valirian.y"
+#line 177 "valirian.y"
                                 {
-    (yyval.node) = new Attribution((yyvsp[-3].str), (yyvsp[-1].node));
+    (yyval.node) = ctx.ast.attribution((yyvsp[-3].atom), (yyvsp[-1].node));
 }
-#line 1655 "valirian.tab.c"
+#line 1720 "valirian.tab.c"
     break;
 
   case 6: /* global: TOK_IDENT '=' scan ';'  */
-#line 101 "valirian.y"
+#line 181 "valirian.y"
                                 {
-    (yyval.node) = new Scan();
+    (yyval.node) = ctx.ast.attribution((yyvsp[-3].atom), ctx.ast.scan());
 }
-#line 1663 "valirian.tab.c"
+#line 1728 "valirian.tab.c"
     break;
 
   case 7: /* global: if  */
-#line 105 "valirian.y"
+#line 185 "valirian.y"
             {
     (yyval.node) = (yyvsp[0].node);
 }
-#line 1671 "valirian.tab.c"
+#line 1736 "valirian.tab.c"
     break;
 
   case 8: /* global: print  */
-#line 109 "valirian.y"
+#line 189 "valirian.y"
               {
     (yyval.node) = (yyvsp[0].node);
 }
-#line 1679 "valirian.tab.c"
+#line 1744 "valirian.tab.c"
     break;
 
   case 9: /* global: decl  */
-#line 113 "valirian.y"
+#line 193 "valirian.y"
              {
     (yyval.node) = (yyvsp[0].node);
 }
-#line 1687 "valirian.tab.c"
+#line 1752 "valirian.tab.c"
     break;
 
   case 10: /* expr: expr '+' term  */
-#line 117 "valirian.y"
+#line 197 "valirian.y"
                          {
-    (yyval.node) = new BinaryOp((yyvsp[-2].node), (yyvsp[0].node), '+');
+    (yyval.node) = ctx.ast.binaryOp((yyvsp[-2].node), (yyvsp[0].node), '+');
 }
-#line 1695 "valirian.tab.c"
+#line 1760 "valirian.tab.c"
     break;
 
   case 11: /* expr: expr '-' term  */
-#line 121 "valirian.y"
+#line 201 "valirian.y"
                          {
-    (yyval.node) = new BinaryOp((yyvsp[-2].node), (yyvsp[0].node), '-');
+    (yyval.node) = ctx.ast.binaryOp((yyvsp[-2].node), (yyvsp[0].node), '-');
 }
-#line 1703 "valirian.tab.c"
+#line 1768 "valirian.tab.c"
     break;
 
   case 12: /* expr: term  */
-#line 125 "valirian.y"
+#line 205 "valirian.y"
             {
     (yyval.node) = (yyvsp[0].node);
 }
-#line 1711 "valirian.tab.c"
+#line 1776 "valirian.tab.c"
     break;
 
   case 13: /* term: term '*' factor  */
-#line 129 "valirian.y"
+#line 209 "valirian.y"
                            {
-    (yyval.node) = new BinaryOp((yyvsp[-2].node), (yyvsp[0].node), '*');
+    (yyval.node) = ctx.ast.binaryOp((yyvsp[-2].node), (yyvsp[0].node), '*');
 }
-#line 1719 "valirian.tab.c"
+#line 1784 "valirian.tab.c"
     break;
 
   case 14: /* term: term '/' factor  */
-#line 133 "valirian.y"
+#line 213 "valirian.y"
                            {
-    (yyval.node) = new BinaryOp((yyvsp[-2].node), (yyvsp[0].node), '/');
+    (yyval.node) = ctx.ast.binaryOp((yyvsp[-2].node), (yyvsp[0].node), '/');
 }
-#line 1727 "valirian.tab.c"
+#line 1792 "valirian.tab.c"
     break;
 
   case 15: /* term: term '%' factor  */
-#line 137 "valirian.y"
+#line 217 "valirian.y"
                            {
-    (yyval.node) = new BinaryOp((yyvsp[-2].node), (yyvsp[0].node), '%');
+    (yyval.node) = ctx.ast.binaryOp((yyvsp[-2].node), (yyvsp[0].node), '%');
 }
-#line 1735 "valirian.tab.c"
+#line 1800 "valirian.tab.c"
     break;
 
   case 16: /* term: factor  */
-#line 141 "valirian.y"
+#line 221 "valirian.y"
               {
     (yyval.node) = (yyvsp[0].node);
 }
-#line 1743 "valirian.tab.c"
+#line 1808 "valirian.tab.c"
     break;
 
   case 17: /* factor: '(' expr ')'  */
-#line 145 "valirian.y"
+#line 225 "valirian.y"
                       {
     (yyval.node) = (yyvsp[-1].node);
 }
-#line 1751 "valirian.tab.c"
+#line 1816 "valirian.tab.c"
     break;
 
   case 18: /* factor: TOK_IDENT  */
-#line 149 "valirian.y"
+#line 229 "valirian.y"
                         {
-    (yyval.node) = new Ident((yyvsp[0].str));
+    (yyval.node) = ctx.ast.ident((yyvsp[0].atom));
 }
-#line 1759 "valirian.tab.c"
+#line 1824 "valirian.tab.c"
     break;
 
   case 19: /* factor: TOK_INT  */
-#line 153 "valirian.y"
+#line 233 "valirian.y"
                       {
-    (yyval.node) = new Integer((yyvsp[0].itg));
+    (yyval.node) = ctx.ast.integer((yyvsp[0].itg));
 }
-#line 1767 "valirian.tab.c"
+#line 1832 "valirian.tab.c"
     break;
 
   case 20: /* factor: TOK_FLOAT  */
-#line 157 "valirian.y"
+#line 237 "valirian.y"
                         {
-    (yyval.node) = new Float((yyvsp[0].flt));
+    (yyval.node) = ctx.ast.floating((yyvsp[0].flt));
 }
-#line 1775 "valirian.tab.c"
+#line 1840 "valirian.tab.c"
     break;
 
   case 21: /* factor: TOK_TRUE  */
-#line 161 "valirian.y"
+#line 241 "valirian.y"
                  {
-    (yyval.node) = new True();
+    (yyval.node) = ctx.ast.boolean(true);
 }
-#line 1783 "valirian.tab.c"
+#line 1848 "valirian.tab.c"
     break;
 
   case 22: /* factor: TOK_FALSE  */
-#line 165 "valirian.y"
+#line 245 "valirian.y"
                   {
-    (yyval.node) = new False();
+    (yyval.node) = ctx.ast.boolean(false);
 }
-#line 1791 "valirian.tab.c"
+#line 1856 "valirian.tab.c"
     break;
 
   case 23: /* factor: unary  */
-#line 169 "valirian.y"
+#line 249 "valirian.y"
                   {
     (yyval.node) = (yyvsp[0].node);
 }
-#line 1799 "valirian.tab.c"
+#line 1864 "valirian.tab.c"
     break;
 
   case 24: /* unary: '-' factor  */
-#line 173 "valirian.y"
+#line 253 "valirian.y"
                       {
-    (yyval.node) = new Unary((yyvsp[0].node), '-');
+    (yyval.node) = ctx.ast.unary((yyvsp[0].node), '-');
 }
-#line 1807 "valirian.tab.c"
+#line 1872 "valirian.tab.c"
     break;
 
   case 25: /* global: TOK_LOOP '(' decl cond ';' pass ')' '{' globals '}'  */
-#line 177 "valirian.y"
+#line 257 "valirian.y"
                                                             {
-    (yyval.node) = new Loop((yyvsp[-7].node), (yyvsp[-6].node), (yyvsp[-4].node), (yyvsp[-1].node));
+    (yyval.node) = ctx.ast.loop((yyvsp[-7].node), (yyvsp[-6].node), (yyvsp[-4].node), (yyvsp[-1].node));
 }
-#line 1815 "valirian.tab.c"
+#line 1880 "valirian.tab.c"
     break;
 
   case 26: /* pass: TOK_IDENT TOK_DEC  */
-#line 181 "valirian.y"
+#line 261 "valirian.y"
                          {
-    (yyval.node) = new Pass((yyvsp[-1].str), "--");
+    (yyval.node) = ctx.ast.pass((yyvsp[-1].atom), "--");
 }
-#line 1823 "valirian.tab.c"
+#line 1888 "valirian.tab.c"
     break;
 
   case 27: /* pass: TOK_IDENT TOK_INC  */
-#line 185 "valirian.y"
+#line 265 "valirian.y"
                          {
-    (yyval.node) = new Pass((yyvsp[-1].str), "++");
+    (yyval.node) = ctx.ast.pass((yyvsp[-1].atom), "++");
 }
-#line 1831 "valirian.tab.c"
+#line 1896 "valirian.tab.c"
     break;
 
   case 28: /* cond: factor TOK_MENORI factor  */
-#line 189 "valirian.y"
+#line 269 "valirian.y"
                                         {
-    (yyval.node) = new Condition((yyvsp[-2].node), (yyvsp[0].node), "<=");
+    (yyval.node) = ctx.ast.condition((yyvsp[-2].node), (yyvsp[0].node), "<=");
 }
-#line 1839 "valirian.tab.c"
+#line 1904 "valirian.tab.c"
     break;
 
   case 29: /* cond: factor TOK_MAIORI factor  */
-#line 193 "valirian.y"
+#line 273 "valirian.y"
                                         {
-    (yyval.node) = new Condition((yyvsp[-2].node), (yyvsp[0].node), ">=");
+    (yyval.node) = ctx.ast.condition((yyvsp[-2].node), (yyvsp[0].node), ">=");
 }
-#line 1847 "valirian.tab.c"
+#line 1912 "valirian.tab.c"
     break;
 
   case 30: /* cond: factor TOK_IGUAL factor  */
-#line 197 "valirian.y"
+#line 277 "valirian.y"
                                        {
-    (yyval.node) = new Condition((yyvsp[-2].node), (yyvsp[0].node), "==");
+    (yyval.node) = ctx.ast.condition((yyvsp[-2].node), (yyvsp[0].node), "==");
 }
-#line 1855 "valirian.tab.c"
+#line 1920 "valirian.tab.c"
     break;
 
   case 31: /* cond: factor TOK_DIFE factor  */
-#line 201 "valirian.y"
+#line 281 "valirian.y"
                                       {
-    (yyval.node) = new Condition((yyvsp[-2].node), (yyvsp[0].node), "!=");
+    (yyval.node) = ctx.ast.condition((yyvsp[-2].node), (yyvsp[0].node), "!=");
 }
-#line 1863 "valirian.tab.c"
+#line 1928 "valirian.tab.c"
     break;
 
   case 32: /* cond: factor '<' factor  */
-#line 205 "valirian.y"
+#line 285 "valirian.y"
                                  {
-    (yyval.node) = new Condition((yyvsp[-2].node), (yyvsp[0].node), "<");
+    (yyval.node) = ctx.ast.condition((yyvsp[-2].node), (yyvsp[0].node), "<");
 }
-#line 1871 "valirian.tab.c"
+#line 1936 "valirian.tab.c"
     break;
 
   case 33: /* cond: factor '>' factor  */
-#line 209 "valirian.y"
+#line 289 "valirian.y"
                                  {
-    (yyval.node) = new Condition((yyvsp[-2].node), (yyvsp[0].node), ">");
+    (yyval.node) = ctx.ast.condition((yyvsp[-2].node), (yyvsp[0].node), ">");
 }
-#line 1879 "valirian.tab.c"
+#line 1944 "valirian.tab.c"
     break;
 
   case 34: /* cond: '(' cond TOK_OR cond ')'  */
-#line 213 "valirian.y"
+#line 293 "valirian.y"
                                       {
-    (yyval.node) = new Condition((yyvsp[-3].node), (yyvsp[-1].node), "||");
+    (yyval.node) = ctx.ast.condition((yyvsp[-3].node), (yyvsp[-1].node), "||");
 }
-#line 1887 "valirian.tab.c"
+#line 1952 "valirian.tab.c"
     break;
 
   case 35: /* cond: '(' cond TOK_AND cond ')'  */
-#line 217 "valirian.y"
+#line 297 "valirian.y"
                                        {
-    (yyval.node) = new Condition((yyvsp[-3].node), (yyvsp[-1].node), "&&");
+    (yyval.node) = ctx.ast.condition((yyvsp[-3].node), (yyvsp[-1].node), "&&");
 }
-#line 1895 "valirian.tab.c"
+#line 1960 "valirian.tab.c"
     break;
 
   case 36: /* decl: tip TOK_IDENT '=' der ';'  */
-#line 221 "valirian.y"
+#line 301 "valirian.y"
                                 {
-    (yyval.node) = new Variable(new TypeDec((yyvsp[-4].str)), (yyvsp[-3].str), (yyvsp[-1].node));
+    (yyval.node) = ctx.ast.variable((yyvsp[-4].str), (yyvsp[-3].atom), (yyvsp[-1].node));
 }
-#line 1903 "valirian.tab.c"
+#line 1968 "valirian.tab.c"
     break;
 
   case 37: /* decl: tip TOK_IDENT '=' scan ';'  */
-#line 225 "valirian.y"
+#line 305 "valirian.y"
                                       {
-    (yyval.node) = new Variable(new TypeDec((yyvsp[-4].str)), (yyvsp[-3].str), new Scan());
+    (yyval.node) = ctx.ast.variable((yyvsp[-4].str), (yyvsp[-3].atom), ctx.ast.scan());
 }
-#line 1911 "valirian.tab.c"
+#line 1976 "valirian.tab.c"
     break;
 
   case 38: /* der: expr  */
-#line 229 "valirian.y"
+#line 309 "valirian.y"
            {
     (yyval.node) = (yyvsp[0].node); 
 }
-#line 1919 "valirian.tab.c"
+#line 1984 "valirian.tab.c"
     break;
 
   case 39: /* der: TOK_STRING  */
-#line 232 "valirian.y"
+#line 312 "valirian.y"
                   {
-    (yyval.node) = new String((yyvsp[0].str));
+    (yyval.node) = ctx.ast.str((yyvsp[0].atom));
 }
-#line 1927 "valirian.tab.c"
+#line 1992 "valirian.tab.c"
     break;
 
   case 40: /* if: TOK_IF '(' cond ')' '{' globals '}'  */
-#line 236 "valirian.y"
+#line 316 "valirian.y"
                                           {
-    (yyval.node) = new If((yyvsp[-4].node), (yyvsp[-1].node));
+    (yyval.node) = ctx.ast.ifStmt((yyvsp[-4].node), (yyvsp[-1].node));
 }
-#line 1935 "valirian.tab.c"
+#line 2000 "valirian.tab.c"
     break;
 
   case 41: /* if: TOK_IF '(' cond ')' '{' globals '}' TOK_ELSE '{' globals '}'  */
-#line 240 "valirian.y"
+#line 320 "valirian.y"
                                                                           { 
-    (yyval.node) = new IfElse((yyvsp[-8].node), (yyvsp[-5].node), (yyvsp[-1].node));
+    (yyval.node) = ctx.ast.ifElse((yyvsp[-8].node), (yyvsp[-5].node), (yyvsp[-1].node));
     }
-#line 1943 "valirian.tab.c"
+#line 2008 "valirian.tab.c"
     break;
 
   case 42: /* print: TOK_PRINT '(' TOK_STRING ')' ';'  */
-#line 244 "valirian.y"
+#line 324 "valirian.y"
                                              {
-    String *value = new String((yyvsp[-2].str));
-    (yyval.node) = new Print(value);
+    (yyval.node) = ctx.ast.print(ctx.ast.str((yyvsp[-2].atom)));
 }
-#line 1952 "valirian.tab.c"
+#line 2016 "valirian.tab.c"
     break;
 
   case 43: /* print: TOK_PRINT '(' TOK_IDENT ')' ';'  */
-#line 249 "valirian.y"
+#line 328 "valirian.y"
                                             {
-    Ident *id = new Ident((yyvsp[-2].str));
-    (yyval.node) = new Print(id);
+    (yyval.node) = ctx.ast.print(ctx.ast.ident((yyvsp[-2].atom)));
 }
-#line 1961 "valirian.tab.c"
+#line 2024 "valirian.tab.c"
     break;
 
   case 44: /* tip: TOK_TIPOBOOL  */
-#line 254 "valirian.y"
+#line 332 "valirian.y"
                   {
     (yyval.str) = "bool";
 }
-#line 1969 "valirian.tab.c"
+#line 2032 "valirian.tab.c"
     break;
 
   case 45: /* tip: TOK_TIPOSTRING  */
-#line 258 "valirian.y"
+#line 336 "valirian.y"
                     {
     (yyval.str) = "string";
 }
-#line 1977 "valirian.tab.c"
+#line 2040 "valirian.tab.c"
     break;
 
   case 46: /* tip: TOK_TIPOFLOAT  */
-#line 262 "valirian.y"
+#line 340 "valirian.y"
                    {
     (yyval.str) = "float";
 }
-#line 1985 "valirian.tab.c"
+#line 2048 "valirian.tab.c"
     break;
 
   case 47: /* tip: TOK_TIPOINT  */
-#line 266 "valirian.y"
+#line 344 "valirian.y"
                  {
     (yyval.str) = "int";
 }
-#line 1993 "valirian.tab.c"
+#line 2056 "valirian.tab.c"
     break;
 
   case 48: /* scan: TOK_SCAN '(' tip ')'  */
-#line 270 "valirian.y"
+#line 348 "valirian.y"
                            {
-    (yyval.node) = new Scan(new TypeDec((yyvsp[-1].str)));
+    (yyval.node) = ctx.ast.scan((yyvsp[-1].str));
 }
-#line 2001 "valirian.tab.c"
+#line 2064 "valirian.tab.c"
     break;
 
 
-#line 2005 "valirian.tab.c"
+#line 2068 "valirian.tab.c"
 
       default: break;
     }
@@ -2075,7 +2138,7 @@ yyerrlab:
                 yysyntax_error_status = YYENOMEM;
               }
           }
-        yyerror (yymsgp);
+        yyerror (scanner, ctx, yymsgp);
         if (yysyntax_error_status == YYENOMEM)
           YYNOMEM;
       }
@@ -2095,7 +2158,7 @@ yyerrlab:
       else
         {
           yydestruct ("Error: discarding",
-                      yytoken, &yylval);
+                      yytoken, &yylval, scanner, ctx);
           yychar = YYEMPTY;
         }
     }
@@ -2151,7 +2214,7 @@ yyerrlab1:
 
 
       yydestruct ("Error: popping",
-                  YY_ACCESSING_SYMBOL (yystate), yyvsp);
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp, scanner, ctx);
       YYPOPSTACK (1);
       yystate = *yyssp;
       YY_STACK_PRINT (yyss, yyssp);
@@ -2189,7 +2252,7 @@ yyabortlab:
 | yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
 `-----------------------------------------------------------*/
 yyexhaustedlab:
-  yyerror (YY_("memory exhausted"));
+  yyerror (scanner, ctx, YY_("memory exhausted"));
   yyresult = 2;
   goto yyreturnlab;
 
@@ -2204,7 +2267,7 @@ yyreturnlab:
          user semantic actions for why this is necessary.  */
       yytoken = YYTRANSLATE (yychar);
       yydestruct ("Cleanup: discarding lookahead",
-                  yytoken, &yylval);
+                  yytoken, &yylval, scanner, ctx);
     }
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYABORT or YYACCEPT.  */
@@ -2213,7 +2276,7 @@ yyreturnlab:
   while (yyssp != yyss)
     {
       yydestruct ("Cleanup: popping",
-                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp);
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp, scanner, ctx);
       YYPOPSTACK (1);
     }
 #ifndef yyoverflow
@@ -2225,4 +2288,4 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 274 "valirian.y"
+#line 352 "valirian.y"
@@ -44,6 +44,27 @@
 #if YYDEBUG
 extern int yydebug;
 #endif
+/* "%code requires" blocks.  */
+#line 1 "valirian.y"
+
+#include <cstdint>
+#include "atoms.h"
+
+class Node;
+class Compilation;
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+// Valor semantico dos nao-terminais: no da arvore ou indice no AST compacto.
+struct NodeRef {
+    Node *node;
+    uint32_t id;
+};
+
+#line 68 "valirian.tab.h"
 
 /* Token kinds.  */
 #ifndef YYTOKENTYPE
@@ -85,14 +106,15 @@ extern int yydebug;
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 12 "valirian.y"
+#line 40 "valirian.y"
 
     const char *str;
+    Atom atom;
     int itg;
     double flt;
-    Node *node;
+    NodeRef node;
 
-#line 96 "valirian.tab.h"
+#line 118 "valirian.tab.h"
 
 };
 typedef union YYSTYPE YYSTYPE;
@@ -101,10 +123,9 @@ typedef union YYSTYPE YYSTYPE;
 #endif
 
 
-extern YYSTYPE yylval;
 
 
-int yyparse (void);
+int yyparse (yyscan_t scanner, Compilation &ctx);
 
 
 #endif /* !YY_YY_VALIRIAN_TAB_H_INCLUDED  */
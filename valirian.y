@@ -1,19 +1,48 @@
-%{
-#include "nodes.h"
+%code requires {
+#include <cstdint>
+#include "atoms.h"
 
-int yyerror(const char *s);
-int yylex(void);
-int errorcount = 0;
-extern bool force_print_tree;
-%}
+class Node;
+class Compilation;
 
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+// Valor semantico dos nao-terminais: no da arvore ou indice no AST compacto.
+struct NodeRef {
+    Node *node;
+    uint32_t id;
+};
+}
+
+%code {
+#include "compilation.h"
+#include "passes.h"
+#include "interpreter.h"
+#include "vm.h"
+#include "jit.h"
+#include "stencil.h"
+#include "ssa.h"
+#include "asm.h"
+#include "cgen.h"
+
+int yyerror(yyscan_t scanner, Compilation &ctx, const char *s);
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+}
+
+%define api.pure full
 %define parse.error verbose
+%param {yyscan_t scanner}
+%parse-param {Compilation &ctx}
 
 %union {
     const char *str;
+    Atom atom;
     int itg;
     double flt;
-    Node *node;
+    NodeRef node;
 }
 
 %token TOK_IDENT
@@ -40,15 +69,17 @@ extern bool force_print_tree;
 %token TOK_OR
 %token TOK_AND
 
-%type<str> tip TOK_IDENT TOK_STRING TOK_SCAN TOK_TIPOINT TOK_TIPOFLOAT TOK_TIPOSTRING TOK_TIPOBOOL
+%type<str> tip TOK_SCAN TOK_TIPOINT TOK_TIPOFLOAT TOK_TIPOSTRING TOK_TIPOBOOL
+%type<atom> TOK_IDENT TOK_STRING
 %type<itg> TOK_INT 
 %type<flt> TOK_FLOAT
 %type<node> globals global expr term factor unary pass cond decl der if print scan
 
 %printer { fprintf(yyo, "%s", $$);} <str>
+%printer { fprintf(yyo, "%s", atoms.c_str($$));} <atom>
 %printer { fprintf(yyo, "%d", $$);} <itg>
 %printer { fprintf(yyo, "%f", $$);} <flt>
-%printer { fprintf(yyo, "%s", $$-> toDebug().c_str());} <node>
+%printer { fprintf(yyo, "%s", ctx.ast.toDebug($$).c_str());} <node>
 
 %start program
 
@@ -56,50 +87,99 @@ extern bool force_print_tree;
 
 
 program : globals {
-    Node *program = new Program();
-    program->append($globals);
-
-    CheckVarDecl cvd;
-    cout << "Checking variable declarations..." << endl;
-    cvd.check(program);
-    cout << "erros: " << errorcount << endl;
-
-    CheckVarMix cvm;
-    cout << "Checking type mix declarations..." << endl;
-    cvm.check(program);
-    cout << "erros: " << errorcount << endl;
-
-    CheckDuplicateVariable cdv;
-    cout << "Checking duplicate variable declarations..." << endl;
-    cdv.check(program, "global"); 
-    cout << "erros: " << errorcount << endl;
-
-    if (errorcount > 0)
-        cout << errorcount << " error(s) found" << endl;
-    if (force_print_tree || errorcount == 0)
-        printf_tree(program);
+    NodeRef program = ctx.ast.program($globals);
+
+    const Options &opts = ctx.options;
+    DiagnosticEngine &diagnostics = ctx.diagnostics;
+    PassManager passes(diagnostics, !opts.separate_passes, opts.compact_ast);
+    passes.run(program, ctx.ast.flat);
+
+    size_t errors = diagnostics.count();
+    if (diagnostics.limitReached())
+        diagnostics.note("Error limit reached, stopping.");
+    if (errors > 0)
+        diagnostics.note("", errors, " error(s) found");
+    if (opts.optimize && (errors == 0 || opts.force_print_tree))
+        passes.optimize(program, ctx.ast.flat);
+    if (opts.run || opts.vm || opts.jit || opts.trace || opts.baseline) {
+        diagnostics.write(ctx.out);
+        if (errors == 0 && opts.vm) {
+            Chunk chunk = BytecodeCompiler().compile(static_cast<Program*>(program.node));
+            ctx.failed = !VM(ctx.file_name, ctx.out).run(chunk);
+        }
+        else if (errors == 0 && opts.baseline) {
+            Chunk chunk = BytecodeCompiler().compile(static_cast<Program*>(program.node));
+            ctx.failed = !BaselineRunner(ctx.file_name, ctx.out).run(chunk);
+        }
+        else if (errors == 0 && (opts.jit || opts.trace)) {
+            Jit jit(ctx.out, opts.trace);
+            Interpreter interp(ctx.file_name, ctx.out);
+            interp.setLoopRunner(&jit);
+            ctx.failed = !interp.run(static_cast<Program*>(program.node));
+        }
+        else if (errors == 0) {
+            Interpreter interp(ctx.file_name, ctx.out);
+            ctx.failed = !interp.run(static_cast<Program*>(program.node));
+        }
+        else
+            diagnostics.note("Errors found, not running the program.");
+    }
+    else if (opts.emit_ssa) {
+        diagnostics.write(ctx.out);
+        if (errors == 0) {
+            IrFunction fn = build_ssa(static_cast<Program*>(program.node));
+            for (const string &e : verify_ir(fn))
+                diagnostics.note("Invalid SSA: " + e);
+            print_ir(fn, ctx.treeOutput());
+        }
+        else
+            diagnostics.note("Errors found, not emitting SSA.");
+    }
+    else if (opts.emit_asm || opts.native || opts.emit_c || opts.native_c) {
+        diagnostics.write(ctx.out);
+        Program *tree = static_cast<Program*>(program.node);
+        if (errors > 0)
+            diagnostics.note("Errors found, not generating code.");
+        else if (opts.emit_asm)
+            AsmGenerator(ctx.file_name, ctx.treeOutput()).generate(tree);
+        else if (opts.emit_c)
+            CGenerator(ctx.file_name).generate(tree, ctx.treeOutput());
+        else {
+            diagnostics.note(opts.native ? "Assembling and linking..." : "Compiling with gcc -O2...");
+            string exe;
+            string error = opts.native ? build_native(tree, ctx.file_name, exe) : build_native_c(tree, ctx.file_name, exe);
+            diagnostics.note(error.empty() ? "executável: " + exe : error);
+        }
+    }
+    else if (opts.force_print_tree || errors == 0) {
+        diagnostics.write(ctx.out);
+        if (opts.compact_ast)
+            flat_printf_tree(ctx.ast.flat, program.id, ctx.treeOutput());
+        else
+            printf_tree(program.node, ctx.treeOutput());
+    }
     else
-        cout << "Errors found, not printing the tree." << endl;
+        diagnostics.note("Errors found, not printing the tree.");
+    diagnostics.write(ctx.out);
+
+    ctx.ast.flat.release();
 }
 
 
 globals : globals[gg] global {
-    $gg->append($global);
-    $$ = $gg;
+    $$ = ctx.ast.append($gg, $global);
 }
 
 globals : global {
-    Node *n = new Node();
-    n->append($global);
-    $$ = n;
+    $$ = ctx.ast.stmts($global);
 }
 
 global : TOK_IDENT '=' expr ';' {
-    $$ = new Attribution($TOK_IDENT, $expr);
+    $$ = ctx.ast.attribution($TOK_IDENT, $expr);
 }
 
 global : TOK_IDENT '=' scan ';' {
-    $$ = new Scan();
+    $$ = ctx.ast.attribution($TOK_IDENT, ctx.ast.scan());
 }
 
 global : if {
@@ -115,11 +195,11 @@ global : decl{
 }
 
 expr : expr[ee] '+' term {
-    $$ = new BinaryOp($ee, $term, '+');
+    $$ = ctx.ast.binaryOp($ee, $term, '+');
 }
 
 expr : expr[ee] '-' term {
-    $$ = new BinaryOp($ee, $term, '-');
+    $$ = ctx.ast.binaryOp($ee, $term, '-');
 }
 
 expr : term {
@@ -127,15 +207,15 @@ expr : term {
 }
 
 term : term[tt] '*' factor {
-    $$ = new BinaryOp($tt, $factor, '*');
+    $$ = ctx.ast.binaryOp($tt, $factor, '*');
 }
 
 term : term[tt] '/' factor {
-    $$ = new BinaryOp($tt, $factor, '/');
+    $$ = ctx.ast.binaryOp($tt, $factor, '/');
 }
 
 term : term[tt] '%' factor {
-    $$ = new BinaryOp($tt, $factor, '%');
+    $$ = ctx.ast.binaryOp($tt, $factor, '%');
 }
 
 term : factor {
@@ -147,23 +227,23 @@ factor : '(' expr ')' {
 }
 
 factor : TOK_IDENT[str] {
-    $$ = new Ident($str);
+    $$ = ctx.ast.ident($str);
 }
 
 factor : TOK_INT[itg] {
-    $$ = new Integer($itg);
+    $$ = ctx.ast.integer($itg);
 }
 
 factor : TOK_FLOAT[flt] {
-    $$ = new Float($flt);
+    $$ = ctx.ast.floating($flt);
 }
 
 factor : TOK_TRUE{
-    $$ = new True();
+    $$ = ctx.ast.boolean(true);
 }
 
 factor : TOK_FALSE{
-    $$ = new False();
+    $$ = ctx.ast.boolean(false);
 }
 
 factor : unary[u] {
@@ -171,84 +251,82 @@ factor : unary[u] {
 }
 
 unary : '-' factor[f] {
-    $$ = new Unary($f, '-');
+    $$ = ctx.ast.unary($f, '-');
 }
 
 global : TOK_LOOP '(' decl cond ';' pass ')' '{' globals '}'{
-    $$ = new Loop($decl, $cond, $pass, $globals);
+    $$ = ctx.ast.loop($decl, $cond, $pass, $globals);
 }
 
 pass : TOK_IDENT TOK_DEC {
-    $$ = new Pass($TOK_IDENT, "--");
+    $$ = ctx.ast.pass($TOK_IDENT, "--");
 }
 
 pass : TOK_IDENT TOK_INC {
-    $$ = new Pass($TOK_IDENT, "++");
+    $$ = ctx.ast.pass($TOK_IDENT, "++");
 }
 
 cond : factor[f1] TOK_MENORI factor[f2] {
-    $$ = new Condition($f1, $f2, "<=");
+    $$ = ctx.ast.condition($f1, $f2, "<=");
 }
 
 cond : factor[f1] TOK_MAIORI factor[f2] {
-    $$ = new Condition($f1, $f2, ">=");
+    $$ = ctx.ast.condition($f1, $f2, ">=");
 }
 
 cond : factor[f1] TOK_IGUAL factor[f2] {
-    $$ = new Condition($f1, $f2, "==");
+    $$ = ctx.ast.condition($f1, $f2, "==");
 }
 
 cond : factor[f1] TOK_DIFE factor[f2] {
-    $$ = new Condition($f1, $f2, "!=");
+    $$ = ctx.ast.condition($f1, $f2, "!=");
 }
 
 cond : factor[f1] '<' factor[f2] {
-    $$ = new Condition($f1, $f2, "<");
+    $$ = ctx.ast.condition($f1, $f2, "<");
 }
 
 cond : factor[f1] '>' factor[f2] {
-    $$ = new Condition($f1, $f2, ">");
+    $$ = ctx.ast.condition($f1, $f2, ">");
 }
 
 cond : '('cond[c1] TOK_OR cond[c2] ')'{
-    $$ = new Condition($c1, $c2, "||");
+    $$ = ctx.ast.condition($c1, $c2, "||");
 }
 
 cond : '('cond[c1] TOK_AND cond[c2] ')'{
-    $$ = new Condition($c1, $c2, "&&");
+    $$ = ctx.ast.condition($c1, $c2, "&&");
 }
 
 decl : tip TOK_IDENT '=' der ';'{
-    $$ = new Variable(new TypeDec($tip), $TOK_IDENT, $der);
+    $$ = ctx.ast.variable($tip, $TOK_IDENT, $der);
 }
 
 decl : tip TOK_IDENT[str] '=' scan ';'{
-    $$ = new Variable(new TypeDec($tip), $str, new Scan());
+    $$ = ctx.ast.variable($tip, $str, ctx.ast.scan());
 }
 
 der : expr {
     $$ = $expr; 
 }
 | TOK_STRING[str] {
-    $$ = new String($str);
+    $$ = ctx.ast.str($str);
 }
 
 if : TOK_IF '('  cond  ')' '{' globals '}'{
-    $$ = new If($cond, $globals);
+    $$ = ctx.ast.ifStmt($cond, $globals);
 }
 
 if : TOK_IF '(' cond ')' '{' globals[g1] '}' TOK_ELSE '{' globals[g2] '}' { 
-    $$ = new IfElse($cond, $g1, $g2);
+    $$ = ctx.ast.ifElse($cond, $g1, $g2);
     }
 
 print : TOK_PRINT '(' TOK_STRING[str] ')' ';'{
-    String *value = new String($str);
-    $$ = new Print(value);
+    $$ = ctx.ast.print(ctx.ast.str($str));
 }
 
 print : TOK_PRINT '(' TOK_IDENT[str] ')' ';'{
-    Ident *id = new Ident($str);
-    $$ = new Print(id);
+    $$ = ctx.ast.print(ctx.ast.ident($str));
 }
 
 tip : TOK_TIPOBOOL{
@@ -268,7 +346,7 @@ tip : TOK_TIPOINT{
 }
 
 scan : TOK_SCAN '(' tip ')'{
-    $$ = new Scan(new TypeDec($tip));
+    $$ = ctx.ast.scan($tip);
 }
 
 %%
\ No newline at end of file
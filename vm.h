@@ -0,0 +1,196 @@
+#ifndef VM_H
+#define VM_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "bytecode.h"
+
+using namespace std;
+
+// Despacho por threaded code (goto computado, extensao do GCC/Clang) quando
+// o compilador suporta; com -DVALIRIAN_SWITCH_DISPATCH, ou fora do GCC,
+// volta para o switch portavel.
+#if defined(__GNUC__) && !defined(VALIRIAN_SWITCH_DISPATCH)
+#define VM_THREADED 1
+#else
+#define VM_THREADED 0
+#endif
+
+// Executa um Chunk (--vm). A saida e os erros sao os mesmos do
+// Interpreter; so muda o caminho: um laco de despacho sobre instrucoes de
+// largura fixa e um vetor de registradores, sem andar pelos filhos da
+// arvore.
+class VM {
+private:
+    const char *file;
+    FILE *out;
+    FILE *in;
+
+#if VM_THREADED
+    // Instrucao com o endereco do rotulo do seu opcode no lugar do opcode.
+    struct Threaded {
+        const void *handler;
+        uint32_t a, b, c;
+    };
+#endif
+
+    void fail(const Chunk &chunk, size_t pc, string_view msg, string_view arg = "") {
+        fprintf(out, "%s:%d:0: runtime error: %.*s%.*s\n", file, chunk.lines[pc],
+                (int) msg.size(), msg.data(), (int) arg.size(), arg.data());
+        fflush(out);
+    }
+
+    bool scan(Reg &r, ValueType type, const Chunk &chunk, size_t pc) {
+        char buf[256];
+        Value v;
+        if (const char *err = scan_value(in, type, v, buf)) {
+            fail(chunk, pc, err, buf);
+            return false;
+        }
+        switch (v.type) {
+        case VT_INT: r.i = v.i; break;
+        case VT_FLOAT: r.f = v.f; break;
+        case VT_BOOL: r.i = v.b; break;
+        case VT_STRING: r.str.s = v.s; r.str.len = v.len; break;
+        }
+        return true;
+    }
+
+    static int compare(const Reg &a, const Reg &b) {
+        return string_view(a.str.s, a.str.len).compare(string_view(b.str.s, b.str.len));
+    }
+
+public:
+    VM(const char *file, FILE *out, FILE *in = stdin) : file(file), out(out), in(in) {}
+
+    // false se o programa parou num erro de execucao.
+    bool run(const Chunk &chunk) {
+        vector<Reg> regs(chunk.numRegs, Reg{});
+        if (!chunk.consts.empty())
+            memcpy(&regs[chunk.constBase], chunk.consts.data(), chunk.consts.size() * sizeof(Reg));
+        Reg *R = regs.data();
+
+        // Os corpos das instrucoes sao os mesmos nos dois despachos: OP()
+        // abre o corpo (rotulo ou case) e NEXT() segue para a proxima.
+#if VM_THREADED
+        static const void *const labels[] = {
+            &&op_MOV, &&op_I2F, &&op_F2I,
+            &&op_ADD_I, &&op_SUB_I, &&op_MUL_I, &&op_DIV_I, &&op_MOD_I,
+            &&op_ADD_F, &&op_SUB_F, &&op_MUL_F, &&op_DIV_F, &&op_MOD_F,
+            &&op_NEG_I, &&op_NEG_F, &&op_INC_I, &&op_INC_F,
+            &&op_JMP, &&op_JT, &&op_JF,
+            &&op_JLT_I, &&op_JLE_I, &&op_JEQ_I, &&op_JNE_I,
+            &&op_JLT_F, &&op_JLE_F, &&op_JEQ_F, &&op_JNE_F,
+            &&op_JLT_S, &&op_JLE_S, &&op_JEQ_S, &&op_JNE_S,
+            &&op_SCAN_I, &&op_SCAN_F, &&op_SCAN_S, &&op_SCAN_B,
+            &&op_PRINT_I, &&op_PRINT_F, &&op_PRINT_S, &&op_PRINT_B,
+            &&op_FAIL, &&op_HALT
+        };
+        static_assert(sizeof(labels) / sizeof(*labels) == OP_COUNT, "um rotulo por opcode");
+
+        vector<Threaded> threaded(chunk.code.size());
+        for (size_t i = 0; i < threaded.size(); i++) {
+            const Instr &ins = chunk.code[i];
+            threaded[i] = {labels[ins.op], ins.a, ins.b, ins.c};
+        }
+        const Threaded *code = threaded.data();
+#define OP(name) op_##name:
+#define NEXT() goto *(ins = ip++)->handler
+#else
+        const Instr *code = chunk.code.data();
+#define OP(name) case OP_##name:
+#define NEXT() break
+#endif
+        auto ip = code;
+        auto ins = ip;
+
+#if VM_THREADED
+        NEXT();
+#else
+        for (;;) {
+            ins = ip++;
+            switch (ins->op) {
+#endif
+            OP(MOV) R[ins->a] = R[ins->b]; NEXT();
+            OP(I2F) R[ins->a].f = (double) R[ins->b].i; NEXT();
+            OP(F2I) R[ins->a].i = (int) R[ins->b].f; NEXT();
+
+            // giez da a volta no overflow, como no interpretador
+            OP(ADD_I) R[ins->a].i = (int) ((unsigned) R[ins->b].i + (unsigned) R[ins->c].i); NEXT();
+            OP(SUB_I) R[ins->a].i = (int) ((unsigned) R[ins->b].i - (unsigned) R[ins->c].i); NEXT();
+            OP(MUL_I) R[ins->a].i = (int) ((unsigned) R[ins->b].i * (unsigned) R[ins->c].i); NEXT();
+            OP(DIV_I) {
+                int x = R[ins->b].i, y = R[ins->c].i;
+                if (y == 0) {
+                    fail(chunk, ins - code, "divisão por zero");
+                    return false;
+                }
+                R[ins->a].i = y == -1 ? (int) (0u - (unsigned) x) : x / y;
+                NEXT();
+            }
+            OP(MOD_I) {
+                int x = R[ins->b].i, y = R[ins->c].i;
+                if (y == 0) {
+                    fail(chunk, ins - code, "divisão por zero");
+                    return false;
+                }
+                R[ins->a].i = y == -1 ? 0 : x % y;
+                NEXT();
+            }
+            OP(ADD_F) R[ins->a].f = R[ins->b].f + R[ins->c].f; NEXT();
+            OP(SUB_F) R[ins->a].f = R[ins->b].f - R[ins->c].f; NEXT();
+            OP(MUL_F) R[ins->a].f = R[ins->b].f * R[ins->c].f; NEXT();
+            OP(DIV_F) R[ins->a].f = R[ins->b].f / R[ins->c].f; NEXT();
+            OP(MOD_F) R[ins->a].f = fmod(R[ins->b].f, R[ins->c].f); NEXT();
+            OP(NEG_I) R[ins->a].i = (int) (0u - (unsigned) R[ins->b].i); NEXT();
+            OP(NEG_F) R[ins->a].f = -R[ins->b].f; NEXT();
+            OP(INC_I) R[ins->a].i = (int) ((unsigned) R[ins->a].i + ins->b); NEXT();
+            OP(INC_F) R[ins->a].f += (int32_t) ins->b; NEXT();
+
+            OP(JMP) ip = code + ins->c; NEXT();
+            OP(JT) if (R[ins->a].i) ip = code + ins->c; NEXT();
+            OP(JF) if (!R[ins->a].i) ip = code + ins->c; NEXT();
+            OP(JLT_I) if (R[ins->a].i < R[ins->b].i) ip = code + ins->c; NEXT();
+            OP(JLE_I) if (R[ins->a].i <= R[ins->b].i) ip = code + ins->c; NEXT();
+            OP(JEQ_I) if (R[ins->a].i == R[ins->b].i) ip = code + ins->c; NEXT();
+            OP(JNE_I) if (R[ins->a].i != R[ins->b].i) ip = code + ins->c; NEXT();
+            // pelo resultado de tres vias: NaN conta como igual
+            OP(JLT_F) if (R[ins->a].f < R[ins->b].f) ip = code + ins->c; NEXT();
+            OP(JLE_F) if (!(R[ins->a].f > R[ins->b].f)) ip = code + ins->c; NEXT();
+            OP(JEQ_F) if (!(R[ins->a].f < R[ins->b].f) && !(R[ins->a].f > R[ins->b].f)) ip = code + ins->c; NEXT();
+            OP(JNE_F) if (R[ins->a].f < R[ins->b].f || R[ins->a].f > R[ins->b].f) ip = code + ins->c; NEXT();
+            OP(JLT_S) if (compare(R[ins->a], R[ins->b]) < 0) ip = code + ins->c; NEXT();
+            OP(JLE_S) if (compare(R[ins->a], R[ins->b]) <= 0) ip = code + ins->c; NEXT();
+            OP(JEQ_S) if (compare(R[ins->a], R[ins->b]) == 0) ip = code + ins->c; NEXT();
+            OP(JNE_S) if (compare(R[ins->a], R[ins->b]) != 0) ip = code + ins->c; NEXT();
+
+            OP(SCAN_I) if (!scan(R[ins->a], VT_INT, chunk, ins - code)) return false; NEXT();
+            OP(SCAN_F) if (!scan(R[ins->a], VT_FLOAT, chunk, ins - code)) return false; NEXT();
+            OP(SCAN_S) if (!scan(R[ins->a], VT_STRING, chunk, ins - code)) return false; NEXT();
+            OP(SCAN_B) if (!scan(R[ins->a], VT_BOOL, chunk, ins - code)) return false; NEXT();
+            OP(PRINT_I) print_value(out, Value::ofInt(R[ins->a].i)); NEXT();
+            OP(PRINT_F) print_value(out, Value::ofFloat(R[ins->a].f)); NEXT();
+            OP(PRINT_S) print_value(out, Value::ofString(string_view(R[ins->a].str.s, R[ins->a].str.len))); NEXT();
+            OP(PRINT_B) print_value(out, Value::ofBool(R[ins->a].i != 0)); NEXT();
+
+            OP(FAIL)
+                fail(chunk, ins - code, chunk.messages[ins->a]);
+                return false;
+            OP(HALT)
+                fflush(out);
+                return true;
+#if !VM_THREADED
+            default:
+                return true;
+            }
+        }
+#endif
+#undef OP
+#undef NEXT
+    }
+};
+
+#endif